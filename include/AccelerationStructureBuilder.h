@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/viewer/Window.h>
+#include <vsg/vk/CommandPool.h>
+#include <vsg/vk/Queue.h>
+#include "RayTracingScene.h"
+
+// Bytes of device memory used by a scene, and time taken to build its BLASes
+struct SceneMemoryReport
+{
+  uint32_t numBLAS = 0;
+  uint32_t numCompactedBLAS = 0;
+  VkDeviceSize blasBytes = 0;
+  VkDeviceSize uncompactedBLASBytes = 0; // BLAS bytes before compaction
+  VkDeviceSize tlasBytes = 0;
+  VkDeviceSize scratchBytes = 0; // Build scratch of all BLASes and TLAS
+  VkDeviceSize attributeBytes = 0; // Indices, vertex attributes, object infos and materials
+  VkDeviceSize textureBytes = 0; // Currently resident texture data
+  VkDeviceSize deduplicatedTextureBytes = 0; // Texture data not uploaded because identical images were shared (see RayTracingScene::findTexture)
+  double blasBuildMilliseconds = 0.0; // Wall time of BLAS builds and compaction, including waits for the GPU
+
+  void print(std::ostream& stream) const;
+};
+
+// Builds BLASes of a scene before TLAS, so that BLASes created with allowCompaction can be compacted
+// before TLAS refers to them. TLAS is built later when commands of RayTracer are compiled.
+class AccelerationStructureBuilder : public vsg::Inherit<vsg::Object, AccelerationStructureBuilder>
+{
+public:
+  AccelerationStructureBuilder(vsg::ref_ptr<vsg::Window> window);
+
+  // Upload geometry of new primitives (see RayTracingScene::uploadGeometry), then build BLASes which are not built yet
+  // (BLASes shared with snapshots are built once), and compact them if allowed
+  void build(RayTracingScene* scene);
+
+  SceneMemoryReport report(RayTracingScene* scene) const;
+
+  double buildMilliseconds = 0.0; // Accumulated by build
+
+protected:
+  void buildAndCompact(RayTracingScene* scene);
+
+  vsg::ref_ptr<vsg::Window> window;
+  vsg::ref_ptr<vsg::CommandPool> commandPool;
+  vsg::ref_ptr<vsg::Queue> queue;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include "RayTracingScene.h"
+#include "GLTFAnimation.h"
+#include "MeshOptimizer.h"
+
+// Loads glTF files and an environment map into a scene on a worker thread, so that the viewer can run meanwhile.
+// Meshes are added to the scene as they are loaded, and snapshots of it (RayTracingScene::createSnapshot) can be rendered until loading finishes.
+// Files are loaded in order into the same scene, sharing identical textures.
+class AsyncSceneLoader : public vsg::Inherit<vsg::Object, AsyncSceneLoader>
+{
+public:
+  // An empty envMapFile keeps the environment map of the scene
+  AsyncSceneLoader(vsg::ref_ptr<RayTracingScene> scene, const std::vector<std::string>& gltfFiles, const std::string& envMapFile, std::optional<MeshOptimizer> meshOptimizer = std::nullopt);
+
+  bool finished() const { return done; }
+  // Block until loading finishes. Returns false on error
+  bool wait();
+
+  // Results below are valid after loading finished
+  bool succeeded = false;
+  vsg::ref_ptr<GLTFAnimation> animation; // Of the first file which has animations
+  std::optional<MeshOptimizer> meshOptimizer;
+
+  vsg::ref_ptr<RayTracingScene> scene;
+
+protected:
+  virtual ~AsyncSceneLoader();
+
+  void load(const std::vector<std::string>& gltfFiles, const std::string& envMapFile);
+
+  std::atomic<bool> done = false;
+  std::thread worker;
+};
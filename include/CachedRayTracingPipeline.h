@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/vk/Device.h>
+#include <vsg/vk/Context.h>
+#include <vsg/commands/Command.h>
+#include <vsg/state/PipelineLayout.h>
+#include <vsg/state/ShaderStage.h>
+#include <vsg/raytracing/RayTracingShaderGroup.h>
+#include "PipelineCache.h"
+
+// Same as vsg::RayTracingPipeline, but created through a PipelineCache (vsg::RayTracingPipeline always passes VK_NULL_HANDLE).
+// Time spent in the driver and whether a cache file was loaded are reported when it is compiled.
+// compile throws vsg::Exception if the pipeline cannot be created, like vsg::RayTracingPipeline.
+class CachedRayTracingPipeline : public vsg::Inherit<vsg::Object, CachedRayTracingPipeline>
+{
+public:
+  CachedRayTracingPipeline(vsg::ref_ptr<vsg::PipelineLayout> layout, const vsg::ShaderStages& shaderStages, const vsg::RayTracingShaderGroups& shaderGroups);
+
+  void compile(vsg::Context& context);
+  // Destroy the pipeline, so that the next compile creates it again from current shader stages and groups. The GPU must not use it
+  void release();
+
+  VkPipeline vk() const { return pipeline; }
+
+  vsg::ref_ptr<vsg::PipelineLayout> layout;
+  vsg::ShaderStages shaderStages;
+  vsg::RayTracingShaderGroups shaderGroups;
+  uint32_t maxRecursionDepth = 1;
+
+  // Null means no cache. It has to be set before compile
+  vsg::ref_ptr<PipelineCache> pipelineCache;
+
+protected:
+  virtual ~CachedRayTracingPipeline();
+
+  vsg::ref_ptr<vsg::Device> device;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+};
+
+// Same as vsg::BindRayTracingPipeline, for CachedRayTracingPipeline
+class BindCachedRayTracingPipeline : public vsg::Inherit<vsg::Command, BindCachedRayTracingPipeline>
+{
+public:
+  BindCachedRayTracingPipeline(vsg::ref_ptr<CachedRayTracingPipeline> pipeline) : pipeline(pipeline) {}
+
+  void compile(vsg::Context& context) override { pipeline->compile(context); }
+  void record(vsg::CommandBuffer& commandBuffer) const override;
+
+  vsg::ref_ptr<CachedRayTracingPipeline> pipeline;
+};
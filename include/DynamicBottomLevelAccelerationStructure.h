@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vsg/core/Inherit.h>
+#include <vsg/raytracing/BottomLevelAccelerationStructure.h>
+#include <vsg/vk/Buffer.h>
+#include <vsg/vk/CommandBuffer.h>
+
+// Trade-off between tracing performance and build time of an acceleration structure
+enum class AccelerationStructureBuildPreference
+{
+  FAST_TRACE, // VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR (default of VSG)
+  FAST_BUILD  // VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR
+};
+
+// BLAS which can be refitted in place after the first build (see MeshDeformer),
+// or compacted after the first build (see AccelerationStructureBuilder)
+class DynamicBottomLevelAccelerationStructure : public vsg::Inherit<vsg::BottomLevelAccelerationStructure, DynamicBottomLevelAccelerationStructure>
+{
+public:
+  DynamicBottomLevelAccelerationStructure(vsg::Device* device);
+
+  void compile(vsg::Context& context) override;
+
+  VkBuildAccelerationStructureFlagsKHR buildFlags() const { return _accelerationStructureBuildGeometryInfo.flags; }
+
+  // Build with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR. It has to be set before compile.
+  bool allowUpdate = false;
+  // Build with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR. It has to be set before compile.
+  bool allowCompaction = false;
+  // It has to be set before compile.
+  AccelerationStructureBuildPreference buildPreference = AccelerationStructureBuildPreference::FAST_TRACE;
+
+  bool compiled() const { return isCompiled; }
+  bool compacted() const { return compactedSize > 0; }
+
+  // Bytes of the structure (after compaction if compacted) and of the scratch buffer used by the build
+  VkDeviceSize size() const;
+  VkDeviceSize uncompactedSize() const { return _accelerationStructureBuildSizesInfo.accelerationStructureSize; }
+  VkDeviceSize buildScratchSize() const { return _accelerationStructureBuildSizesInfo.buildScratchSize; }
+
+  // Replace the built structure with a copy of newSize bytes (queried with VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR).
+  // The copy is recorded into commandBuffer, and the original has to be released by releaseUncompacted after the commands finished.
+  void recordCompaction(vsg::CommandBuffer& commandBuffer, VkDeviceSize newSize);
+  void releaseUncompacted();
+
+protected:
+  // Set build flags from allowUpdate, allowCompaction and buildPreference
+  void applyBuildFlags();
+
+  bool isCompiled = false;
+  VkDeviceSize compactedSize = 0;
+
+  // Original structure kept alive until the compacting copy finished
+  VkAccelerationStructureKHR uncompacted = VK_NULL_HANDLE;
+  vsg::ref_ptr<vsg::Buffer> uncompactedBuffer;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vsg/core/Inherit.h>
+#include <vsg/raytracing/TopLevelAccelerationStructure.h>
+
+// TLAS which can be updated in place after the first build.
+// Instances cannot be added or removed after compile, but their transforms can be changed
+// (see UpdateTopLevelAccelerationStructure).
+class DynamicTopLevelAccelerationStructure : public vsg::Inherit<vsg::TopLevelAccelerationStructure, DynamicTopLevelAccelerationStructure>
+{
+public:
+  DynamicTopLevelAccelerationStructure(vsg::Device* device);
+
+  void compile(vsg::Context& context) override;
+
+  VkBuildAccelerationStructureFlagsKHR buildFlags() const { return _accelerationStructureBuildGeometryInfo.flags; }
+
+  // Build with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR. It has to be set before compile.
+  bool allowUpdate = false;
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/core/Array.h>
+#include <vsg/maths/vec3.h>
+#include <vsg/maths/quat.h>
+#include <vsg/maths/mat4.h>
+#include "RayTracingScene.h"
+
+// Plays back glTF node animations by moving instances of a RayTracingScene.
+// Skins and morph target weights are passed to MeshDeformer of the scene.
+class GLTFAnimation : public vsg::Inherit<vsg::Object, GLTFAnimation>
+{
+public:
+  enum class Path
+  {
+    TRANSLATION, ROTATION, SCALE, WEIGHTS
+  };
+
+  enum class Interpolation
+  {
+    STEP, LINEAR, CUBICSPLINE
+  };
+
+  struct Channel
+  {
+    int node;
+    Path path;
+    Interpolation interpolation;
+    vsg::ref_ptr<vsg::floatArray> times;
+    vsg::ref_ptr<vsg::floatArray> values; // For CUBICSPLINE, (in-tangent, value, out-tangent) triplets
+    uint32_t numComponents; // Number of floats per value
+  };
+
+  // Static state of a glTF node
+  struct Node
+  {
+    std::vector<int> children;
+    vsg::mat4 matrix; // Identity unless the node has a matrix
+    vsg::vec3 translation = vsg::vec3(0.0f, 0.0f, 0.0f);
+    vsg::quat rotation = vsg::quat(0.0f, 0.0f, 0.0f, 1.0f);
+    vsg::vec3 scale = vsg::vec3(1.0f, 1.0f, 1.0f);
+    std::vector<float> weights; // Morph target weights
+    int skin = -1;
+    std::vector<uint32_t> instanceIds;  // Instances in the scene created from mesh of this node
+  };
+
+  struct Skin
+  {
+    std::vector<int> joints;  // Node indices
+    std::vector<vsg::mat4> inverseBindMatrices;
+  };
+
+  GLTFAnimation(vsg::ref_ptr<RayTracingScene> scene);
+
+  // Evaluate channels at given time (in seconds, looped by duration) and update instance transforms
+  void update(double time);
+
+  std::vector<Node> nodes;
+  std::vector<int> rootNodes;
+  std::vector<Skin> skins;
+  std::vector<Channel> channels;
+  double duration = 0.0;
+
+protected:
+  // Write interpolated value into result (numComponents floats)
+  void sample(const Channel& channel, float time, float* result) const;
+  void updateNode(int nodeIdx, const vsg::mat4& parentTransform);
+  void updateDeformation(int nodeIdx);
+
+  vsg::ref_ptr<RayTracingScene> scene;
+
+  // TRS of each node at the current time
+  std::vector<vsg::vec3> translations;
+  std::vector<vsg::vec4> rotations;
+  std::vector<vsg::vec3> scales;
+  std::vector<std::vector<float>> weights;
+  std::vector<vsg::mat4> globalTransforms;
+};
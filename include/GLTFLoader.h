@@ -1,34 +1,53 @@
-#pragma once
-
-#include <string>
-#include <optional>
-#include <unordered_map>
-#include <vsg/maths/mat4.h>
-#include "tiny_gltf.h"
-#include "RayTracingScene.h"
-
-class GLTFLoader
-{
-public:
-  GLTFLoader(vsg::ref_ptr<RayTracingScene> scene);
-
-  bool loadFile(const std::string& path);
-
-protected:
-  bool loadModel(const tinygltf::Model& model);
-  bool loadScene(const tinygltf::Scene& gltfScene, const tinygltf::Model& model);
-  bool loadNode(const tinygltf::Node& node, const tinygltf::Model& model, const vsg::mat4& parentTransform);
-  bool loadMesh(const tinygltf::Mesh& mesh, const tinygltf::Model& model, const vsg::mat4& transform);
-  bool loadPrimitive(const tinygltf::Primitive& primitive, const tinygltf::Model& model, const vsg::mat4& transform);
-
-  std::optional<RayTracingMaterial> loadMaterial(const tinygltf::Material& gltfMaterial, const tinygltf::Model& model);
-  std::optional<uint32_t> loadTexture(const tinygltf::Texture& gltfTexture, const tinygltf::Model& model);
-  std::optional<uint32_t> loadTextureCached(int textureIdx, const tinygltf::Model& model);
-
-  // Read image data and convert into a RGB float array, regardless of original format
-  vsg::ref_ptr<vsg::Data> readImageData(const std::vector<unsigned char>& data, int width, int height, int numComp, int compType);
-
-  vsg::ref_ptr<RayTracingScene> scene;
-
-  std::unordered_map<int, uint32_t> textureCache;
-};
+#pragma once
+
+#include <string>
+#include <optional>
+#include <unordered_map>
+#include <vsg/maths/mat4.h>
+#include "tiny_gltf.h"
+#include "RayTracingScene.h"
+#include "GLTFAnimation.h"
+#include "MeshOptimizer.h"
+
+class GLTFLoader
+{
+public:
+  GLTFLoader(vsg::ref_ptr<RayTracingScene> scene);
+
+  bool loadFile(const std::string& path);
+
+  // Node animations, skins and morph target weights of the loaded file (null if the file has none of them)
+  vsg::ref_ptr<GLTFAnimation> animation;
+
+  // If set before loading, static meshes are optimized before being added to the scene (deformable meshes are kept as they are)
+  std::optional<MeshOptimizer> meshOptimizer;
+
+protected:
+  bool loadModel(const tinygltf::Model& model);
+  bool loadScene(const tinygltf::Scene& gltfScene, const tinygltf::Model& model);
+  bool loadNode(int nodeIdx, const tinygltf::Model& model, const vsg::mat4& parentTransform);
+  // Static primitives of a mesh share one instance (and BLAS), while each deformable primitive has its own instance
+  bool loadMesh(const tinygltf::Mesh& mesh, const tinygltf::Model& model, const vsg::mat4& transform, bool skinned, std::vector<uint32_t>& instanceIds);
+  // Adds a deformable primitive into the scene and its instance into instanceIds, or appends a static primitive to staticPrimitives
+  bool loadPrimitive(const tinygltf::Primitive& primitive, const tinygltf::Model& model, const vsg::mat4& transform, bool skinned, const std::vector<double>& morphWeights, std::vector<MeshPrimitive>& staticPrimitives, std::vector<uint32_t>& instanceIds);
+  // Read joints, weights and morph targets. Returns nullopt if the primitive has no deformation
+  std::optional<MeshDeformation> loadDeformation(const tinygltf::Primitive& primitive, const tinygltf::Model& model, bool skinned, const std::vector<double>& morphWeights, size_t numVertices);
+
+  bool loadAnimations(const tinygltf::Model& model);
+
+  std::optional<RayTracingMaterial> loadMaterial(const tinygltf::Material& gltfMaterial, const tinygltf::Model& model);
+  // Returns ID of the material in the scene. Primitives without material (index -1) use the default material
+  std::optional<uint32_t> loadMaterialCached(int materialIdx, const tinygltf::Model& model);
+  std::optional<uint32_t> loadTexture(const tinygltf::Texture& gltfTexture, const tinygltf::Model& model);
+  std::optional<uint32_t> loadTextureCached(int textureIdx, const tinygltf::Model& model);
+
+  // Read image data and convert into a RGB float array, regardless of original format
+  vsg::ref_ptr<vsg::Data> readImageData(const std::vector<unsigned char>& data, int width, int height, int numComp, int compType);
+
+  vsg::ref_ptr<RayTracingScene> scene;
+
+  std::unordered_map<int, uint32_t> textureCache;
+  std::unordered_map<int, uint32_t> materialCache;
+
+  std::unordered_map<int, std::vector<uint32_t>> nodeInstances;  // Instance IDs created for each node
+};
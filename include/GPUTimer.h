@@ -0,0 +1,54 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/vk/Device.h>
+#include <vsg/commands/Command.h>
+
+// GPU time of a frame and the samples per pixel it was recorded with
+struct FrameTiming
+{
+  double milliseconds;
+  uint32_t samplesPerPixel;
+};
+
+// Measures GPU execution time of commands using timestamp queries.
+// Commands created by createStartCommand and createStopCommand have to be placed around the measured commands.
+// Each frame (see advanceFrame) writes its own pair of queries, so that frames in flight do not overwrite results being read.
+class GPUTimer : public vsg::Inherit<vsg::Object, GPUTimer>
+{
+public:
+  // numFramesInFlight is the number of frames the GPU may execute while the next one is recorded
+  GPUTimer(vsg::Device* device, uint32_t numFramesInFlight = 1);
+
+  vsg::ref_ptr<vsg::Command> createStartCommand();
+  vsg::ref_ptr<vsg::Command> createStopCommand();
+
+  // Start a frame, which is recorded with samplesPerPixel. Call once per frame before recording (see RayTracer::advanceFrame)
+  void advanceFrame(uint32_t samplesPerPixel);
+
+  // Elapsed time between start and stop of the frame numFramesInFlight frames before the current one,
+  // whose commands have finished once the current one was recorded. Returns nullopt if there is no such frame, or it was already read
+  std::optional<FrameTiming> getFrameTiming();
+
+  VkQueryPool queryPool() const { return pool; }
+  // First query of the current frame
+  uint32_t recordingQuery() const { return 2 * uint32_t((numFrames - 1) % numSlots); }
+
+protected:
+  virtual ~GPUTimer();
+
+  vsg::ref_ptr<vsg::Device> device;
+
+  VkQueryPool pool = VK_NULL_HANDLE;
+  uint32_t numFramesInFlight;
+  uint32_t numSlots;  // Pairs of queries
+  std::vector<uint32_t> slotSamplesPerPixel;  // Of the frame which uses each slot
+  uint64_t numFrames = 0; // Incremented by advanceFrame
+  uint64_t numReadFrames = 0;
+
+  double timestampPeriod; // Nanoseconds per timestamp tick
+  uint64_t timestampMask; // Valid bits of timestamps
+};
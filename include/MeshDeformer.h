@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/core/Array.h>
+#include <vsg/maths/mat4.h>
+#include <vsg/vk/Device.h>
+#include <vsg/vk/Buffer.h>
+#include <vsg/commands/Command.h>
+#include "DynamicBottomLevelAccelerationStructure.h"
+
+class RayTracingScene;
+
+// Binding indices of the compute shader (deform.comp)
+enum class DeformBindings : uint32_t
+{
+  DEFORM_INFOS = 20,
+  SOURCE_VERTICES = 21,
+  SOURCE_NORMALS = 22,
+  SOURCE_TANGENTS = 23,
+  JOINTS = 24,
+  WEIGHTS = 25,
+  MORPH_VERTICES = 26,
+  MORPH_NORMALS = 27,
+  MORPH_TANGENTS = 28,
+  JOINT_MATRICES = 29,
+  MORPH_WEIGHTS = 30,
+  BLAS_VERTICES = 31
+};
+
+// Skinning and morph target data of a mesh in bind pose
+struct MeshDeformation
+{
+  vsg::ref_ptr<vsg::uivec4Array> joints;  // Null if the mesh is not skinned
+  vsg::ref_ptr<vsg::vec4Array> weights;
+  uint32_t numJoints = 0;
+
+  // Displacements of each morph target (null when a target does not have the attribute)
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> morphVertices;
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> morphNormals;
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> morphTangents;
+  std::vector<float> morphWeights;  // Initial weights
+};
+
+// Per-mesh parameters for the compute shader
+struct DeformInfo
+{
+  // Device addresses of deformed attributes in the geometry buffer of the mesh (see PrimitiveGeometry). Set by createCommands
+  VkDeviceAddress vertices;
+  VkDeviceAddress normals;
+  VkDeviceAddress tangents;
+  uint32_t numVertices;
+  uint32_t sourceOffset;  // Offset in bind pose arrays (and vertex positions for BLAS) of the deformer
+  uint32_t jointMatrixOffset;
+  uint32_t numJoints; // Zero if the mesh is not skinned
+  uint32_t morphWeightOffset;
+  uint32_t numMorphTargets;
+  uint32_t morphOffset; // Offset in morph target arrays. Displacements of a target are stored contiguously
+  uint32_t padding; // Keeps the size a multiple of 8 bytes, as the array stride in the shader
+};
+
+// Deforms vertices of skinned and morphed meshes on GPU every frame using a compute shader,
+// writes them into geometry buffers of the meshes read by the closest-hit shader, and refits BLASes of the meshes.
+class MeshDeformer : public vsg::Inherit<vsg::Object, MeshDeformer>
+{
+public:
+  MeshDeformer(vsg::Device* device);
+
+  void addMesh(uint32_t instanceId, vsg::ref_ptr<DynamicBottomLevelAccelerationStructure> blas, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec4Array> tangents, const MeshDeformation& deformation);
+
+  // Joint matrices transform vertices from bind pose into the coordinate of the mesh instance
+  void setJointMatrices(uint32_t instanceId, const std::vector<vsg::mat4>& matrices);
+  void setMorphWeights(uint32_t instanceId, const std::vector<float>& weights);
+
+  // Request deformation if joint matrices or morph weights were changed since the last call. They are uploaded by recordUpload
+  void update();
+
+  // Create commands which deform the meshes and refit their BLASes. Geometry of the scene has to be uploaded (see RayTracingScene::uploadGeometry).
+  // They have to be recorded before TLAS update and tracing.
+  vsg::ref_ptr<vsg::Command> createCommands(RayTracingScene* scene);
+
+  bool empty() const { return deformInfoList.empty(); }
+
+  // Record upload of current joint matrices and morph weights. Values are stored in the command buffer
+  void recordUpload(vsg::CommandBuffer& commandBuffer) const;
+
+  // Record refit of BLASes using deformed vertex positions
+  void recordBLASRefit(vsg::CommandBuffer& commandBuffer) const;
+
+  bool deformationRequired = true;  // Set by update and cleared after the deformation is recorded
+
+protected:
+  vsg::Device* device;
+
+  // Data for refitting BLASes
+  struct BLASRefit
+  {
+    vsg::ref_ptr<DynamicBottomLevelAccelerationStructure> blas;
+    VkAccelerationStructureGeometryKHR geometry;
+    VkAccelerationStructureBuildRangeInfoKHR range;
+    VkDeviceSize scratchOffset;
+  };
+  std::vector<BLASRefit> refits;
+  vsg::ref_ptr<vsg::Buffer> blasVertexBuffer, blasIndexBuffer, scratchBuffer;
+  vsg::ref_ptr<vsg::Buffer> jointMatricesBuffer, morphWeightsBuffer;  // Device local, written by recordUpload
+
+  std::vector<DeformInfo> deformInfoList;
+  std::vector<uint32_t> instanceIdList;
+  std::unordered_map<uint32_t, size_t> instanceToDeformInfo;
+  std::vector<vsg::ref_ptr<DynamicBottomLevelAccelerationStructure>> blasList;
+
+  std::vector<vsg::ref_ptr<vsg::ushortArray>> indicesList;
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> verticesList;
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> normalsList;
+  std::vector<vsg::ref_ptr<vsg::vec4Array>> tangentsList;
+  std::vector<vsg::ref_ptr<vsg::uivec4Array>> jointsList;
+  std::vector<vsg::ref_ptr<vsg::vec4Array>> weightsList;
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> morphVerticesList;
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> morphNormalsList;
+  std::vector<vsg::ref_ptr<vsg::vec3Array>> morphTangentsList;
+
+  std::vector<vsg::mat4> jointMatrices;
+  std::vector<float> morphWeights;
+  bool modified = true;
+
+  uint32_t numSourceVertices = 0;
+  uint32_t maxNumVertices = 0;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <vsg/core/Array.h>
+
+// Vertex attributes and indices of a triangle mesh, in the form passed to RayTracingScene::addMesh
+struct MeshData
+{
+  vsg::ref_ptr<vsg::ushortArray> indices;
+  vsg::ref_ptr<vsg::vec3Array> vertices;
+  vsg::ref_ptr<vsg::vec3Array> normals;
+  vsg::ref_ptr<vsg::vec2Array> texCoords;
+  vsg::ref_ptr<vsg::vec4Array> tangents;
+};
+
+// Load-time optimization of meshes:
+//  1. Welds vertices whose attributes are bitwise identical
+//  2. Removes degenerate triangles (repeated indices or zero area)
+//  3. Sorts triangles along a Morton curve of their centroids, so that neighboring triangles are close in BLAS leaves and memory
+//  4. Reorders vertices in order of first use by the sorted triangles
+// Statistics of all optimized meshes are accumulated for reporting.
+class MeshOptimizer
+{
+public:
+  void optimize(MeshData& mesh);
+
+  // Print numbers of vertices, triangles and bytes before and after optimization
+  void report(std::ostream& stream) const;
+
+  size_t verticesBefore = 0, verticesAfter = 0;
+  size_t trianglesBefore = 0, trianglesAfter = 0;
+  size_t bytesBefore = 0, bytesAfter = 0;
+  double milliseconds = 0.0;
+};
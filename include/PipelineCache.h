@@ -0,0 +1,35 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/vk/Device.h>
+#include <vsg/state/ShaderStage.h>
+
+// VkPipelineCache persisted in a directory, so that pipelines compiled in a previous run are reused.
+// The file is keyed by the device, the driver version and a hash of the shaders, therefore a stale cache is never loaded.
+class PipelineCache : public vsg::Inherit<vsg::Object, PipelineCache>
+{
+public:
+  PipelineCache(const std::filesystem::path& directory);
+
+  // Create the VkPipelineCache for the device and shaders, initialized with the file if it exists
+  VkPipelineCache load(vsg::Device* device, const vsg::ShaderStages& shaderStages);
+  // Write the current content of the cache (including pipelines created after load) into the file, if it differs from the file
+  bool save();
+
+  // True if the cache was initialized with a file. It does not tell whether the driver could use its content
+  bool isLoaded() const { return loadedFromFile; }
+
+  std::filesystem::path directory;
+
+protected:
+  virtual ~PipelineCache();
+
+  vsg::ref_ptr<vsg::Device> device;
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+  std::filesystem::path path;
+  std::vector<char> savedData;  // Content of the file as loaded or last saved
+  bool loadedFromFile = false;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+#include <vsg/core/Inherit.h>
+#include <vsg/vk/Buffer.h>
+#include "DynamicBottomLevelAccelerationStructure.h"
+
+// Geometry of a primitive. Shapes other than triangles are analytic and defined in object coordinate (see intersection.rint):
+//  SPHERE: unit sphere centered at the origin
+//  QUAD: square [-1, 1] x [-1, 1] on the XY plane, facing +Z
+//  DISK: unit disk on the XY plane, facing +Z
+enum class PrimitiveShape : uint32_t
+{
+  TRIANGLES = 0,
+  SPHERE = 1,
+  QUAD = 2,
+  DISK = 3
+};
+
+// BLAS of one AABB enclosing an analytic shape, which is intersected by the intersection shader.
+// Its size does not depend on how many instances use it, so one is shared by all shapes of the same kind in a scene.
+class ProceduralBottomLevelAccelerationStructure : public vsg::Inherit<DynamicBottomLevelAccelerationStructure, ProceduralBottomLevelAccelerationStructure>
+{
+public:
+  ProceduralBottomLevelAccelerationStructure(vsg::Device* device, PrimitiveShape shape);
+
+  void compile(vsg::Context& context) override;
+
+  const PrimitiveShape shape;
+
+protected:
+  vsg::ref_ptr<vsg::Buffer> aabbBuffer;
+};
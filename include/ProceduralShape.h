@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vsg/core/Inherit.h>
+#include <vsg/nodes/Node.h>
+#include <vsg/core/Visitor.h>
+#include <vsg/maths/mat4.h>
+#include "ProceduralBottomLevelAccelerationStructure.h"
+
+// Analytic shape in a scene graph. SceneConversionTraversal adds it to RayTracingScene with addShape instead of tessellating it
+class ProceduralShape : public vsg::Inherit<vsg::Node, ProceduralShape>
+{
+public:
+  ProceduralShape(PrimitiveShape shape, const vsg::mat4& transform);
+
+  virtual void accept(vsg::Visitor& visitor);
+
+  PrimitiveShape shape;
+  vsg::mat4 transform;  // Places the shape defined in object coordinate (see PrimitiveShape)
+};
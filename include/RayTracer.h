@@ -1,82 +1,199 @@
-#pragma once
-
-#include <vsg/core/Inherit.h>
-#include <vsg/core/Object.h>
-#include <vsg/core/ref_ptr.h>
-#include <vsg/vk/Device.h>
-#include <vsg/viewer/Window.h>
-#include <vsg/maths/mat4.h>
-#include <vsg/raytracing/RayTracingShaderGroup.h>
-#include <vsg/raytracing/DescriptorAccelerationStructure.h>
-#include <vsg/state/DescriptorImage.h>
-#include <vsg/state/DescriptorBuffer.h>
-#include <vsg/state/DescriptorSet.h>
-#include "RayTracingUniform.h"
-#include "RayTracingScene.h"
-
-enum class SamplingAlgorithm
-{
-  PATH_TRACING, QUASI_MONTE_CARLO
-};
-
-enum class Bindings : uint32_t
-{
-  TLAS = 0,
-  TARGET_IMAGE = 1,
-  UNIFORMS = 2,
-  OBJECT_INFOS = 3,
-  INDICES = 4,
-  VERTICES = 5,
-  NORMALS = 6,
-  TEX_COORDS = 7,
-  TANGENTS = 8,
-  TEXTURES = 10,
-  HAMMERSLEY = 11,
-  ENV_MAP = 12
-};
-
-class RayTracer : public vsg::Inherit<vsg::Object, RayTracer>
-{
-public:
-  RayTracer(vsg::Device* device, int width, int height, vsg::ref_ptr<RayTracingScene> scene, SamplingAlgorithm algorithm = SamplingAlgorithm::PATH_TRACING);
-
-  // Update setting of samples per pixel in uniform buffer
-  void setSamplesPerPixel(int samplesPerPixel);
-  // Update camera parameters in uniform buffer
-  void setCameraParams(const vsg::mat4& viewMat, const vsg::mat4& projectionMat);
-
-  vsg::ref_ptr<vsg::CommandGraph> createCommandGraph(vsg::ref_ptr<vsg::Window> window);
-
-  vsg::ref_ptr<RayTracingScene> scene;
-
-  const size_t MAX_NUM_TEXTURES = 32;  // FIXME: Larger value (limit is unclear) breaks QMC (entire screen becomes blue). Probably GPU memory corruption
-
-  const int MAX_DEPTH = 10;
-  const int SAMPLING_DIMENSIONS = 2 + 3 * MAX_DEPTH;  // 2 for antialiasing, 3 per each depth of ray tracing
-  const int HAMMERSLEY_REPLICATIONS = 71; // This must agree with the definition in shader rayGeneration.rgen
-
-protected:
-  vsg::Device* device;
-  
-  VkExtent2D screenSize;
-
-  SamplingAlgorithm algorithm;
-
-  vsg::ref_ptr<RayTracingUniformValue> uniformValue;  // Parameters for ray tracing
-
-  vsg::ref_ptr<vsg::ShaderStage> rayGenerationShader, missShader, closestHitShader;
-  vsg::ref_ptr<vsg::RayTracingShaderGroup> rayGenerationShaderGroup, missShaderGroup, closestHitShaderGroup;
-
-  vsg::ref_ptr<vsg::Image> targetImage; // Image to render result of ray tracing
-  vsg::ref_ptr<vsg::ImageView> targetImageView;
-
-  vsg::ref_ptr<vsg::floatArray> hammersley; // Hammersley sequence for QMC
-
-  vsg::ref_ptr<vsg::DescriptorAccelerationStructure> tlasDescriptor;
-  vsg::ref_ptr<vsg::DescriptorImage> targetImageDescriptor;
-  vsg::ref_ptr<vsg::DescriptorBuffer> uniformDescriptor, objectInfoDescriptor, indicesDescriptor, verticesDescriptor, normalsDescriptor, texCoordsDescriptor, tangentsDescriptor, hammersleyDescriptor;
-  vsg::ref_ptr<vsg::DescriptorImage> textureDescriptor, envMapDescriptor;
-  vsg::ref_ptr<vsg::DescriptorSet> descriptorSet;
-  vsg::ref_ptr<vsg::PipelineLayout> pipelineLayout;
-  vsg::ref_ptr<vsg::RayTracingPipeline> rayTracingPipeline;
-};
+#pragma once
+
+#include <vector>
+#include <map>
+#include <optional>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/core/ref_ptr.h>
+#include <vsg/core/observer_ptr.h>
+#include <vsg/vk/Device.h>
+#include <vsg/viewer/Window.h>
+#include <vsg/maths/mat4.h>
+#include <vsg/raytracing/RayTracingShaderGroup.h>
+#include <vsg/raytracing/DescriptorAccelerationStructure.h>
+#include <vsg/state/DescriptorImage.h>
+#include <vsg/state/DescriptorBuffer.h>
+#include <vsg/state/DescriptorSet.h>
+#include <vsg/commands/Commands.h>
+#include "RayTracingUniform.h"
+#include "RayTracingScene.h"
+#include "GPUTimer.h"
+#include "CachedRayTracingPipeline.h"
+#include "TraceRaysWithHitGroups.h"
+#include "PipelineCache.h"
+#include "ToneMapper.h"
+
+enum class SamplingAlgorithm
+{
+  PATH_TRACING, QUASI_MONTE_CARLO
+};
+
+enum class Bindings : uint32_t
+{
+  TLAS = 0,
+  TARGET_IMAGE = 1,
+  UNIFORMS = 2,
+  OBJECT_INFOS = 3,
+  MATERIALS = 9,
+  TEXTURES = 10,
+  HAMMERSLEY = 11,
+  ENV_MAP = 12,
+  TEXTURE_FEEDBACK = 13,
+  AOV_IMAGE = 14,
+  GBUFFER = 15,
+  PREV_TARGET_IMAGE = 16,
+  PREV_GBUFFER = 17
+};
+
+// Layers of the AOV image for each view (this must agree with the definitions in rayGeneration.rgen).
+// Layer of an AOV of view v is v * NUM_AOV_LAYERS + layer.
+enum class AOVLayers : uint32_t
+{
+  NORMAL_DEPTH = 0, // World normal (xyz) and linear depth (w)
+  ALBEDO_ROUGHNESS = 1, // Base color (xyz) and roughness (w)
+  MOTION_METALLIC = 2,  // Motion vector towards the previous camera in pixels (xy) and metallic (z)
+  IDS = 3 // Instance ID (x) and material ID (y). Both are -1 where the camera ray missed
+};
+const uint32_t NUM_AOV_LAYERS = 4;
+
+// Number of frames the interactive viewer may have in flight. Each of them has its own target image, uniform buffer and descriptor set
+const uint32_t NUM_FRAMES_IN_FLIGHT = 2;
+
+class RayTracer : public vsg::Inherit<vsg::Object, RayTracer>
+{
+public:
+  // width and height are the size of the target image. When rendering in tiles, it is the tile size (see TiledRenderer).
+  // The target image stores linear (HDR) radiance, therefore targetFormat has to be a float format.
+  // The target image has numViews layers (at most MAX_NUM_VIEWS), so that a launch can render several cameras at once.
+  // If writeAOVs is true, first-hit attributes are also written into the AOV image (see AOVLayers).
+  RayTracer(vsg::Device* device, int width, int height, vsg::ref_ptr<RayTracingScene> scene, SamplingAlgorithm algorithm = SamplingAlgorithm::PATH_TRACING, VkFormat targetFormat = VK_FORMAT_R32G32B32A32_SFLOAT, uint32_t numViews = 1, bool writeAOVs = false);
+
+  // Update setting of samples per pixel in uniforms
+  void setSamplesPerPixel(int samplesPerPixel);
+  // Update camera parameters of a view in uniforms. The previous camera of the view is kept for motion vectors.
+  // Uniforms are uploaded into the buffer of the current frame when trace commands are recorded.
+  void setCameraParams(const vsg::mat4& viewMat, const vsg::mat4& projectionMat, uint32_t view = 0);
+  // Forget previous cameras, so that the next camera of each view has no motion (e.g. at the start of an unrelated job)
+  void resetCameraHistory();
+
+  // Commands which trace the first view, tone-map it and copy it into the window.
+  // Resources of NUM_FRAMES_IN_FLIGHT frames are created, and the commands use those of the current frame when recorded.
+  vsg::ref_ptr<vsg::CommandGraph> createCommandGraph(vsg::ref_ptr<vsg::Window> window);
+  // Switch to resources of the next frame. Call once per frame before updating uniforms.
+  // The previous frame becomes history of temporal reprojection
+  void advanceFrame();
+  uint32_t getFrameIndex() const { return frameIndex; }
+
+  // Commands which update acceleration structures (skinning and moved instances). They have to be recorded before tracing.
+  vsg::ref_ptr<vsg::Commands> createSceneUpdateCommands();
+
+  // Take materials edited by RayTracingScene::setMaterial. They are uploaded into the material buffer when trace commands are recorded
+  void updateMaterials();
+  // Render a newer version of the scene (e.g. a snapshot taken while loading) whose BLASes are built, keeping commands created before.
+  // TLAS is built, object infos, materials and new textures are written into the descriptor sets, and the shader binding table is rebuilt.
+  // The pipeline is recreated only if the scene needs hit groups it does not have. It waits for frames in flight.
+  void setScene(vsg::ref_ptr<RayTracingScene> newScene, vsg::ref_ptr<vsg::Window> window);
+  // Commands which trace a region of width x height pixels for the first numLaunchViews views. The region and range of samples are read from tileParams when recorded.
+  // They upload uniforms and use the target image of the current frame. Callers should keep and reuse them, because each has its own shader binding table.
+  vsg::ref_ptr<vsg::Commands> createTraceCommands(vsg::ref_ptr<TileParamsValue> tileParams, uint32_t width, uint32_t height, uint32_t numLaunchViews = 1);
+
+  // Target image, uniforms and descriptor set of the current frame
+  vsg::ref_ptr<vsg::Image> getTargetImage() const { return frames[frameIndex].targetImage; }
+  const RayTracingUniform& getUniforms() const { return uniformValue->value(); }
+  vsg::ref_ptr<vsg::Buffer> getUniformBuffer() const { return frames[frameIndex].uniformBuffer; }
+  vsg::ref_ptr<vsg::DescriptorSet> getDescriptorSet() const { return frames[frameIndex].descriptorSet; }
+  // Materials and their device local buffer. The version is incremented when materials have to be uploaded again
+  const vsg::Array<RayTracingMaterial>& getMaterials() const { return *materials; }
+  vsg::ref_ptr<vsg::Buffer> getMaterialBuffer() const { return materialBuffer; }
+  uint32_t getMaterialVersion() const { return materialVersion; }
+  uint32_t getNumViews() const { return numViews; }
+  vsg::ref_ptr<vsg::Image> getAOVImage() const { return aovImage; }  // Null if AOVs are not written
+
+  // Compile the pipeline through a persistent cache. It has to be set before commands are compiled
+  void setPipelineCache(vsg::ref_ptr<PipelineCache> pipelineCache) { rayTracingPipeline->pipelineCache = pipelineCache; }
+
+  vsg::ref_ptr<RayTracingScene> scene;
+
+  // If set, GPU time of ray tracing is measured every frame (frames are advanced by advanceFrame)
+  vsg::ref_ptr<GPUTimer> gpuTimer;
+
+  // Exposure and curve used by createCommandGraph. They can be changed after commands are created
+  vsg::ref_ptr<ToneMapParamsValue> toneMapParams;
+
+  // Samples of previous frames reprojected into the first view by createCommandGraph (0 disables temporal reprojection).
+  // History whose first-hit depth or normal does not match is rejected
+  uint32_t maxHistorySamples = 0;
+
+  const size_t MAX_NUM_TEXTURES = 32;  // FIXME: Larger value (limit is unclear) breaks QMC (entire screen becomes blue). Probably GPU memory corruption
+
+  const int MAX_DEPTH = 10;
+  const int SAMPLING_DIMENSIONS = 2 + 3 * MAX_DEPTH;  // 2 for antialiasing, 3 per each depth of ray tracing
+  const int HAMMERSLEY_REPLICATIONS = 71; // This must agree with the definition in shader rayGeneration.rgen
+
+  const uint32_t NUM_MATERIAL_FEATURES = 4;  // Number of specialization constants in shader closestHit.rchit
+
+protected:
+  // Resources which are written by a frame while other frames are in flight
+  struct Frame
+  {
+    vsg::ref_ptr<vsg::Image> targetImage; // Image to render result of ray tracing (and history of the next frame)
+    vsg::ref_ptr<vsg::ImageView> targetImageView;
+    vsg::ref_ptr<vsg::ImageView> gBufferImageView; // First-hit normal and depth of the first view
+    vsg::ref_ptr<vsg::Buffer> uniformBuffer;  // Device local, written by vkCmdUpdateBuffer
+    vsg::ref_ptr<vsg::DescriptorSet> descriptorSet;
+  };
+  void addFrame();
+  // Descriptor sets refer to the previous frame, therefore they are recreated when a frame is added
+  void createDescriptorSets();
+  // Descriptors of TLAS, object infos, materials and the environment map of the scene
+  void createSceneDescriptors(vsg::ref_ptr<vsg::Array<ObjectInfo>> objectInfo);
+  // Add hit groups for combinations of primitive shape and material features the pipeline does not have yet, and assign hit records of primitives.
+  // Returns true if hit groups were added (then the pipeline has to be created again)
+  bool updateHitGroups(const vsg::Array<ObjectInfo>& objectInfo);
+
+  vsg::Device* device;
+  
+  VkExtent2D screenSize;
+  uint32_t numViews;
+  VkFormat targetFormat;
+
+  SamplingAlgorithm algorithm;
+
+  std::vector<Frame> frames;  // One for offline rendering, NUM_FRAMES_IN_FLIGHT after createCommandGraph
+  uint32_t frameIndex = 0;
+  uint32_t numAdvancedFrames = 0;
+
+  vsg::ref_ptr<RayTracingUniformValue> uniformValue;  // Parameters for ray tracing, copied into the uniform buffer of a frame
+  vsg::ref_ptr<TileParamsValue> tileParams; // Whole screen and all samples (used by createCommandGraph)
+
+  vsg::ref_ptr<vsg::ShaderStage> rayGenerationShader, missShader, closestHitShader, anyHitShader;
+  vsg::ref_ptr<vsg::ShaderStage> proceduralClosestHitShader, intersectionShader;  // For analytic shapes
+  vsg::ref_ptr<vsg::RayTracingShaderGroup> rayGenerationShaderGroup, missShaderGroup;
+  std::vector<vsg::ref_ptr<vsg::RayTracingShaderGroup>> hitShaderGroups; // One per combination of primitive shape and material features
+  std::map<std::pair<uint32_t, uint32_t>, uint32_t> hitGroupIndices; // Index in hitShaderGroups for each (shape, material features)
+  std::vector<uint32_t> hitRecords; // Index in hitShaderGroups for each primitive (object info) of the scene
+  std::vector<vsg::observer_ptr<TraceRaysWithHitGroups>> traceRaysCommands; // Created by createTraceCommands and owned by callers. Their hit records are updated by setScene
+  vsg::ref_ptr<vsg::Commands> sceneUpdateCommands; // Recorded by createCommandGraph and replaced by setScene
+
+  vsg::ref_ptr<vsg::Image> aovImage;  // NUM_AOV_LAYERS layers per view
+  vsg::ref_ptr<vsg::ImageView> aovImageView;
+
+  std::vector<std::optional<vsg::mat4>> viewProjectionMats; // Last camera of each view
+
+  vsg::ref_ptr<vsg::Array<RayTracingMaterial>> materials;  // Copied into materialBuffer by trace commands
+  vsg::ref_ptr<vsg::Buffer> materialBuffer; // Device local, written by vkCmdUpdateBuffer
+  uint32_t materialVersion = 0;
+
+  vsg::ref_ptr<vsg::floatArray> hammersley; // Hammersley sequence for QMC
+  vsg::ref_ptr<vsg::Data> envMap; // Data of envMapDescriptor
+
+  vsg::ref_ptr<vsg::DescriptorAccelerationStructure> tlasDescriptor;
+  vsg::ref_ptr<vsg::DescriptorImage> aovImageDescriptor;
+  vsg::ref_ptr<vsg::DescriptorBuffer> objectInfoDescriptor, materialDescriptor, hammersleyDescriptor, textureFeedbackDescriptor;
+  vsg::ref_ptr<vsg::DescriptorImage> textureDescriptor, envMapDescriptor;
+  vsg::Descriptors sharedDescriptors;  // Descriptors used by all frames
+  vsg::ref_ptr<vsg::DescriptorSetLayout> descriptorLayout;
+  vsg::ref_ptr<vsg::PipelineLayout> pipelineLayout;
+  vsg::ref_ptr<CachedRayTracingPipeline> rayTracingPipeline;
+};
@@ -1,24 +1,44 @@
-#pragma once
-
-#include <vsg/maths/vec3.h>
-
-enum class AlphaMode {
-  Opaque = 0,
-  Mask = 1
-};
-
-struct RayTracingMaterial
-{
-  vsg::vec3 color = vsg::vec3(1.0f, 1.0f, 1.0f);  // Base color
-  float metallic = 0.0f;
-  float roughness = 0.0f;
-  int32_t colorTextureIdx = -1;
-  int32_t metallicRoughnessTextureIdx = -1;
-  int32_t normalTextureIdx = -1;
-  float normalTextureScale = 1.0f;
-  int32_t emissiveTextureIdx = -1;
-  vsg::vec3 emissive = vsg::vec3(0.0f, 0.0f, 0.0f);
-  AlphaMode alphaMode = AlphaMode::Opaque;
-  float alphaFactor = 1.0f; // Scaling factor for alpha (included in base color factor in glTF)
-  float alphaCutoff = 0.5f;
-};
\ No newline at end of file
+#pragma once
+
+#include <cstdint>
+#include <vsg/maths/vec3.h>
+
+enum class AlphaMode {
+  Opaque = 0,
+  Mask = 1
+};
+
+struct RayTracingMaterial
+{
+  vsg::vec3 color = vsg::vec3(1.0f, 1.0f, 1.0f);  // Base color
+  float metallic = 0.0f;
+  float roughness = 0.0f;
+  int32_t colorTextureIdx = -1;
+  int32_t metallicRoughnessTextureIdx = -1;
+  int32_t normalTextureIdx = -1;
+  float normalTextureScale = 1.0f;
+  int32_t emissiveTextureIdx = -1;
+  vsg::vec3 emissive = vsg::vec3(0.0f, 0.0f, 0.0f);
+  AlphaMode alphaMode = AlphaMode::Opaque;
+  float alphaFactor = 1.0f; // Scaling factor for alpha (included in base color factor in glTF)
+  float alphaCutoff = 0.5f;
+};
+
+// Optional features of a material. A specialized closest-hit shader is used for each combination (see RayTracer)
+enum MaterialFeatures : uint32_t
+{
+  MATERIAL_FEATURE_COLOR_TEXTURE = 1,
+  MATERIAL_FEATURE_METALLIC_ROUGHNESS_TEXTURE = 2,
+  MATERIAL_FEATURE_NORMAL_TEXTURE = 4,
+  MATERIAL_FEATURE_EMISSIVE_TEXTURE = 8
+};
+
+inline uint32_t getMaterialFeatures(const RayTracingMaterial& material)
+{
+  uint32_t features = 0;
+  if (material.colorTextureIdx >= 0) features |= MATERIAL_FEATURE_COLOR_TEXTURE;
+  if (material.metallicRoughnessTextureIdx >= 0) features |= MATERIAL_FEATURE_METALLIC_ROUGHNESS_TEXTURE;
+  if (material.normalTextureIdx >= 0) features |= MATERIAL_FEATURE_NORMAL_TEXTURE;
+  if (material.emissiveTextureIdx >= 0) features |= MATERIAL_FEATURE_EMISSIVE_TEXTURE;
+  return features;
+}
@@ -1,60 +1,198 @@
-#pragma once
-
-#include <vsg/core/Object.h>
-#include <vsg/core/Inherit.h>
-#include <vsg/raytracing/TopLevelAccelerationStructure.h>
-#include <vsg/maths/mat4.h>
-#include <vsg/core/Data.h>
-#include <vsg/state/ImageInfo.h>
-#include "RayTracingMaterial.h"
-
-struct ObjectInfo
-{
-  // Offset (first index) of index and vertex attributes of a particular object in respective array
-  uint32_t indexOffset;
-  uint32_t vertexOffset;
-  RayTracingMaterial material;
-};
-
-class ObjectInfoValue : public vsg::Inherit<vsg::Value<ObjectInfo>, ObjectInfoValue>
-{
-};
-
-class RayTracingScene : public vsg::Inherit<vsg::Object, RayTracingScene>
-{
-public:
-  RayTracingScene(vsg::Device* device);
-
-  uint32_t addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, vsg::ref_ptr<vsg::vec4Array> tangents, const RayTracingMaterial& material);
-  // For meshes without tangent vectors
-  uint32_t addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, const RayTracingMaterial& material);
-
-  uint32_t addTexture(const vsg::ImageInfo& imageInfo);
-  uint32_t addTexture(vsg::ref_ptr<vsg::Data> imageData, vsg::ref_ptr<vsg::Sampler> sampler);
-
-  vsg::ref_ptr<vsg::Array<ObjectInfo>> getObjectInfo() const;
-  vsg::ref_ptr<vsg::ushortArray> getIndices() const;
-  vsg::ref_ptr<vsg::vec3Array> getVertices() const;
-  vsg::ref_ptr<vsg::vec3Array> getNormals() const;
-  vsg::ref_ptr<vsg::vec2Array> getTexCoords() const;
-  vsg::ref_ptr<vsg::vec4Array> getTangents() const;
-
-  vsg::ref_ptr<vsg::TopLevelAccelerationStructure> tlas;
-
-  vsg::ImageInfoList textures;
-
-  vsg::ref_ptr<vsg::Data> envMap;
-
-private:
-  vsg::Device* device;
-
-  std::vector<ObjectInfo> objectInfoList;
-  std::vector<vsg::ref_ptr<vsg::ushortArray>> indicesList;
-  std::vector<vsg::ref_ptr<vsg::vec3Array>> verticesList;
-  std::vector<vsg::ref_ptr<vsg::vec3Array>> normalsList;
-  std::vector<vsg::ref_ptr<vsg::vec2Array>> texCoordsList;
-  std::vector<vsg::ref_ptr<vsg::vec4Array>> tangentsList;
-
-  uint32_t numIndices;
-  uint32_t numVertices;
-};
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <vsg/core/Object.h>
+#include <vsg/core/Inherit.h>
+#include <vsg/raytracing/TopLevelAccelerationStructure.h>
+#include <vsg/maths/mat4.h>
+#include <vsg/core/Data.h>
+#include <vsg/state/ImageInfo.h>
+#include <vsg/vk/Buffer.h>
+#include <vsg/vk/CommandPool.h>
+#include <vsg/vk/Queue.h>
+#include "RayTracingMaterial.h"
+#include "DynamicTopLevelAccelerationStructure.h"
+#include "DynamicBottomLevelAccelerationStructure.h"
+#include "ProceduralBottomLevelAccelerationStructure.h"
+#include "MeshDeformer.h"
+#include "TextureStreamer.h"
+
+struct ObjectInfo
+{
+  // Device addresses of indices and vertex attributes of a particular object (see PrimitiveGeometry). Zero for analytic shapes
+  VkDeviceAddress indices;
+  VkDeviceAddress vertices;
+  VkDeviceAddress normals;
+  VkDeviceAddress texCoords;
+  VkDeviceAddress tangents;
+  uint32_t materialId;  // Index in the material table (see RayTracingScene::addMaterial)
+  uint32_t shape; // PrimitiveShape. Analytic shapes have no indices or vertex attributes
+};
+
+class ObjectInfoValue : public vsg::Inherit<vsg::Value<ObjectInfo>, ObjectInfoValue>
+{
+};
+
+// Indices, vertex attributes and material of a primitive
+struct MeshPrimitive
+{
+  vsg::ref_ptr<vsg::ushortArray> indices;
+  vsg::ref_ptr<vsg::vec3Array> vertices;
+  vsg::ref_ptr<vsg::vec3Array> normals;
+  vsg::ref_ptr<vsg::vec2Array> texCoords;
+  vsg::ref_ptr<vsg::vec4Array> tangents;
+  uint32_t materialId;
+};
+
+// Indices and vertex attributes of a primitive packed into a range of a device buffer shared with other primitives (see RayTracingScene::uploadGeometry).
+// Shaders read them through device addresses in ObjectInfo, so adding a primitive does not repack geometry of the others.
+class PrimitiveGeometry : public vsg::Inherit<vsg::Object, PrimitiveGeometry>
+{
+public:
+  PrimitiveGeometry(const MeshPrimitive& primitive);
+
+  vsg::ref_ptr<vsg::ushortArray> indices;
+  vsg::ref_ptr<vsg::vec3Array> vertices;
+  vsg::ref_ptr<vsg::vec3Array> normals;
+  vsg::ref_ptr<vsg::vec2Array> texCoords;
+  vsg::ref_ptr<vsg::vec4Array> tangents;
+
+  // Arrays in the order they are packed into the buffer
+  std::vector<vsg::ref_ptr<vsg::Data>> arrays() const { return { indices, vertices, normals, texCoords, tangents }; }
+  // Bytes of the buffer. Each array starts at an aligned offset
+  VkDeviceSize dataSize() const;
+
+  // Set addresses of the arrays in info. The geometry has to be uploaded
+  void setAddresses(ObjectInfo& info) const;
+
+  vsg::ref_ptr<vsg::Buffer> buffer; // Block of GeometryBufferPool. Null until uploaded
+  VkDeviceSize offset = 0;  // Of the range in buffer
+  VkDeviceAddress address = 0;  // Of the range
+};
+
+// Suballocates ranges of PrimitiveGeometry from large device buffers, because a buffer per primitive would exceed
+// maxMemoryAllocationCount (4096 on many drivers) in large scenes. Ranges are never freed. Shared by a scene and its snapshots
+class GeometryBufferPool : public vsg::Inherit<vsg::Object, GeometryBufferPool>
+{
+public:
+  GeometryBufferPool(vsg::Device* device) : device(device) {}
+
+  // Reserve size bytes (a multiple of 16, the alignment of arrays). Returns the buffer and the offset of the range
+  std::pair<vsg::ref_ptr<vsg::Buffer>, VkDeviceSize> allocate(VkDeviceSize size);
+
+  const VkDeviceSize BLOCK_SIZE = 64 * 1024 * 1024; // Larger primitives get a block of their own
+
+protected:
+  vsg::Device* device;
+  vsg::ref_ptr<vsg::Buffer> block;  // Block being filled
+  VkDeviceSize blockSize = 0;
+  VkDeviceSize blockUsed = 0;
+};
+
+class RayTracingScene : public vsg::Inherit<vsg::Object, RayTracingScene>
+{
+public:
+  RayTracingScene(vsg::Device* device);
+
+  // Primitives become geometries of one BLAS and share an instance. Each primitive has its own object info,
+  // which shaders look up with gl_InstanceCustomIndexEXT + gl_GeometryIndexEXT. Returns ID of the instance
+  uint32_t addMesh(const vsg::mat4& transform, const std::vector<MeshPrimitive>& primitives);
+  uint32_t addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, vsg::ref_ptr<vsg::vec4Array> tangents, uint32_t materialId);
+  // For meshes without tangent vectors
+  uint32_t addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, uint32_t materialId);
+
+  // Analytic shape placed by transform (see PrimitiveShape). All shapes of the same kind share one BLAS of a single AABB.
+  // Alpha masking of the material is ignored. Returns ID of the instance
+  uint32_t addShape(const vsg::mat4& transform, PrimitiveShape shape, uint32_t materialId);
+  uint32_t addSphere(const vsg::vec3& center, float radius, uint32_t materialId);
+
+  // Another instance of the mesh or shape of instance id, sharing its BLAS, indices and vertex attributes.
+  // If materialId is given, it replaces materials of all primitives of the instance. Returns ID of the new instance
+  uint32_t addInstance(uint32_t id, const vsg::mat4& transform, std::optional<uint32_t> materialId = std::nullopt);
+
+  // Mesh deformed on GPU every frame by skinning and/or morph targets (see MeshDeformer)
+  uint32_t addDeformableMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, vsg::ref_ptr<vsg::vec4Array> tangents, uint32_t materialId, const MeshDeformation& deformation);
+
+  // Move an instance added by addMesh.
+  // tlas->allowUpdate has to be set before RayTracer is created, in order to reflect changes after compile.
+  void setInstanceTransform(uint32_t id, const vsg::mat4& transform);
+  // Override blasBuildPreference for a mesh. It has to be called before its BLAS is built (shapes share BLASes and cannot be overridden).
+  void setMeshBuildPreference(uint32_t id, AccelerationStructureBuildPreference preference);
+
+  // Materials are stored once and shared by meshes which refer to them by ID
+  uint32_t addMaterial(const RayTracingMaterial& material);
+  const RayTracingMaterial& getMaterial(uint32_t id) const { return materialList[id]; }
+  // Edit a material after RayTracer is created. Used textures (see getMaterialFeatures) and alpha mode have to stay the same,
+  // because they select hit groups and instance flags when RayTracer is created.
+  void setMaterial(uint32_t id, const RayTracingMaterial& material);
+
+  uint32_t addTexture(const vsg::ImageInfo& imageInfo);
+  uint32_t addTexture(vsg::ref_ptr<vsg::Data> imageData, vsg::ref_ptr<vsg::Sampler> sampler);
+  // Content-addressed texture cache shared by all files loaded into the scene. contentKey is a hash of the image and sampler state
+  // (see GLTFLoader::loadTexture). findTexture returns ID of a texture added with the same key whose image (dimensions, format and bytes)
+  // and sampler state are equal, so that a hash collision never shares different textures. The size of the shared texture is counted as saved
+  uint32_t addTexture(uint64_t contentKey, vsg::ref_ptr<vsg::Data> imageData, vsg::ref_ptr<vsg::Sampler> sampler, const std::vector<int>& samplerState);
+  std::optional<uint32_t> findTexture(uint64_t contentKey, const vsg::Data& imageData, const std::vector<int>& samplerState);
+  // Bytes of texture data not uploaded because findTexture found an identical texture
+  VkDeviceSize getDeduplicatedTextureBytes() const;
+
+  // Meshes, materials and textures can be added by a loading thread (see AsyncSceneLoader) while another thread takes snapshots.
+  // A snapshot shares geometry, BLASes and textures, but has its own TLAS. Deformable meshes are static in bind pose in it.
+  // Geometry uploaded through a snapshot is not uploaded again for the scene.
+  vsg::ref_ptr<RayTracingScene> createSnapshot() const;
+  uint32_t numInstances() const;
+  void setEnvMap(vsg::ref_ptr<vsg::Data> data);
+
+  // Copy indices and vertex attributes of primitives added since the last call into device-local buffers.
+  // It has to be called before getObjectInfo, whose addresses refer to the buffers (see AccelerationStructureBuilder::build)
+  void uploadGeometry(vsg::CommandPool* commandPool, vsg::Queue* queue);
+
+  // One per primitive. Primitives of an instance are contiguous from GeometryInstance::id
+  vsg::ref_ptr<vsg::Array<ObjectInfo>> getObjectInfo() const;
+  vsg::ref_ptr<vsg::Array<RayTracingMaterial>> getMaterials() const;
+  // Bytes of indices, vertex attributes, object infos and materials uploaded for the closest-hit shader
+  VkDeviceSize getAttributeBufferSize() const;
+
+  vsg::ref_ptr<DynamicTopLevelAccelerationStructure> tlas;
+  bool transformsModified = false;  // Set by setInstanceTransform and cleared when TLAS is updated
+  bool materialsModified = false; // Set by setMaterial and cleared when the material buffer is updated
+
+  vsg::ImageInfoList textures;
+  // If set before textures are added, textures start as proxies and are streamed at the resolution needed
+  vsg::ref_ptr<TextureStreamer> textureStreamer;
+
+  vsg::ref_ptr<MeshDeformer> deformer;
+
+  vsg::ref_ptr<vsg::Data> envMap;
+
+  // Build settings of BLASes created by addMesh afterwards (see AccelerationStructureBuilder).
+  // Deformable meshes are never compacted because they are refitted.
+  AccelerationStructureBuildPreference blasBuildPreference = AccelerationStructureBuildPreference::FAST_TRACE;
+  bool compactBLAS = false;
+
+private:
+  vsg::Device* device;
+
+  mutable std::recursive_mutex mutex;  // Guards additions against snapshots
+
+  std::vector<ObjectInfo> objectInfoList; // Addresses are set by getObjectInfo
+  std::vector<vsg::ref_ptr<PrimitiveGeometry>> geometryList;  // One per object info (null for shapes). Instances share geometry
+  vsg::ref_ptr<GeometryBufferPool> geometryPool;
+  std::vector<RayTracingMaterial> materialList;
+  std::map<PrimitiveShape, vsg::ref_ptr<ProceduralBottomLevelAccelerationStructure>> shapeBLASes;
+
+  // Key data of a texture in the content cache
+  struct CachedTexture
+  {
+    uint32_t id;
+    vsg::ref_ptr<vsg::Data> imageData; // As given to addTexture (the source of streaming)
+    std::vector<int> samplerState;
+  };
+  std::unordered_multimap<uint64_t, CachedTexture> textureContentCache;
+  VkDeviceSize deduplicatedTextureBytes = 0;
+};
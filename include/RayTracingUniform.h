@@ -1,18 +1,41 @@
-#pragma once
-
-#include <cstdint>
-#include <vsg/maths/mat4.h>
-#include <vsg/core/Inherit.h>
-#include <vsg/core/Value.h>
-
-struct RayTracingUniform
-{
-  vsg::mat4 invViewMat; // Inverse of view matrix (i.e. transform camera coordinate to world coordinate)
-  vsg::mat4 invProjectionMat; // Inverse of projection matrix (i.e. transform normalized device coordinate into camera coordinate)
-  uint32_t samplesPerPixel;
-};
-
-// This inherits vsg::Data and it can be passed to vsg::DescriptorBuffer::create
-class RayTracingUniformValue : public vsg::Inherit<vsg::Value<RayTracingUniform>, RayTracingUniformValue>
-{
-};
\ No newline at end of file
+#pragma once
+
+#include <cstdint>
+#include <vsg/maths/mat4.h>
+#include <vsg/maths/vec2.h>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Value.h>
+
+// Maximum number of cameras rendered by one launch (this must agree with the definition in common.glsl)
+const uint32_t MAX_NUM_VIEWS = 8;
+
+struct RayTracingUniform
+{
+  // One camera per layer of the target image (selected by gl_LaunchIDEXT.z)
+  vsg::mat4 invViewMat[MAX_NUM_VIEWS]; // Inverse of view matrix (i.e. transform camera coordinate to world coordinate)
+  vsg::mat4 invProjectionMat[MAX_NUM_VIEWS]; // Inverse of projection matrix (i.e. transform normalized device coordinate into camera coordinate)
+  vsg::mat4 prevViewProjectionMat[MAX_NUM_VIEWS]; // Projection matrix times view matrix of the previous camera (for motion vectors)
+  uint32_t samplesPerPixel;
+  float pixelSpreadAngle; // Angle between rays of adjacent pixels (used to estimate texture resolution needed at a hit)
+  uint32_t maxHistorySamples; // Samples of previous frames reused by temporal reprojection (0 disables it)
+  uint32_t historyValid; // Whether the previous frame left radiance and G-buffer to reproject
+  uint32_t randomSeed; // Changed every frame while history is accumulated, so that frames trace different samples
+};
+
+// This inherits vsg::Data and it can be passed to vsg::DescriptorBuffer::create
+class RayTracingUniformValue : public vsg::Inherit<vsg::Value<RayTracingUniform>, RayTracingUniformValue>
+{
+};
+
+// Region of the image and range of samples rendered by one ray tracing launch (passed as push constants)
+struct TileParams
+{
+  vsg::uivec2 tileOffset; // Position of the first pixel of the launch in the whole image
+  vsg::uivec2 imageSize;  // Size of the whole image
+  uint32_t sampleOffset;  // Index of the first sample. Results of previous samples in the target image are accumulated if not zero
+  uint32_t sampleCount;   // Number of samples per pixel in this launch
+};
+
+class TileParamsValue : public vsg::Inherit<vsg::Value<TileParams>, TileParamsValue>
+{
+};
@@ -1,10 +1,12 @@
-#pragma once
-
-#include <vsg/core/Visitor.h>
-#include "RayTracingMaterialGroup.h"
-
-class RayTracingVisitor : public vsg::Visitor
-{
-public:
-  virtual void apply(RayTracingMaterialGroup& rtMatGroup) = 0;
+#pragma once
+
+#include <vsg/core/Visitor.h>
+#include "RayTracingMaterialGroup.h"
+#include "ProceduralShape.h"
+
+class RayTracingVisitor : public vsg::Visitor
+{
+public:
+  virtual void apply(RayTracingMaterialGroup& rtMatGroup) = 0;
+  virtual void apply(ProceduralShape& shape) = 0;
 };
\ No newline at end of file
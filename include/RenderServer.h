@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <istream>
+#include <ostream>
+#include <optional>
+#include <vector>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/maths/vec3.h>
+#include "RayTracer.h"
+#include "TiledRenderer.h"
+#include "GLTFAnimation.h"
+
+// Camera and output file of an image rendered by RenderServer
+struct RenderView
+{
+  vsg::dvec3 cameraPos = vsg::dvec3(0.0, 0.0, 1.0);
+  vsg::dvec3 lookAtPos = vsg::dvec3(0.0, 0.0, 0.0);
+  vsg::dvec3 cameraUp = vsg::dvec3(0.0, 1.0, 0.0);
+  std::string output;
+};
+
+// Parameters of images rendered by RenderServer.
+// All views are traced in the same launches, and share the image size, field of view, samples and time.
+struct RenderJob
+{
+  std::vector<RenderView> views = { RenderView() };
+  double fov = 90.0;  // Degrees
+  uint32_t width = 800;
+  uint32_t height = 450;
+  uint32_t samplesPerPixel = 100;
+  uint32_t samplesPerBatch = 64;
+  double time = 0.0;  // Time of animation in seconds
+};
+
+// Renders many jobs with a scene, device and pipeline created once.
+// Jobs are read as JSON lines (see README for keys). Missing keys take values of defaultJob (and its first view).
+// A JSON line is written for each job when its images are written.
+class RenderServer : public vsg::Inherit<vsg::Object, RenderServer>
+{
+public:
+  RenderServer(vsg::ref_ptr<RayTracer> rayTracer, vsg::ref_ptr<TiledRenderer> tiledRenderer, const RenderJob& defaultJob);
+
+  // Process jobs until the input ends
+  void run(std::istream& input, std::ostream& output);
+
+  // Parse a JSON line. Returns nullopt and sets error if it is not a valid job
+  std::optional<RenderJob> parseJob(const std::string& line, std::string& error) const;
+
+  bool render(const RenderJob& job);
+
+  vsg::ref_ptr<GLTFAnimation> animation;  // If set, the scene is posed at RenderJob::time
+
+protected:
+  vsg::ref_ptr<RayTracer> rayTracer;
+  vsg::ref_ptr<TiledRenderer> tiledRenderer;
+  RenderJob defaultJob;
+};
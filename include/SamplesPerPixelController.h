@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+// Adjusts samples per pixel every frame so that GPU time of a frame approaches the target.
+// Samples per pixel is changed only when frame time goes out of the tolerance band around the target (hysteresis),
+// to avoid oscillation caused by small fluctuations of measured time.
+class SamplesPerPixelController
+{
+public:
+  SamplesPerPixelController(double targetMilliseconds, uint32_t initialSamplesPerPixel, uint32_t minSamplesPerPixel, uint32_t maxSamplesPerPixel);
+
+  // Feed GPU time of a frame rendered with frameSamplesPerPixel (which may be older than the current setting, because frames are in flight)
+  // and return samples per pixel for the next frame
+  uint32_t update(double frameMilliseconds, uint32_t frameSamplesPerPixel);
+
+  uint32_t getSamplesPerPixel() const { return samplesPerPixel; }
+
+  double tolerance = 0.1; // Relative half width of the band in which samples per pixel is kept unchanged
+  double smoothing = 0.25; // Weight of the newest measurement in the moving average of time per sample
+
+protected:
+  double targetMilliseconds;
+  uint32_t samplesPerPixel;
+  uint32_t minSamplesPerPixel;
+  uint32_t maxSamplesPerPixel;
+
+  double millisecondsPerSample; // Smoothed estimate (negative until the first measurement)
+};
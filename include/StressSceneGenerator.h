@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "RayTracingScene.h"
+#include "MeshOptimizer.h"
+
+// Synthetic scene for measuring how building and tracing scale with instance, triangle, texture and material counts.
+// Meshes are randomly deformed spheres, and their instances are scattered in a cube around the origin.
+// The same parameters and seed generate the same scene.
+class StressSceneGenerator
+{
+public:
+  // Add materials, textures and instances into scene. Build settings of BLASes are taken from the scene
+  void generate(RayTracingScene* scene);
+
+  // Print sizes of the generated scene
+  void report(std::ostream& stream) const;
+
+  uint32_t numInstances = 1000;
+  uint32_t numMeshes = 16;
+  uint32_t trianglesPerMesh = 10000;  // Rounded to a grid of quads, and limited by 16-bit indices
+  uint32_t numTextures = 0; // Checkerboards assigned to materials in turn, up to MAX_NUM_TEXTURES of RayTracer
+  uint32_t numMaterials = 16;
+  float emissiveFraction = 0.05f; // Fraction of materials (and of instances on average) emitting light
+  uint32_t seed = 1;
+
+  // Sizes of the generated scene
+  size_t uniqueTriangles = 0;
+  size_t instancedTriangles = 0;
+  uint32_t numGeneratedTextures = 0;
+  uint32_t numEmissiveMaterials = 0;
+  double milliseconds = 0.0;
+
+protected:
+  MeshData createMesh(uint32_t trianglesPerMesh);
+
+  uint32_t randomState = 0;
+  float random(); // [0,1)
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/core/Data.h>
+#include <vsg/viewer/Window.h>
+#include <vsg/vk/Buffer.h>
+#include <vsg/vk/Fence.h>
+#include <vsg/state/Sampler.h>
+#include <vsg/state/ImageInfo.h>
+#include <vsg/state/DescriptorSet.h>
+
+namespace vsg
+{
+  class CompileTraversal;
+}
+
+// Keeps textures resident at the resolution actually needed by rendering, within a memory budget.
+// Textures start as small proxies. Hit shaders write the texture size they need into a feedback buffer,
+// and the requested levels (downsampled from the source image by 2^level) are prepared and uploaded on a background thread.
+// Textures not sampled for a while are evicted back to their proxies.
+// Descriptor sets are rewritten only after the frames using them have finished, so that rendering never waits for the device.
+class TextureStreamer : public vsg::Inherit<vsg::Object, TextureStreamer>
+{
+public:
+  TextureStreamer(vsg::ref_ptr<vsg::Window> window, VkDeviceSize memoryBudget);
+
+  // Register a texture (index in RayTracingScene::textures) and returns proxy data used until a finer level is streamed in.
+  // It can be called from a loading thread while update is called.
+  vsg::ref_ptr<vsg::Data> addTexture(uint32_t textureIdx, vsg::ref_ptr<vsg::Data> source, vsg::ref_ptr<vsg::Sampler> sampler);
+
+  // Buffer of uint per texture written by shaders (bound to Bindings::TEXTURE_FEEDBACK)
+  vsg::ref_ptr<vsg::Buffer> getFeedbackBuffer() const { return feedbackBuffer; }
+  VkDeviceSize getFeedbackBufferSize() const { return feedbackBufferSize; }
+
+  // Set descriptor sets of RayTracer (one per frame in flight) which contain the textures. They have to be compiled before update.
+  // New descriptor sets start with proxies, therefore all textures are streamed again. The GPU must not use the previous ones.
+  void setDescriptorSets(const std::vector<vsg::ref_ptr<vsg::DescriptorSet>>& descriptorSets, uint32_t textureBinding);
+
+  // Read feedback of finished frames, request levels and replace textures whose levels are ready. Call once per frame after submission.
+  // The submitted frame used the descriptor set at frameIndex, and frameFence is signalled when it finishes
+  void update(uint32_t frameIndex, vsg::ref_ptr<vsg::Fence> frameFence);
+
+  const uint32_t PROXY_SIZE = 64; // Largest dimension of proxies
+  const uint32_t EVICTION_FRAMES = 120; // Textures not sampled in this number of frames are evicted
+
+protected:
+  virtual ~TextureStreamer();
+
+  struct Texture
+  {
+    vsg::ref_ptr<vsg::Data> source;
+    vsg::ref_ptr<vsg::Sampler> sampler;
+    uint32_t proxyLevel;
+    uint32_t residentLevel;
+    uint32_t requestedLevel;  // Level requested to the worker thread (== residentLevel if none)
+    uint64_t lastUsedFrame = 0;
+  };
+
+  struct Job
+  {
+    uint32_t textureIdx;
+    uint32_t level;
+    vsg::ImageInfo imageInfo;  // Uploaded by the worker thread
+  };
+
+  // Descriptor set of a frame in flight, and textures to be written into it
+  struct FrameDescriptorSet
+  {
+    vsg::ref_ptr<vsg::DescriptorSet> descriptorSet;
+    vsg::ref_ptr<vsg::Fence> fence;  // Of the last frame which used the set (null if not used yet)
+    std::map<uint32_t, vsg::ImageInfo> pendingImages;  // Written once the fence is signalled
+    std::map<uint32_t, vsg::ImageInfo> boundImages;  // Keeps streamed images alive while the set refers to them
+  };
+
+  void replaceTexture(uint32_t textureIdx, uint32_t level, const vsg::ImageInfo& imageInfo);
+  void writePendingImages(FrameDescriptorSet& frameDescriptorSet);
+  VkDeviceSize levelSize(const Texture& texture, uint32_t level) const;
+  void workerLoop();
+
+  vsg::ref_ptr<vsg::Window> window;
+  VkDeviceSize memoryBudget;
+  VkDeviceSize residentSize = 0;  // Total size of resident levels
+  uint64_t frameCount = 0;
+
+  std::vector<FrameDescriptorSet> frameDescriptorSets;
+  uint32_t textureBinding = 0;
+
+  std::vector<Texture> textures;
+  std::mutex texturesMutex; // Guards textures against addTexture on a loading thread
+
+  vsg::ref_ptr<vsg::Buffer> feedbackBuffer;
+  VkDeviceSize feedbackBufferSize;
+
+  // Shared with the worker thread
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<Job> pendingJobs, finishedJobs;
+  bool quit = false;
+  std::thread worker;
+  vsg::ref_ptr<vsg::CompileTraversal> uploadTraversal;  // Used only by the worker thread, which submits uploads by itself
+};
+
+// Box-filter an image by 2^level in both dimensions. Supports 8-bit UNORM and 32-bit float formats with 1-4 channels
+vsg::ref_ptr<vsg::Data> downsampleImage(vsg::ref_ptr<vsg::Data> source, uint32_t level);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/viewer/Window.h>
+#include <vsg/vk/Buffer.h>
+#include <vsg/vk/CommandPool.h>
+#include <vsg/vk/Queue.h>
+#include "RayTracer.h"
+#include "ToneMapper.h"
+
+// Offline renderer which splits a large image into tiles and samples into batches.
+// Each batch is submitted in a separate command buffer and waited, so that a launch never runs long enough to hit driver timeouts.
+// Only one tile is resident on GPU, and finished rows of tiles are streamed into the output file.
+class TiledRenderer : public vsg::Inherit<vsg::Object, TiledRenderer>
+{
+public:
+  // rayTracer has to be created with tileSize x tileSize target image of VK_FORMAT_R32G32B32A32_SFLOAT
+  TiledRenderer(vsg::ref_ptr<vsg::Window> window, vsg::ref_ptr<RayTracer> rayTracer, uint32_t tileSize);
+
+  // Render width x height image into a binary PPM file, or an OpenEXR file of raw radiance if the path ends with ".exr".
+  // EXR files also contain AOVs if the ray tracer writes them. They are kept in host memory until the end, and images needing more than 4 GiB are rejected.
+  // Returns false if the file cannot be written
+  bool render(const std::string& path, uint32_t width, uint32_t height, uint32_t samplesPerPixel, uint32_t samplesPerBatch);
+  // Render views of the ray tracer in the same launches. paths[i] receives view i (at most RayTracer::getNumViews() paths)
+  bool render(const std::vector<std::string>& paths, uint32_t width, uint32_t height, uint32_t samplesPerPixel, uint32_t samplesPerBatch);
+
+  bool reportProgress = true; // Print finished rows into stdout
+  ToneMapParams toneMapParams;  // Applied to PPM files
+
+protected:
+  vsg::ref_ptr<vsg::Window> window;
+  vsg::ref_ptr<RayTracer> rayTracer;
+  uint32_t tileSize;
+
+  vsg::ref_ptr<vsg::CommandPool> commandPool;
+  vsg::ref_ptr<vsg::Queue> queue;
+  vsg::ref_ptr<vsg::Buffer> readbackBuffer; // Host visible copy of a tile (all layers of the target image)
+
+  // Commands are kept across renders, because each trace command has its own shader binding table.
+  // Size of the launch differs for tiles on right and bottom edges, therefore trace commands are created for each size and number of views
+  vsg::ref_ptr<TileParamsValue> tileParams;
+  std::map<std::tuple<uint32_t, uint32_t, uint32_t>, vsg::ref_ptr<vsg::Commands>> traceCommands;
+  vsg::ref_ptr<vsg::Commands> sceneUpdateCommands;
+  vsg::ref_ptr<RayTracingScene> sceneUpdateScene; // Scene of sceneUpdateCommands, which are created again if the ray tracer renders another one
+};
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vsg/core/Inherit.h>
+#include <vsg/core/Object.h>
+#include <vsg/core/Value.h>
+#include <vsg/core/Visitor.h>
+#include <vsg/maths/vec3.h>
+#include <vsg/vk/Device.h>
+#include <vsg/state/ImageView.h>
+#include <vsg/state/DescriptorSet.h>
+#include <vsg/state/PipelineLayout.h>
+#include <vsg/state/ComputePipeline.h>
+#include <vsg/commands/Commands.h>
+#include <vsg/ui/KeyEvent.h>
+
+// Curves mapping linear radiance into [0,1] (this must agree with the definitions in toneMap.comp)
+enum class ToneMapOperator : uint32_t
+{
+  CLAMP = 0,  // Radiance above 1 is clipped (same as the output before tone mapping was introduced)
+  REINHARD = 1,
+  ACES = 2  // Filmic curve fitted to ACES by K. Narkowicz
+};
+
+// Parse "clamp", "reinhard" or "aces"
+std::optional<ToneMapOperator> parseToneMapOperator(const std::string& name);
+const char* toneMapOperatorName(ToneMapOperator toneMapOperator);
+
+// Parameters of the tone mapping pass (passed as push constants)
+struct ToneMapParams
+{
+  float exposure = 0.0f; // In EV (radiance is multiplied by 2^exposure)
+  uint32_t toneMapOperator = uint32_t(ToneMapOperator::CLAMP);
+};
+
+class ToneMapParamsValue : public vsg::Inherit<vsg::Value<ToneMapParams>, ToneMapParamsValue>
+{
+};
+
+// Same curve as toneMap.comp on CPU, including gamma correction. Used for images written by TiledRenderer
+vsg::vec3 toneMap(const vsg::vec3& radiance, const ToneMapParams& params);
+
+// Binding indices of the compute shader (toneMap.comp)
+enum class ToneMapBindings : uint32_t
+{
+  RADIANCE = 0,
+  DISPLAY = 1
+};
+
+// Compute pass which converts HDR radiance in the first layer of the ray tracing target into an 8-bit image for the window.
+// Exposure and curve are read from params when commands are recorded, so changing them does not require re-rendering.
+class ToneMapper : public vsg::Inherit<vsg::Object, ToneMapper>
+{
+public:
+  ToneMapper(vsg::Device* device, vsg::ref_ptr<vsg::Image> radianceImage, vsg::ref_ptr<vsg::ImageView> radianceImageView, uint32_t width, uint32_t height, vsg::ref_ptr<ToneMapParamsValue> params);
+
+  // Commands which have to be recorded after tracing
+  vsg::ref_ptr<vsg::Commands> createCommands();
+
+  vsg::ref_ptr<vsg::ImageView> getDisplayImageView() const { return displayImageView; }
+
+  vsg::ref_ptr<ToneMapParamsValue> params;
+
+protected:
+  uint32_t width, height;
+
+  vsg::ref_ptr<vsg::Image> radianceImage;
+  vsg::ref_ptr<vsg::Image> displayImage;  // VK_FORMAT_B8G8R8A8_UNORM, same as the swapchain
+  vsg::ref_ptr<vsg::ImageView> displayImageView;
+  vsg::ref_ptr<vsg::DescriptorSet> descriptorSet;
+  vsg::ref_ptr<vsg::PipelineLayout> pipelineLayout;
+  vsg::ref_ptr<vsg::ComputePipeline> pipeline;
+};
+
+// Adjusts tone mapping of the interactive viewer.
+// "+" and "-" change exposure by 0.5 EV and "t" switches the operator.
+class ToneMapKeyHandler : public vsg::Inherit<vsg::Visitor, ToneMapKeyHandler>
+{
+public:
+  ToneMapKeyHandler(vsg::ref_ptr<ToneMapParamsValue> params) : params(params) {}
+
+  void apply(vsg::KeyPressEvent& keyPress) override;
+
+  vsg::ref_ptr<ToneMapParamsValue> params;
+};
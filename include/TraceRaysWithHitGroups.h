@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <vsg/core/Inherit.h>
+#include <vsg/commands/Command.h>
+#include <vsg/vk/Buffer.h>
+#include "CachedRayTracingPipeline.h"
+
+// Same as vsg::TraceRays, but the hit region of the shader binding table contains a record per geometry,
+// each of which refers to one of several hit groups. The record of a hit is found at GeometryInstance::shaderOffset
+// (instanceShaderBindingTableRecordOffset) + geometry index, because rays are traced with sbtRecordStride 1.
+// The shader binding table is built by this command, therefore indices of shader groups in the pipeline have to be given.
+class TraceRaysWithHitGroups : public vsg::Inherit<vsg::Command, TraceRaysWithHitGroups>
+{
+public:
+  // hitRecords are indices of hit groups counted from firstHitGroup
+  TraceRaysWithHitGroups(vsg::ref_ptr<CachedRayTracingPipeline> pipeline, uint32_t raygenGroup, uint32_t missGroup, uint32_t firstHitGroup, uint32_t numHitGroups, const std::vector<uint32_t>& hitRecords);
+
+  // Replace hit records (e.g. when primitives were added to the scene). The shader binding table is built again by the next compile,
+  // therefore the GPU must not use the current one
+  void setHitGroups(uint32_t numHitGroups, const std::vector<uint32_t>& hitRecords);
+
+  void compile(vsg::Context& context) override;
+  void record(vsg::CommandBuffer& commandBuffer) const override;
+
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t depth = 1;
+
+protected:
+  vsg::ref_ptr<CachedRayTracingPipeline> pipeline;
+  uint32_t raygenGroup, missGroup, firstHitGroup, numHitGroups;
+  std::vector<uint32_t> hitRecords;
+
+  vsg::ref_ptr<vsg::Buffer> bindingTableBuffer;
+  VkStridedDeviceAddressRegionKHR raygenRegion{}, missRegion{}, hitRegion{}, callableRegion{};
+};
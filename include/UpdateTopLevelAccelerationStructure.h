@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <vsg/core/Inherit.h>
+#include <vsg/commands/Command.h>
+#include <vsg/vk/Buffer.h>
+#include "RayTracingScene.h"
+
+// A command which refits TLAS of a scene when instance transforms were changed by RayTracingScene::setInstanceTransform.
+// BLASes are not touched. It has to be recorded before TraceRays.
+class UpdateTopLevelAccelerationStructure : public vsg::Inherit<vsg::Command, UpdateTopLevelAccelerationStructure>
+{
+public:
+  UpdateTopLevelAccelerationStructure(vsg::ref_ptr<RayTracingScene> scene);
+
+  void compile(vsg::Context& context) override;
+  void record(vsg::CommandBuffer& commandBuffer) const override;
+
+  // Refitting degrades quality of TLAS when instances move a lot.
+  // If not zero, every N-th update rebuilds TLAS from scratch instead of refitting.
+  uint32_t rebuildInterval = 60;
+
+protected:
+  vsg::ref_ptr<RayTracingScene> scene;
+
+  vsg::ref_ptr<vsg::Buffer> instanceBuffer; // Array of VkAccelerationStructureInstanceKHR
+  vsg::ref_ptr<vsg::Buffer> scratchBuffer;
+  VkDeviceAddress instanceBufferAddress = 0;
+  VkDeviceAddress scratchBufferAddress = 0;
+
+  std::vector<uint64_t> blasReferences; // Device addresses of BLAS of each instance
+
+  mutable uint32_t updateCount = 0;
+};
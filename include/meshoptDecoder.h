@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Decoders of the bitstreams defined by glTF extension EXT_meshopt_compression
+// See: https://github.com/KhronosGroup/glTF/blob/main/extensions/2.0/Vendor/EXT_meshopt_compression/README.md
+// Each function returns false if the data is malformed.
+
+// Mode "ATTRIBUTES": count elements of byteStride bytes
+bool decodeMeshoptVertexBuffer(uint8_t* destination, size_t count, size_t byteStride, const uint8_t* buffer, size_t size);
+// Mode "TRIANGLES": count indices of indexSize (2 or 4) bytes
+bool decodeMeshoptIndexBuffer(uint8_t* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size);
+// Mode "INDICES": count indices of indexSize (2 or 4) bytes
+bool decodeMeshoptIndexSequence(uint8_t* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size);
+
+// Apply filter "OCTAHEDRAL", "QUATERNION" or "EXPONENTIAL" in place after decoding attributes ("NONE" does nothing)
+bool applyMeshoptFilter(uint8_t* data, size_t count, size_t byteStride, const std::string& filter);
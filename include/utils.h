@@ -1,32 +1,55 @@
-#pragma once
-
-#include <vector>
-#include <vsg/maths/vec3.h>
-#include <vsg/nodes/Node.h>
-#include <vsg/utils/Builder.h>
-#include <vsg/core/Array.h>
-
-vsg::ref_ptr<vsg::Node> createSphere(vsg::vec3 center, float radius);
-vsg::ref_ptr<vsg::Node> createQuad(vsg::vec3 center, vsg::vec3 normal, vsg::vec3 up, float width, float height);
-
-vsg::ref_ptr<vsg::Data> loadEXRTexture(const std::string& path);
-
-template<typename T>
-vsg::ref_ptr<vsg::Array<T>> concatArray(std::vector<vsg::ref_ptr<vsg::Array<T>>> arrays)
-{
-  size_t totalValueCount = 0;
-  for (auto& arr : arrays) {
-    totalValueCount += arr->valueCount();
-  }
-  
-  auto newArray = vsg::Array<T>::create(totalValueCount);
-  size_t pos = 0;
-  for (auto& arr : arrays) {
-    for (auto& elem : *arr) {
-      newArray->at(pos) = elem;
-      ++pos;
-    }
-  }
-
-  return newArray;
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <vsg/maths/vec3.h>
+#include <vsg/nodes/Node.h>
+#include <vsg/utils/Builder.h>
+#include <vsg/core/Array.h>
+#include <vsg/vk/Buffer.h>
+
+// Analytic shapes traced with the intersection shader (see ProceduralShape). up is projected onto the plane of a quad or disk
+vsg::ref_ptr<vsg::Node> createSphere(vsg::vec3 center, float radius);
+vsg::ref_ptr<vsg::Node> createQuad(vsg::vec3 center, vsg::vec3 normal, vsg::vec3 up, float width, float height);
+vsg::ref_ptr<vsg::Node> createDisk(vsg::vec3 center, vsg::vec3 normal, vsg::vec3 up, float radius);
+
+vsg::ref_ptr<vsg::Data> loadEXRTexture(const std::string& path);
+// A channel of an image saved by saveEXRImage (row-major, top to bottom)
+struct EXRChannel
+{
+  std::string name;
+  std::vector<float> pixels;
+};
+
+// Save float channels as a (multi-layer) OpenEXR image. Returns false on failure
+bool saveEXRImage(const std::string& path, int width, int height, std::vector<EXRChannel> channels);
+
+// Get device address of a buffer created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+VkDeviceAddress getBufferDeviceAddress(vsg::Device* device, vsg::ref_ptr<vsg::Buffer> buffer);
+
+// Create a host visible buffer filled with content of data
+vsg::ref_ptr<vsg::Buffer> createHostVisibleBuffer(vsg::Device* device, vsg::ref_ptr<vsg::Data> data, VkBufferUsageFlags usage);
+
+// 64-bit FNV-1a, which is stable across runs and platforms unlike std::hash. Pass a previous result as hash to continue it
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull);
+
+template<typename T>
+vsg::ref_ptr<vsg::Array<T>> concatArray(std::vector<vsg::ref_ptr<vsg::Array<T>>> arrays)
+{
+  size_t totalValueCount = 0;
+  for (auto& arr : arrays) {
+    totalValueCount += arr->valueCount();
+  }
+  
+  auto newArray = vsg::Array<T>::create(totalValueCount);
+  size_t pos = 0;
+  for (auto& arr : arrays) {
+    for (auto& elem : *arr) {
+      newArray->at(pos) = elem;
+      ++pos;
+    }
+  }
+
+  return newArray;
 }
\ No newline at end of file
@@ -1,135 +1,177 @@
-// Macros, constants, struct definitions, and utility functions for shaders
-
-// Binding indices
-
-#define BINDING_TLAS  0
-#define BINDING_TARGET_IMAGE 1
-#define BINDING_UNIFORMS 2
-#define BINDING_OBJECT_INFOS 3
-#define BINDING_INDICES 4
-#define BINDING_VERTICES 5
-#define BINDING_NORMALS 6
-#define BINDING_TEX_COORDS 7
-#define BINDING_TANGENTS 8
-#define BINDING_TEXTURES 10
-#define BINDING_HAMMERSLEY 11
-#define BINDING_ENV_MAP 12
-
-// Constants
-
-const float EPSILON = 0.0001;
-const float PI = 3.14159265359;
-
-const int MAX_NUM_TEXTURES = 32;
-
-const int ALPHA_MODE_OPAQUE = 0;
-const int ALPHA_MODE_MASK = 1;
-
-
-// Structs
-
-struct Material
-{
-  vec3 color;
-  float metallic;
-  float roughness;
-  int colorTextureIdx;
-  int metallicRoughnessTextureIdx;
-  int normalTextureIdx;
-  float normalTextureScale;
-  int emissiveTextureIdx;
-  vec3 emissive;
-  int alphaMode;
-  float alphaFactor;
-  float alphaCutoff;
-};
-
-struct ObjectInfo
-{
-  uint indexOffset;
-  uint vertexOffset;
-  Material material;
-};
-
-// State for Xorshift random number generator
-struct RandomState
-{
-  uint x, y, z, w;
-};
-
-struct RayPayload
-{
-  vec3 multiplier;  // This will be multiplied to light value (background or emissive)
-  vec3 color; // Radiance will be accumulated to this variable
-  bool traceNextRay;
-  vec3 nextOrigin;
-  vec3 nextDirection;
-  float random[3];  // [0,1) random numbers used in closest hit shader
-};
-
-struct RayTracingUniform
-{
-  mat4 invViewMat; // Inverse of view matrix (i.e. transform camera coordinate to world coordinate)
-  mat4 invProjectionMat; // Inverse of projection matrix (i.e. transform normalized device coordinate into camera coordinate)
-  uint samplesPerPixel; // How many rays are sampled to render one pixel
-};
-
-
-// Utility functions
-
-// Pseudo-random number using Xorshift (xor128)
-// G. Marsaglia, "Xorshift RNGs", Journal of Statistical Software, vol. 8, no. 14, pp. 1-6, 2003, doi: 10.18637/jss.v008.i14
-uint random(inout RandomState state)
-{
-  uint t = (state.x ^ (state.x << 11));
-  state.x = state.y;
-  state.y = state.z;
-  state.z = state.w;
-  return (state.w = (state.w ^ (state.w >> 19)) ^ (t ^ (t >> 8)));
-}
-
-// Initialize the RNG.
-void initRandom(out RandomState state, uint x)
-{
-  state.x = x;
-  // Values of y, z, w are same as Marsaglia's paper.
-  state.y = 362436069;
-  state.z = 521288629;
-  state.w = 88675123;
-}
-
-float randomFloat(inout RandomState state, float minimum, float maximum)
-{
-  return minimum + (float(random(state)) / 4294967296.0) * (maximum - minimum);
-}
-
-bool nearZero(in vec3 v)
-{
-  return (abs(v.x) < EPSILON) && (abs(v.y) < EPSILON) && (abs(v.z) < EPSILON);
-}
-
-// Interpolation using barycentric coordinates
-vec2 interpolate(in vec2 v0, in vec2 v1, in vec2 v2, in vec2 uv)
-{
-  return (1.0 - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2;
-}
-
-vec3 interpolate(in vec3 v0, in vec3 v1, in vec3 v2, in vec2 uv)
-{
-  return (1.0 - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2;
-}
-
-vec4 interpolate(in vec4 v0, in vec4 v1, in vec4 v2, in vec2 uv)
-{
-  return (1.0 - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2;
-}
-
-// atan(y, x) with handling of x==0
-// Because GLSL atan(y, x) is undefined when x==0.
-// See:
-//  https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/atan.xhtml
-//  https://qiita.com/7CIT/items/ad76cfa6771641951d31
-float safeAtan(in float y, in float x)
-{
-  return (abs(x) > EPSILON) ? atan(y, x) : (sign(y) * PI / 2.0);
-}
+// Macros, constants, struct definitions, and utility functions for shaders
+
+// Binding indices
+
+#define BINDING_TLAS  0
+#define BINDING_TARGET_IMAGE 1
+#define BINDING_UNIFORMS 2
+#define BINDING_OBJECT_INFOS 3
+#define BINDING_MATERIALS 9
+#define BINDING_TEXTURES 10
+#define BINDING_HAMMERSLEY 11
+#define BINDING_ENV_MAP 12
+#define BINDING_TEXTURE_FEEDBACK 13
+#define BINDING_AOV_IMAGE 14
+#define BINDING_GBUFFER 15
+#define BINDING_PREV_TARGET_IMAGE 16
+#define BINDING_PREV_GBUFFER 17
+
+// Constants
+
+const float EPSILON = 0.0001;
+const float PI = 3.14159265359;
+
+const int MAX_NUM_TEXTURES = 32;
+
+const int ALPHA_MODE_OPAQUE = 0;
+const int ALPHA_MODE_MASK = 1;
+
+// Primitive shapes (these must agree with PrimitiveShape in ProceduralBottomLevelAccelerationStructure.h)
+#define SHAPE_TRIANGLES 0
+#define SHAPE_SPHERE 1
+#define SHAPE_QUAD 2
+#define SHAPE_DISK 3
+
+// Hit kinds reported by the intersection shader for outside and inside of analytic shapes
+#define HIT_KIND_SHAPE_FRONT 0
+#define HIT_KIND_SHAPE_BACK 1
+
+
+// Structs
+
+struct Material
+{
+  vec3 color;
+  float metallic;
+  float roughness;
+  int colorTextureIdx;
+  int metallicRoughnessTextureIdx;
+  int normalTextureIdx;
+  float normalTextureScale;
+  int emissiveTextureIdx;
+  vec3 emissive;
+  int alphaMode;
+  float alphaFactor;
+  float alphaCutoff;
+};
+
+struct ObjectInfo
+{
+  // Device addresses of indices and vertex attributes (zero for analytic shapes).
+  // Shaders reading them declare buffer_reference blocks and enable GL_EXT_buffer_reference_uvec2
+  uvec2 indices;
+  uvec2 vertices;
+  uvec2 normals;
+  uvec2 texCoords;
+  uvec2 tangents;
+  uint materialId;  // Index in the material buffer
+  uint shape; // SHAPE_*
+};
+
+// State for Xorshift random number generator
+struct RandomState
+{
+  uint x, y, z, w;
+};
+
+struct RayPayload
+{
+  vec3 multiplier;  // This will be multiplied to light value (background or emissive)
+  vec3 color; // Radiance will be accumulated to this variable
+  bool traceNextRay;
+  vec3 nextOrigin;
+  vec3 nextDirection;
+  float random[3];  // [0,1) random numbers used in closest hit shader
+  // Attributes of the hit (used as AOVs at the first hit)
+  float hitT;  // Negative on miss
+  vec3 normal;  // Shading normal in world coordinate
+  vec3 albedo;
+  float roughness;
+  float metallic;
+  uint instanceId;
+  uint materialId;
+};
+
+const uint MAX_NUM_VIEWS = 8; // This must agree with the definition in RayTracingUniform.h
+
+struct RayTracingUniform
+{
+  // One camera per layer of the target image (selected by gl_LaunchIDEXT.z)
+  mat4 invViewMat[MAX_NUM_VIEWS]; // Inverse of view matrix (i.e. transform camera coordinate to world coordinate)
+  mat4 invProjectionMat[MAX_NUM_VIEWS]; // Inverse of projection matrix (i.e. transform normalized device coordinate into camera coordinate)
+  mat4 prevViewProjectionMat[MAX_NUM_VIEWS]; // Projection matrix times view matrix of the previous camera (for motion vectors)
+  uint samplesPerPixel; // How many rays are sampled to render one pixel
+  float pixelSpreadAngle; // Angle between rays of adjacent pixels (used to estimate texture resolution needed at a hit)
+  uint maxHistorySamples; // Samples of previous frames reused by temporal reprojection (0 disables it)
+  uint historyValid; // Whether the previous frame left radiance and G-buffer to reproject
+  uint randomSeed; // Changed every frame while history is accumulated, so that frames trace different samples
+};
+
+// Region of the image and range of samples rendered by one launch (this must agree with TileParams in RayTracingUniform.h)
+struct TileParams
+{
+  uvec2 tileOffset; // Position of the first pixel of the launch in the whole image
+  uvec2 imageSize;  // Size of the whole image
+  uint sampleOffset;  // Index of the first sample. Results of previous samples in the target image are accumulated if not zero
+  uint sampleCount; // Number of samples per pixel in this launch
+};
+
+
+// Utility functions
+
+// Pseudo-random number using Xorshift (xor128)
+// G. Marsaglia, "Xorshift RNGs", Journal of Statistical Software, vol. 8, no. 14, pp. 1-6, 2003, doi: 10.18637/jss.v008.i14
+uint random(inout RandomState state)
+{
+  uint t = (state.x ^ (state.x << 11));
+  state.x = state.y;
+  state.y = state.z;
+  state.z = state.w;
+  return (state.w = (state.w ^ (state.w >> 19)) ^ (t ^ (t >> 8)));
+}
+
+// Initialize the RNG.
+void initRandom(out RandomState state, uint x)
+{
+  state.x = x;
+  // Values of y, z, w are same as Marsaglia's paper.
+  state.y = 362436069;
+  state.z = 521288629;
+  state.w = 88675123;
+}
+
+float randomFloat(inout RandomState state, float minimum, float maximum)
+{
+  return minimum + (float(random(state)) / 4294967296.0) * (maximum - minimum);
+}
+
+bool nearZero(in vec3 v)
+{
+  return (abs(v.x) < EPSILON) && (abs(v.y) < EPSILON) && (abs(v.z) < EPSILON);
+}
+
+// Interpolation using barycentric coordinates
+vec2 interpolate(in vec2 v0, in vec2 v1, in vec2 v2, in vec2 uv)
+{
+  return (1.0 - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2;
+}
+
+vec3 interpolate(in vec3 v0, in vec3 v1, in vec3 v2, in vec2 uv)
+{
+  return (1.0 - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2;
+}
+
+vec4 interpolate(in vec4 v0, in vec4 v1, in vec4 v2, in vec2 uv)
+{
+  return (1.0 - uv.x - uv.y) * v0 + uv.x * v1 + uv.y * v2;
+}
+
+// atan(y, x) with handling of x==0
+// Because GLSL atan(y, x) is undefined when x==0.
+// See:
+//  https://www.khronos.org/registry/OpenGL-Refpages/gl4/html/atan.xhtml
+//  https://qiita.com/7CIT/items/ad76cfa6771641951d31
+float safeAtan(in float y, in float x)
+{
+  return (abs(x) > EPSILON) ? atan(y, x) : (sign(y) * PI / 2.0);
+}
@@ -0,0 +1,178 @@
+#include "AccelerationStructureBuilder.h"
+
+#include <chrono>
+#include <set>
+#include <vector>
+#include <vsg/all.h>
+
+void SceneMemoryReport::print(std::ostream& stream) const
+{
+  stream << "Scene memory (bytes):" << std::endl;
+  stream << "  BLAS: " << blasBytes << " (" << numBLAS << " structures";
+  if (numCompactedBLAS > 0) {
+    stream << ", " << numCompactedBLAS << " compacted from " << uncompactedBLASBytes << " bytes";
+  }
+  stream << ")" << std::endl;
+  stream << "  TLAS: " << tlasBytes << std::endl;
+  stream << "  scratch: " << scratchBytes << std::endl;
+  stream << "  attribute buffers: " << attributeBytes << std::endl;
+  stream << "  textures: " << textureBytes;
+  if (deduplicatedTextureBytes > 0) {
+    stream << " (" << deduplicatedTextureBytes << " saved by sharing identical images)";
+  }
+  stream << std::endl;
+  stream << "BLAS build: " << blasBuildMilliseconds << " ms" << std::endl;
+}
+
+// BLASes referenced by instances of the scene (an instance may share its BLAS with others)
+static std::vector<DynamicBottomLevelAccelerationStructure*> collectBLASes(RayTracingScene* scene)
+{
+  std::vector<DynamicBottomLevelAccelerationStructure*> blases;
+  std::set<DynamicBottomLevelAccelerationStructure*> visited;
+  for (auto& instance : scene->tlas->geometryInstances) {
+    auto blas = instance->accelerationStructure.cast<DynamicBottomLevelAccelerationStructure>();
+    if (blas && visited.insert(blas.get()).second) {
+      blases.push_back(blas.get());
+    }
+  }
+  return blases;
+}
+
+AccelerationStructureBuilder::AccelerationStructureBuilder(vsg::ref_ptr<vsg::Window> window)
+  : window(window)
+{
+  vsg::Device* device = window->getOrCreateDevice();
+
+  int queueFamily = device->getPhysicalDevice()->getQueueFamily(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+  commandPool = vsg::CommandPool::create(device, queueFamily);
+  queue = device->getQueue(queueFamily);
+}
+
+void AccelerationStructureBuilder::build(RayTracingScene* scene)
+{
+  scene->uploadGeometry(commandPool, queue);
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  buildAndCompact(scene);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+  buildMilliseconds += elapsed.count();
+}
+
+void AccelerationStructureBuilder::buildAndCompact(RayTracingScene* scene)
+{
+  vsg::Device* device = window->getOrCreateDevice();
+  auto extensions = device->getExtensions();
+
+  std::vector<DynamicBottomLevelAccelerationStructure*> newBLASes;
+  for (auto blas : collectBLASes(scene)) {
+    if (!blas->compiled()) {
+      newBLASes.push_back(blas);
+    }
+  }
+  if (newBLASes.empty()) {
+    return;
+  }
+
+  // Build through VSG (geometry buffers are uploaded and builds are recorded by the context)
+  auto compileTraversal = vsg::CompileTraversal::create(window);
+  for (auto& context : compileTraversal->contexts) {
+    for (auto blas : newBLASes) {
+      blas->compile(*context);
+    }
+    context->record();
+    context->waitForCompletion();
+  }
+
+  // Refitted BLASes are not compacted, because refit needs the update scratch size of the original structure
+  std::vector<DynamicBottomLevelAccelerationStructure*> compactedBLASes;
+  for (auto blas : newBLASes) {
+    if (blas->allowCompaction && !blas->allowUpdate) {
+      compactedBLASes.push_back(blas);
+    }
+  }
+  if (compactedBLASes.empty()) {
+    return;
+  }
+
+  // Query sizes of compacted structures
+  uint32_t numQueries = uint32_t(compactedBLASes.size());
+  VkQueryPoolCreateInfo queryPoolInfo{};
+  queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryPoolInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+  queryPoolInfo.queryCount = numQueries;
+  VkQueryPool queryPool;
+  vkCreateQueryPool(*device, &queryPoolInfo, nullptr, &queryPool);
+
+  std::vector<VkAccelerationStructureKHR> structures;
+  for (auto blas : compactedBLASes) {
+    structures.push_back(blas->vk(device->deviceID));
+  }
+  vsg::submitCommandsToQueue(device, commandPool, queue, [&](vsg::CommandBuffer& commandBuffer) {
+    vkCmdResetQueryPool(commandBuffer, queryPool, 0, numQueries);
+    extensions->vkCmdWriteAccelerationStructuresPropertiesKHR(
+      commandBuffer, numQueries, structures.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, 0);
+  });
+  std::vector<VkDeviceSize> compactedSizes(numQueries);
+  vkGetQueryPoolResults(
+    *device, queryPool, 0, numQueries, numQueries * sizeof(VkDeviceSize), compactedSizes.data(), sizeof(VkDeviceSize),
+    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+  vkDestroyQueryPool(*device, queryPool, nullptr);
+
+  // Copy into smaller structures, then release the original ones
+  vsg::submitCommandsToQueue(device, commandPool, queue, [&](vsg::CommandBuffer& commandBuffer) {
+    for (uint32_t i = 0; i < numQueries; ++i) {
+      compactedBLASes[i]->recordCompaction(commandBuffer, compactedSizes[i]);
+    }
+  });
+  for (auto blas : compactedBLASes) {
+    blas->releaseUncompacted();
+  }
+}
+
+SceneMemoryReport AccelerationStructureBuilder::report(RayTracingScene* scene) const
+{
+  vsg::Device* device = window->getOrCreateDevice();
+
+  SceneMemoryReport report;
+  report.blasBuildMilliseconds = buildMilliseconds;
+  for (auto blas : collectBLASes(scene)) {
+    ++report.numBLAS;
+    report.blasBytes += blas->size();
+    report.uncompactedBLASBytes += blas->uncompactedSize();
+    report.scratchBytes += blas->buildScratchSize();
+    if (blas->compacted()) {
+      ++report.numCompactedBLAS;
+    }
+  }
+
+  // TLAS may not be built yet, therefore its sizes are queried (addresses are ignored by the query)
+  VkAccelerationStructureGeometryKHR geometry{};
+  geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+  geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{};
+  buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+  buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  buildInfo.flags = scene->tlas->buildFlags();
+  buildInfo.geometryCount = 1;
+  buildInfo.pGeometries = &geometry;
+
+  uint32_t primitiveCount = uint32_t(scene->tlas->geometryInstances.size());
+  VkAccelerationStructureBuildSizesInfoKHR sizeInfo{};
+  sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+  device->getExtensions()->vkGetAccelerationStructureBuildSizesKHR(*device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &primitiveCount, &sizeInfo);
+  report.tlasBytes = sizeInfo.accelerationStructureSize;
+  report.scratchBytes += sizeInfo.buildScratchSize;
+
+  report.attributeBytes = scene->getAttributeBufferSize();
+
+  for (auto& imageInfo : scene->textures) {
+    if (imageInfo.imageView && imageInfo.imageView->image && imageInfo.imageView->image->data) {
+      report.textureBytes += imageInfo.imageView->image->data->dataSize();
+    }
+  }
+  report.deduplicatedTextureBytes = scene->getDeduplicatedTextureBytes();
+
+  return report;
+}
@@ -0,0 +1,59 @@
+#include "AsyncSceneLoader.h"
+
+#include <iostream>
+#include "GLTFLoader.h"
+#include "utils.h"
+
+AsyncSceneLoader::AsyncSceneLoader(vsg::ref_ptr<RayTracingScene> scene, const std::vector<std::string>& gltfFiles, const std::string& envMapFile, std::optional<MeshOptimizer> meshOptimizer)
+  : meshOptimizer(meshOptimizer), scene(scene)
+{
+  worker = std::thread(&AsyncSceneLoader::load, this, gltfFiles, envMapFile);
+}
+
+AsyncSceneLoader::~AsyncSceneLoader()
+{
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+bool AsyncSceneLoader::wait()
+{
+  if (worker.joinable()) {
+    worker.join();
+  }
+  return succeeded;
+}
+
+void AsyncSceneLoader::load(const std::vector<std::string>& gltfFiles, const std::string& envMapFile)
+{
+  // Environment map first, because it is visible regardless of how much of the geometry has arrived
+  if (!envMapFile.empty()) {
+    auto envMap = loadEXRTexture(envMapFile);
+    if (!envMap) {
+      std::cerr << "Environment map load error" << std::endl;
+      done = true;
+      return;
+    }
+    scene->setEnvMap(envMap);
+  }
+
+  // Only one animation is played, therefore animations of later files are ignored
+  for (auto& gltfFile : gltfFiles) {
+    GLTFLoader loader(scene);
+    loader.meshOptimizer = meshOptimizer;
+    if (!loader.loadFile(gltfFile)) {
+      std::cerr << "GLTF load error: " << gltfFile << std::endl;
+      done = true;
+      return;
+    }
+
+    meshOptimizer = loader.meshOptimizer;
+    if (!animation) {
+      animation = loader.animation;
+    }
+  }
+
+  succeeded = true;
+  done = true;  // Results above are visible to threads which see this
+}
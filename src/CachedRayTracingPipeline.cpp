@@ -0,0 +1,86 @@
+#include "CachedRayTracingPipeline.h"
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <vsg/core/Exception.h>
+#include <vsg/vk/CommandBuffer.h>
+#include <vsg/vk/Extensions.h>
+
+CachedRayTracingPipeline::CachedRayTracingPipeline(vsg::ref_ptr<vsg::PipelineLayout> layout, const vsg::ShaderStages& shaderStages, const vsg::RayTracingShaderGroups& shaderGroups)
+  : layout(layout), shaderStages(shaderStages), shaderGroups(shaderGroups)
+{
+}
+
+CachedRayTracingPipeline::~CachedRayTracingPipeline()
+{
+  release();
+}
+
+void CachedRayTracingPipeline::release()
+{
+  if (pipeline != VK_NULL_HANDLE) {
+    vkDestroyPipeline(*device, pipeline, device->getAllocationCallbacks());
+    pipeline = VK_NULL_HANDLE;
+  }
+}
+
+void CachedRayTracingPipeline::compile(vsg::Context& context)
+{
+  if (pipeline != VK_NULL_HANDLE) {
+    return; // Already compiled
+  }
+
+  device = context.device;
+  auto extensions = device->getExtensions();
+
+  layout->compile(context);
+
+  std::vector<VkPipelineShaderStageCreateInfo> stageInfos(shaderStages.size());
+  for (size_t i = 0; i < shaderStages.size(); i++) {
+    shaderStages[i]->compile(context);
+    stageInfos[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    shaderStages[i]->apply(context, stageInfos[i]);
+  }
+
+  std::vector<VkRayTracingShaderGroupCreateInfoKHR> groupInfos(shaderGroups.size());
+  for (size_t i = 0; i < shaderGroups.size(); i++) {
+    shaderGroups[i]->applyTo(groupInfos[i]);
+  }
+
+  VkRayTracingPipelineCreateInfoKHR pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR;
+  pipelineInfo.stageCount = uint32_t(stageInfos.size());
+  pipelineInfo.pStages = stageInfos.data();
+  pipelineInfo.groupCount = uint32_t(groupInfos.size());
+  pipelineInfo.pGroups = groupInfos.data();
+  pipelineInfo.maxPipelineRayRecursionDepth = maxRecursionDepth;
+  pipelineInfo.layout = layout->vk(context.deviceID);
+
+  VkPipelineCache cache = pipelineCache ? pipelineCache->load(device, shaderStages) : VK_NULL_HANDLE;
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  VkResult result = extensions->vkCreateRayTracingPipelinesKHR(*device, VK_NULL_HANDLE, cache, 1, &pipelineInfo, device->getAllocationCallbacks(), &pipeline);
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+  if (result != VK_SUCCESS) {
+    // Same as vsg::RayTracingPipeline. Binding and tracing a null pipeline is invalid
+    pipeline = VK_NULL_HANDLE;
+    throw vsg::Exception{"Error: CachedRayTracingPipeline failed to create VkPipeline.", result};
+  }
+
+  // Reported into stderr, because stdout carries results in server mode
+  std::cerr << "Ray tracing pipeline created in " << elapsed.count() << " ms";
+  if (pipelineCache) {
+    std::cerr << " (pipeline cache " << (pipelineCache->isLoaded() ? "loaded" : "empty") << ")";
+    pipelineCache->save();
+  }
+  std::cerr << std::endl;
+}
+
+void BindCachedRayTracingPipeline::record(vsg::CommandBuffer& commandBuffer) const
+{
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipeline->vk());
+  // PushConstants use the layout of the bound pipeline
+  commandBuffer.setCurrentPipelineLayout(pipeline->layout->vk(commandBuffer.deviceID));
+}
@@ -0,0 +1,82 @@
+#include "DynamicBottomLevelAccelerationStructure.h"
+
+#include <vsg/vk/Extensions.h>
+
+DynamicBottomLevelAccelerationStructure::DynamicBottomLevelAccelerationStructure(vsg::Device* device)
+  : Inherit(device)
+{
+}
+
+void DynamicBottomLevelAccelerationStructure::compile(vsg::Context& context)
+{
+  if (isCompiled) {
+    return;
+  }
+
+  applyBuildFlags();
+  BottomLevelAccelerationStructure::compile(context);
+  isCompiled = true;
+}
+
+void DynamicBottomLevelAccelerationStructure::applyBuildFlags()
+{
+  auto& flags = _accelerationStructureBuildGeometryInfo.flags;
+  flags &= ~(VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR);
+  flags |= (buildPreference == AccelerationStructureBuildPreference::FAST_BUILD)
+    ? VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR
+    : VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+  if (allowUpdate) {
+    flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+  }
+  if (allowCompaction) {
+    flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+  }
+}
+
+VkDeviceSize DynamicBottomLevelAccelerationStructure::size() const
+{
+  return compacted() ? compactedSize : uncompactedSize();
+}
+
+void DynamicBottomLevelAccelerationStructure::recordCompaction(vsg::CommandBuffer& commandBuffer, VkDeviceSize newSize)
+{
+  auto extensions = _device->getExtensions();
+
+  // Create a smaller structure in the same way as vsg::AccelerationStructure::compile
+  auto buffer = vsg::createBufferAndMemory(
+    _device, newSize,
+    VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  VkAccelerationStructureCreateInfoKHR createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+  createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+  createInfo.buffer = buffer->vk(_device->deviceID);
+  createInfo.offset = buffer->getMemoryOffset(_device->deviceID);
+  createInfo.size = newSize;
+  VkAccelerationStructureKHR compactedStructure;
+  extensions->vkCreateAccelerationStructureKHR(*_device, &createInfo, nullptr, &compactedStructure);
+
+  VkCopyAccelerationStructureInfoKHR copyInfo{};
+  copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+  copyInfo.src = _accelerationStructure;
+  copyInfo.dst = compactedStructure;
+  copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+  extensions->vkCmdCopyAccelerationStructureKHR(commandBuffer, &copyInfo);
+
+  // TLAS built later refers to the compacted structure
+  uncompacted = _accelerationStructure;
+  uncompactedBuffer = _buffer;
+  _accelerationStructure = compactedStructure;
+  _buffer = buffer;
+  compactedSize = newSize;
+}
+
+void DynamicBottomLevelAccelerationStructure::releaseUncompacted()
+{
+  if (uncompacted != VK_NULL_HANDLE) {
+    _device->getExtensions()->vkDestroyAccelerationStructureKHR(*_device, uncompacted, nullptr);
+    uncompacted = VK_NULL_HANDLE;
+  }
+  uncompactedBuffer = nullptr;
+}
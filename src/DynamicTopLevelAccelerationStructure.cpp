@@ -0,0 +1,15 @@
+#include "DynamicTopLevelAccelerationStructure.h"
+
+DynamicTopLevelAccelerationStructure::DynamicTopLevelAccelerationStructure(vsg::Device* device)
+  : Inherit(device)
+{
+}
+
+void DynamicTopLevelAccelerationStructure::compile(vsg::Context& context)
+{
+  if (allowUpdate) {
+    _accelerationStructureBuildGeometryInfo.flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+  }
+
+  TopLevelAccelerationStructure::compile(context);
+}
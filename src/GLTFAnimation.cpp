@@ -0,0 +1,202 @@
+#include "GLTFAnimation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vsg/maths/transform.h>
+
+// Spherical linear interpolation of quaternions stored in vec4 (x, y, z, w)
+// See: 3.11 in glTF 2.0 Specification https://www.khronos.org/registry/glTF/specs/2.0/glTF-2.0.html#animations
+static vsg::vec4 slerp(const vsg::vec4& q0, vsg::vec4 q1, float r)
+{
+  float cosTheta = vsg::dot(q0, q1);
+  if (cosTheta < 0.0f) {  // Take shorter path
+    q1 = q1 * -1.0f;
+    cosTheta = -cosTheta;
+  }
+
+  if (cosTheta > 0.9995f) { // Nearly parallel. Use linear interpolation to avoid division by zero
+    return vsg::normalize(q0 * (1.0f - r) + q1 * r);
+  }
+
+  float theta = std::acos(cosTheta);
+  float sinTheta = std::sin(theta);
+  return q0 * (std::sin((1.0f - r) * theta) / sinTheta) + q1 * (std::sin(r * theta) / sinTheta);
+}
+
+GLTFAnimation::GLTFAnimation(vsg::ref_ptr<RayTracingScene> scene)
+  : scene(scene)
+{
+}
+
+void GLTFAnimation::update(double time)
+{
+  bool hasDeformation = !skins.empty() || std::any_of(nodes.begin(), nodes.end(), [](const Node& node) { return !node.weights.empty(); });
+  if (channels.empty() && !hasDeformation) {
+    return;
+  }
+
+  float localTime = (duration > 0.0) ? float(std::fmod(time, duration)) : 0.0f;
+
+  // Start from static state of nodes
+  translations.resize(nodes.size());
+  rotations.resize(nodes.size());
+  scales.resize(nodes.size());
+  weights.resize(nodes.size());
+  globalTransforms.resize(nodes.size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    translations[i] = nodes[i].translation;
+    rotations[i] = vsg::vec4(nodes[i].rotation.x, nodes[i].rotation.y, nodes[i].rotation.z, nodes[i].rotation.w);
+    scales[i] = nodes[i].scale;
+    weights[i] = nodes[i].weights;
+  }
+
+  // Overwrite animated properties
+  for (auto& channel : channels) {
+    switch (channel.path) {
+    case Path::TRANSLATION:
+      sample(channel, localTime, translations[channel.node].data());
+      break;
+    case Path::ROTATION:
+      sample(channel, localTime, rotations[channel.node].data());
+      break;
+    case Path::SCALE:
+      sample(channel, localTime, scales[channel.node].data());
+      break;
+    case Path::WEIGHTS:
+      weights[channel.node].resize(channel.numComponents);
+      sample(channel, localTime, weights[channel.node].data());
+      break;
+    }
+  }
+
+  for (int rootIdx : rootNodes) {
+    updateNode(rootIdx, vsg::mat4());
+  }
+
+  // Joint matrices need global transforms of all nodes
+  if (hasDeformation) {
+    for (int i = 0; i < int(nodes.size()); ++i) {
+      updateDeformation(i);
+    }
+    scene->deformer->update();
+  }
+}
+
+void GLTFAnimation::sample(const Channel& channel, float time, float* result) const
+{
+  auto& times = *channel.times;
+  const float* values = channel.values->data();
+  uint32_t n = channel.numComponents;
+  size_t numKeys = times.valueCount();
+  bool isCubic = channel.interpolation == Interpolation::CUBICSPLINE;
+
+  // Pointer to value (not tangent) of a keyframe
+  auto keyValue = [&](size_t key) { return values + (isCubic ? (3 * key + 1) : key) * n; };
+  auto copyKeyValue = [&](size_t key) { std::copy(keyValue(key), keyValue(key) + n, result); };
+
+  if (numKeys == 0) {
+    return;
+  }
+  if (time <= times[0]) {
+    copyKeyValue(0);
+    return;
+  }
+  if (time >= times[numKeys - 1]) {
+    copyKeyValue(numKeys - 1);
+    return;
+  }
+
+  // Find the keyframe just before the time
+  size_t next = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+  size_t prev = next - 1;
+
+  float delta = times[next] - times[prev];
+  float r = (time - times[prev]) / delta;
+
+  switch (channel.interpolation) {
+  case Interpolation::STEP:
+    copyKeyValue(prev);
+    break;
+  case Interpolation::LINEAR:
+    if (channel.path == Path::ROTATION) {
+      const float* q0 = keyValue(prev);
+      const float* q1 = keyValue(next);
+      vsg::vec4 q = slerp(vsg::vec4(q0[0], q0[1], q0[2], q0[3]), vsg::vec4(q1[0], q1[1], q1[2], q1[3]), r);
+      std::copy(q.data(), q.data() + 4, result);
+    } else {
+      const float* v0 = keyValue(prev);
+      const float* v1 = keyValue(next);
+      for (uint32_t i = 0; i < n; ++i) {
+        result[i] = v0[i] * (1.0f - r) + v1[i] * r;
+      }
+    }
+    break;
+  case Interpolation::CUBICSPLINE:
+    {
+      // Cubic Hermite spline
+      // See: Appendix C in glTF 2.0 Specification https://www.khronos.org/registry/glTF/specs/2.0/glTF-2.0.html#appendix-c-interpolation
+      const float* p0 = values + (3 * prev + 1) * n;
+      const float* m0 = values + (3 * prev + 2) * n; // Out-tangent of previous keyframe
+      const float* p1 = values + (3 * next + 1) * n;
+      const float* m1 = values + (3 * next) * n;  // In-tangent of next keyframe
+      float r2 = r * r;
+      float r3 = r2 * r;
+      for (uint32_t i = 0; i < n; ++i) {
+        result[i] = p0[i] * (2.0f * r3 - 3.0f * r2 + 1.0f) + m0[i] * delta * (r3 - 2.0f * r2 + r)
+          + p1[i] * (-2.0f * r3 + 3.0f * r2) + m1[i] * delta * (r3 - r2);
+      }
+      if (channel.path == Path::ROTATION) {
+        vsg::vec4 q = vsg::normalize(vsg::vec4(result[0], result[1], result[2], result[3]));
+        std::copy(q.data(), q.data() + 4, result);
+      }
+    }
+    break;
+  }
+}
+
+void GLTFAnimation::updateNode(int nodeIdx, const vsg::mat4& parentTransform)
+{
+  const Node& node = nodes[nodeIdx];
+
+  // Same composition as GLTFLoader::loadNode
+  const vsg::vec4& rotation = rotations[nodeIdx];
+  vsg::mat4 transform = parentTransform * node.matrix
+    * vsg::translate(translations[nodeIdx])
+    * vsg::rotate(vsg::quat(rotation.x, rotation.y, rotation.z, rotation.w))
+    * vsg::scale(scales[nodeIdx]);
+  globalTransforms[nodeIdx] = transform;
+
+  if (!channels.empty()) {
+    for (uint32_t id : node.instanceIds) {
+      scene->setInstanceTransform(id, transform);
+    }
+  }
+
+  for (int childIdx : node.children) {
+    updateNode(childIdx, transform);
+  }
+}
+
+void GLTFAnimation::updateDeformation(int nodeIdx)
+{
+  const Node& node = nodes[nodeIdx];
+
+  if (node.skin >= 0) {
+    const Skin& skin = skins[node.skin];
+    // Vertices are transformed into coordinate of the node, because instance transform is applied after skinning
+    vsg::mat4 invNodeTransform = vsg::inverse(globalTransforms[nodeIdx]);
+    std::vector<vsg::mat4> jointMatrices(skin.joints.size());
+    for (size_t i = 0; i < skin.joints.size(); ++i) {
+      jointMatrices[i] = invNodeTransform * globalTransforms[skin.joints[i]] * skin.inverseBindMatrices[i];
+    }
+    for (uint32_t id : node.instanceIds) {
+      scene->deformer->setJointMatrices(id, jointMatrices);
+    }
+  }
+
+  if (!weights[nodeIdx].empty()) {
+    for (uint32_t id : node.instanceIds) {
+      scene->deformer->setMorphWeights(id, weights[nodeIdx]);
+    }
+  }
+}
@@ -1,317 +1,556 @@
-#include "GLTFLoader.h"
-
-#include <filesystem>
-#include <iostream>
-#include <cstring>
-#include <vsg/maths/transform.h>
-#include <vsg/maths/quat.h>
-
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "tiny_gltf.h"
-
-#include "gltfUtils.h"
-
-GLTFLoader::GLTFLoader(vsg::ref_ptr<RayTracingScene> scene)
-  : scene(scene)
-{
-}
-
-bool GLTFLoader::loadFile(const std::string& path)
-{
-  tinygltf::TinyGLTF tinyGLTF;
-  tinygltf::Model model;
-
-  bool ret;
-  std::string error;
-  std::string warning;
-
-  auto ext = std::filesystem::path(path).extension();
-  if (ext == ".gltf") {
-    ret = tinyGLTF.LoadASCIIFromFile(&model, &error, &warning, path);
-  } else {  // Files with other extensions are treated as a GLB file
-    ret = tinyGLTF.LoadBinaryFromFile(&model, &error, &warning, path);
-  }
-
-  if (!ret) {
-    std::cerr << error << std::endl;
-    return false;
-  }
-
-  if (!warning.empty()) {
-    std::cerr << warning << std::endl;
-  }
-
-  return loadModel(model);
-}
-
-bool GLTFLoader::loadModel(const tinygltf::Model& model)
-{
-  bool ret = true;
-  for (auto& gltfScene : model.scenes) {
-    ret &= loadScene(gltfScene, model);
-  }
-  return ret;
-}
-
-bool GLTFLoader::loadScene(const tinygltf::Scene& gltfScene, const tinygltf::Model& model)
-{
-  bool ret = true;
-  for (auto& nodeIdx : gltfScene.nodes) {
-    ret &= loadNode(model.nodes[nodeIdx], model, vsg::mat4());
-  }
-  return ret;
-}
-
-bool GLTFLoader::loadNode(const tinygltf::Node& node, const tinygltf::Model& model, const vsg::mat4& parentTransform)
-{
-  bool ret = true;
-
-  // Transform matrix of a node
-  // No special handling is needed because both VSG and GLTF use column-major format for matrices.
-  vsg::mat4 transform;  // Default is identity matrix
-
-  if (!node.matrix.empty()) {
-    transform = vsg::dmat4(
-      node.matrix[0], node.matrix[1],node.matrix[2], node.matrix[3],
-      node.matrix[4], node.matrix[5],node.matrix[6], node.matrix[7],
-      node.matrix[8], node.matrix[9],node.matrix[10], node.matrix[11],
-      node.matrix[12], node.matrix[13],node.matrix[14], node.matrix[15]);
-  }
-
-  if (!node.translation.empty()) {
-    transform = transform * vsg::translate(float(node.translation[0]), float(node.translation[1]), float(node.translation[2]));
-  }
-  if (!node.rotation.empty()) {
-    vsg::quat quat(float(node.rotation[0]), float(node.rotation[1]), float(node.rotation[2]), float(node.rotation[3]));
-    transform = transform * vsg::rotate(quat);
-  }
-  if (!node.scale.empty()) {
-    transform = transform * vsg::scale(float(node.scale[0]), float(node.scale[1]), float(node.scale[2]));
-  }
-
-  if (node.mesh >= 0) {
-    ret &= loadMesh(model.meshes[node.mesh], model, parentTransform * transform);
-  }
-
-  for (auto& childIdx : node.children) {
-    ret &= loadNode(model.nodes[childIdx], model, parentTransform * transform);
-  }
-
-  return ret;
-}
-
-bool GLTFLoader::loadMesh(const tinygltf::Mesh& mesh, const tinygltf::Model& model, const vsg::mat4& transform)
-{
-  bool ret = true;
-  for (auto& primitive : mesh.primitives) {
-    ret &= loadPrimitive(primitive, model, transform);
-  }
-  return ret;
-}
-
-bool GLTFLoader::loadPrimitive(const tinygltf::Primitive& primitive, const tinygltf::Model& model, const vsg::mat4& transform)
-{
-  if (primitive.mode != TINYGLTF_MODE_TRIANGLES) {
-    std::cerr << "Only triangle meshes are supported" << std::endl;
-    return false;
-  }
-
-  auto indices = readGLTFBuffer<uint16_t>(primitive.indices, model);
-  auto vertices = readGLTFBuffer<vsg::vec3>(primitive.attributes.at("POSITION"), model);
-  auto normals = readGLTFBuffer<vsg::vec3>(primitive.attributes.at("NORMAL"), model);
-  auto texCoords = readGLTFBuffer<vsg::vec2>(primitive.attributes.at("TEXCOORD_0"), model);
-  vsg::ref_ptr<vsg::vec4Array> tangents;
-  if (primitive.attributes.find("TANGENT") != primitive.attributes.end()) { // Object contains tangent data
-    tangents = readGLTFBuffer<vsg::vec4>(primitive.attributes.at("TANGENT"), model);
-  } else {
-    tangents = vsg::vec4Array::create(vertices->valueCount());
-  }
-
-  std::optional<RayTracingMaterial> material = loadMaterial(model.materials[primitive.material], model);
-  if (!material) {
-    return false;
-  }
-
-  scene->addMesh(transform, indices, vertices, normals, texCoords, tangents, material.value());
-
-  return true;
-}
-
-std::optional<RayTracingMaterial> GLTFLoader::loadMaterial(const tinygltf::Material& gltfMaterial, const tinygltf::Model& model)
-{
-  const tinygltf::PbrMetallicRoughness& pbr = gltfMaterial.pbrMetallicRoughness;
-  
-  RayTracingMaterial material;
-
-  material.color.r = float(pbr.baseColorFactor[0]);
-  material.color.g = float(pbr.baseColorFactor[1]);
-  material.color.b = float(pbr.baseColorFactor[2]);
-
-  material.metallic = float(pbr.metallicFactor);
-  material.roughness = float(pbr.roughnessFactor);
-
-  material.emissive.r = float(gltfMaterial.emissiveFactor[0]);
-  material.emissive.g = float(gltfMaterial.emissiveFactor[1]);
-  material.emissive.b = float(gltfMaterial.emissiveFactor[2]);
-
-  material.alphaFactor = float(pbr.baseColorFactor[3]);
-  material.alphaCutoff = float(gltfMaterial.alphaCutoff);
-  if (gltfMaterial.alphaMode == "OPAQUE") {
-    material.alphaMode = AlphaMode::Opaque;
-  } else if (gltfMaterial.alphaMode == "MASK") {
-    material.alphaMode = AlphaMode::Mask;
-  } else {
-    material.alphaMode = AlphaMode::Opaque; // BLEND is not supported
-  }
-
-  if (pbr.baseColorTexture.index >= 0) {  // Has a base color texture
-    if (pbr.baseColorTexture.texCoord != 0) {
-      return std::nullopt;  // Only TEXCOORD_0 is supported
-    }
-
-    auto textureIdx = loadTextureCached(pbr.baseColorTexture.index, model);
-    if (!textureIdx) {
-      return std::nullopt;
-    }
-    material.colorTextureIdx = textureIdx.value();
-  } else {
-    material.colorTextureIdx = -1;
-  }
-
-  if (pbr.metallicRoughnessTexture.index >= 0) {  // Has a metallic/roughness texture
-    if (pbr.metallicRoughnessTexture.texCoord != 0) {
-      return std::nullopt;  // Only TEXCOORD_0 is supported
-    }
-
-    auto textureIdx = loadTextureCached(pbr.metallicRoughnessTexture.index, model);
-    if (!textureIdx) {
-      return std::nullopt;
-    }
-    material.metallicRoughnessTextureIdx = textureIdx.value();
-  } else {
-    material.metallicRoughnessTextureIdx = -1;
-  }
-
-  if (gltfMaterial.normalTexture.index >= 0) {  // Has a normal texture
-    if (gltfMaterial.normalTexture.texCoord != 0) {
-      return std::nullopt;  // Only TEXCOORD_0 is supported
-    }
-
-    auto textureIdx = loadTextureCached(gltfMaterial.normalTexture.index, model);
-    if (!textureIdx) {
-      return std::nullopt;
-    }
-    material.normalTextureIdx = textureIdx.value();
-
-    material.normalTextureScale = float(gltfMaterial.normalTexture.scale);
-  } else {
-    material.normalTextureIdx = -1;
-  }
-
-  if (gltfMaterial.emissiveTexture.index >= 0) {  // Has an emissive texture
-    if (gltfMaterial.emissiveTexture.texCoord != 0) {
-      return std::nullopt;  // Only TEXCOORD_0 is supported
-    }
-
-    auto textureIdx = loadTextureCached(gltfMaterial.emissiveTexture.index, model);
-    if (!textureIdx) {
-      return std::nullopt;
-    }
-    material.emissiveTextureIdx = textureIdx.value();
-  } else {
-    material.emissiveTextureIdx = -1;
-  }
-
-  return material;
-}
-
-std::optional<uint32_t> GLTFLoader::loadTexture(const tinygltf::Texture& gltfTexture, const tinygltf::Model& model)
-{
-  const tinygltf::Image& gltfImage = model.images[gltfTexture.source];
-  
-  vsg::ref_ptr<vsg::Data> imageData = readImageData(gltfImage.image, gltfImage.width, gltfImage.height, gltfImage.component, gltfImage.pixel_type);
-
-  auto sampler = vsg::Sampler::create();
-  // TODO: sampler setting
-
-  return scene->addTexture(imageData, sampler);
-}
-
-std::optional<uint32_t> GLTFLoader::loadTextureCached(int textureIdx, const tinygltf::Model& model)
-{
-  if (textureCache.find(textureIdx) != textureCache.end()) {  // Texture for this textureIdx was already created
-    return textureCache[textureIdx];
-  }
-
-  std::optional<uint32_t> idx = loadTexture(model.textures[textureIdx], model);
-  if (!idx) {
-    return std::nullopt;
-  }
-
-  textureCache[textureIdx] = idx.value(); // Cache
-
-  return idx;
-}
-
-vsg::ref_ptr<vsg::Data> GLTFLoader::readImageData(const std::vector<unsigned char>& data, int width, int height, int numComp, int compType)
-{
-  vsg::ref_ptr<vsg::Data> imageData;
-
-  // Image format have to be specified in the layout of a vsg::Data.
-  // It did not work when tried with format property of vsg::Image only.
-  //  See: https://github.com/vsg-dev/vsgXchange/blob/fb0f0754b72112edb821814f28d25a070790a89a/src/stbi/stbi.cpp#L134
-
-  if (numComp == 1) {
-    switch (compType) {
-    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-      imageData = vsg::ubyteArray2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8_UNORM });
-      break;
-    case TINYGLTF_COMPONENT_TYPE_FLOAT:
-      imageData = vsg::floatArray2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32_SFLOAT });
-      break;
-    default:
-      return {};  // Unsupported component type
-    }
-  } else if (numComp == 2) {
-    switch (compType) {
-    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-      imageData = vsg::ubvec2Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8G8_UNORM });
-      break;
-    case TINYGLTF_COMPONENT_TYPE_FLOAT:
-      imageData = vsg::vec2Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32_SFLOAT });
-      break;
-    default:
-      return {};  // Unsupported component type
-    }
-  } else if (numComp == 3) {
-    switch (compType) {
-    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-      imageData = vsg::ubvec3Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8G8B8_UNORM });
-      break;
-    case TINYGLTF_COMPONENT_TYPE_FLOAT:
-      imageData = vsg::vec3Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32B32_SFLOAT });
-      break;
-    default:
-      return {};  // Unsupported component type
-    }
-  } else if (numComp == 4) {
-    switch (compType) {
-    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-      imageData = vsg::ubvec4Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8G8B8A8_UNORM });
-      break;
-    case TINYGLTF_COMPONENT_TYPE_FLOAT:
-      imageData = vsg::vec4Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32B32A32_SFLOAT });
-      break;
-    default:
-      return {};  // Unsupported component type
-    }
-  } else {
-    return {};  // Unsupported number of components
-  }
-
-  std::memcpy(imageData->dataPointer(), data.data(), imageData->dataSize());
-
-  return imageData;
-}
+#include "GLTFLoader.h"
+
+#include <filesystem>
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+#include <vsg/maths/transform.h>
+#include <vsg/maths/quat.h>
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "tiny_gltf.h"
+
+#include "gltfUtils.h"
+#include "utils.h"
+
+GLTFLoader::GLTFLoader(vsg::ref_ptr<RayTracingScene> scene)
+  : scene(scene)
+{
+}
+
+bool GLTFLoader::loadFile(const std::string& path)
+{
+  tinygltf::TinyGLTF tinyGLTF;
+  tinygltf::Model model;
+
+  bool ret;
+  std::string error;
+  std::string warning;
+
+  auto ext = std::filesystem::path(path).extension();
+  if (ext == ".gltf") {
+    ret = tinyGLTF.LoadASCIIFromFile(&model, &error, &warning, path);
+  } else {  // Files with other extensions are treated as a GLB file
+    ret = tinyGLTF.LoadBinaryFromFile(&model, &error, &warning, path);
+  }
+
+  if (!ret) {
+    std::cerr << error << std::endl;
+    return false;
+  }
+
+  if (!warning.empty()) {
+    std::cerr << warning << std::endl;
+  }
+
+  if (!decodeMeshoptCompression(model)) {
+    return false;
+  }
+
+  return loadModel(model);
+}
+
+bool GLTFLoader::loadModel(const tinygltf::Model& model)
+{
+  bool ret = true;
+  for (auto& gltfScene : model.scenes) {
+    ret &= loadScene(gltfScene, model);
+  }
+
+  bool hasMorphTargets = std::any_of(model.meshes.begin(), model.meshes.end(), [](const tinygltf::Mesh& mesh) {
+    return std::any_of(mesh.primitives.begin(), mesh.primitives.end(), [](const tinygltf::Primitive& primitive) { return !primitive.targets.empty(); });
+  });
+  if (!model.animations.empty() || !model.skins.empty() || hasMorphTargets) {
+    ret &= loadAnimations(model);
+  }
+
+  return ret;
+}
+
+bool GLTFLoader::loadScene(const tinygltf::Scene& gltfScene, const tinygltf::Model& model)
+{
+  bool ret = true;
+  for (auto& nodeIdx : gltfScene.nodes) {
+    ret &= loadNode(nodeIdx, model, vsg::mat4());
+  }
+  return ret;
+}
+
+bool GLTFLoader::loadNode(int nodeIdx, const tinygltf::Model& model, const vsg::mat4& parentTransform)
+{
+  const tinygltf::Node& node = model.nodes[nodeIdx];
+
+  bool ret = true;
+
+  // Transform matrix of a node
+  // No special handling is needed because both VSG and GLTF use column-major format for matrices.
+  vsg::mat4 transform;  // Default is identity matrix
+
+  if (!node.matrix.empty()) {
+    transform = vsg::dmat4(
+      node.matrix[0], node.matrix[1],node.matrix[2], node.matrix[3],
+      node.matrix[4], node.matrix[5],node.matrix[6], node.matrix[7],
+      node.matrix[8], node.matrix[9],node.matrix[10], node.matrix[11],
+      node.matrix[12], node.matrix[13],node.matrix[14], node.matrix[15]);
+  }
+
+  if (!node.translation.empty()) {
+    transform = transform * vsg::translate(float(node.translation[0]), float(node.translation[1]), float(node.translation[2]));
+  }
+  if (!node.rotation.empty()) {
+    vsg::quat quat(float(node.rotation[0]), float(node.rotation[1]), float(node.rotation[2]), float(node.rotation[3]));
+    transform = transform * vsg::rotate(quat);
+  }
+  if (!node.scale.empty()) {
+    transform = transform * vsg::scale(float(node.scale[0]), float(node.scale[1]), float(node.scale[2]));
+  }
+
+  if (node.mesh >= 0) {
+    ret &= loadMesh(model.meshes[node.mesh], model, parentTransform * transform, node.skin >= 0, nodeInstances[nodeIdx]);
+  }
+
+  for (auto& childIdx : node.children) {
+    ret &= loadNode(childIdx, model, parentTransform * transform);
+  }
+
+  return ret;
+}
+
+bool GLTFLoader::loadMesh(const tinygltf::Mesh& mesh, const tinygltf::Model& model, const vsg::mat4& transform, bool skinned, std::vector<uint32_t>& instanceIds)
+{
+  bool ret = true;
+  std::vector<MeshPrimitive> staticPrimitives;
+  for (auto& primitive : mesh.primitives) {
+    ret &= loadPrimitive(primitive, model, transform, skinned, mesh.weights, staticPrimitives, instanceIds);
+  }
+  // One BLAS with a geometry per primitive, instead of overlapping instances in TLAS
+  if (!staticPrimitives.empty()) {
+    instanceIds.push_back(scene->addMesh(transform, staticPrimitives));
+  }
+  return ret;
+}
+
+bool GLTFLoader::loadPrimitive(const tinygltf::Primitive& primitive, const tinygltf::Model& model, const vsg::mat4& transform, bool skinned, const std::vector<double>& morphWeights, std::vector<MeshPrimitive>& staticPrimitives, std::vector<uint32_t>& instanceIds)
+{
+  if (primitive.mode != TINYGLTF_MODE_TRIANGLES) {
+    std::cerr << "Only triangle meshes are supported" << std::endl;
+    return false;
+  }
+
+  auto indices = readGLTFBuffer<uint16_t>(primitive.indices, model);
+  auto vertices = readGLTFBuffer<vsg::vec3>(primitive.attributes.at("POSITION"), model);
+  auto normals = readGLTFBuffer<vsg::vec3>(primitive.attributes.at("NORMAL"), model);
+  auto texCoords = readGLTFBuffer<vsg::vec2>(primitive.attributes.at("TEXCOORD_0"), model);
+  vsg::ref_ptr<vsg::vec4Array> tangents;
+  if (primitive.attributes.find("TANGENT") != primitive.attributes.end()) { // Object contains tangent data
+    tangents = readGLTFBuffer<vsg::vec4>(primitive.attributes.at("TANGENT"), model);
+  } else {
+    tangents = vsg::vec4Array::create(vertices->valueCount());
+  }
+
+  std::optional<uint32_t> materialId = loadMaterialCached(primitive.material, model);
+  if (!materialId) {
+    return false;
+  }
+
+  std::optional<MeshDeformation> deformation = loadDeformation(primitive, model, skinned, morphWeights, vertices->valueCount());
+  if (deformation) {
+    instanceIds.push_back(scene->addDeformableMesh(transform, indices, vertices, normals, texCoords, tangents, materialId.value(), deformation.value()));
+    return true;
+  }
+
+  if (meshOptimizer) {
+    MeshData mesh{ indices, vertices, normals, texCoords, tangents };
+    meshOptimizer->optimize(mesh);
+    staticPrimitives.push_back({ mesh.indices, mesh.vertices, mesh.normals, mesh.texCoords, mesh.tangents, materialId.value() });
+    return true;
+  }
+
+  staticPrimitives.push_back({ indices, vertices, normals, texCoords, tangents, materialId.value() });
+  return true;
+}
+
+std::optional<MeshDeformation> GLTFLoader::loadDeformation(const tinygltf::Primitive& primitive, const tinygltf::Model& model, bool skinned, const std::vector<double>& morphWeights, size_t numVertices)
+{
+  MeshDeformation deformation;
+
+  bool hasSkin = skinned
+    && primitive.attributes.find("JOINTS_0") != primitive.attributes.end()
+    && primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end();
+  if (!hasSkin && primitive.targets.empty()) {
+    return std::nullopt;
+  }
+
+  if (hasSkin) {
+    deformation.joints = readGLTFBuffer<vsg::uivec4>(primitive.attributes.at("JOINTS_0"), model);
+    deformation.weights = readGLTFBuffer<vsg::vec4>(primitive.attributes.at("WEIGHTS_0"), model);
+    if (deformation.joints && deformation.weights
+        && deformation.joints->valueCount() == numVertices && deformation.weights->valueCount() == numVertices) {
+      // Weights may be stored as unnormalized integers. Normalizing the sum also handles it
+      for (auto& weight : *deformation.weights) {
+        float sum = weight.x + weight.y + weight.z + weight.w;
+        if (sum > 0.0f) {
+          weight = weight / sum;
+        }
+      }
+      // Number of joint matrices needed by this mesh
+      for (auto& joint : *deformation.joints) {
+        deformation.numJoints = std::max({ deformation.numJoints, joint.x + 1, joint.y + 1, joint.z + 1, joint.w + 1 });
+      }
+    } else {
+      std::cerr << "Unsupported skin attributes" << std::endl;
+      deformation.joints = {};
+      deformation.weights = {};
+    }
+  }
+
+  for (size_t i = 0; i < primitive.targets.size(); ++i) {
+    auto& target = primitive.targets[i];
+    auto readTarget = [&](const std::string& name) {
+      auto it = target.find(name);
+      auto displacements = (it != target.end()) ? readGLTFBuffer<vsg::vec3>(it->second, model) : vsg::ref_ptr<vsg::vec3Array>();
+      return (displacements && displacements->valueCount() == numVertices) ? displacements : vsg::ref_ptr<vsg::vec3Array>();
+    };
+    deformation.morphVertices.push_back(readTarget("POSITION"));
+    deformation.morphNormals.push_back(readTarget("NORMAL"));
+    deformation.morphTangents.push_back(readTarget("TANGENT"));
+    deformation.morphWeights.push_back((i < morphWeights.size()) ? float(morphWeights[i]) : 0.0f);
+  }
+
+  return deformation;
+}
+
+bool GLTFLoader::loadAnimations(const tinygltf::Model& model)
+{
+  animation = GLTFAnimation::create(scene);
+
+  // Static transform and hierarchy of nodes
+  animation->nodes.resize(model.nodes.size());
+  for (size_t i = 0; i < model.nodes.size(); ++i) {
+    const tinygltf::Node& gltfNode = model.nodes[i];
+    GLTFAnimation::Node& node = animation->nodes[i];
+
+    if (!gltfNode.matrix.empty()) {
+      node.matrix = vsg::dmat4(
+        gltfNode.matrix[0], gltfNode.matrix[1], gltfNode.matrix[2], gltfNode.matrix[3],
+        gltfNode.matrix[4], gltfNode.matrix[5], gltfNode.matrix[6], gltfNode.matrix[7],
+        gltfNode.matrix[8], gltfNode.matrix[9], gltfNode.matrix[10], gltfNode.matrix[11],
+        gltfNode.matrix[12], gltfNode.matrix[13], gltfNode.matrix[14], gltfNode.matrix[15]);
+    }
+    if (!gltfNode.translation.empty()) {
+      node.translation = vsg::vec3(float(gltfNode.translation[0]), float(gltfNode.translation[1]), float(gltfNode.translation[2]));
+    }
+    if (!gltfNode.rotation.empty()) {
+      node.rotation = vsg::quat(float(gltfNode.rotation[0]), float(gltfNode.rotation[1]), float(gltfNode.rotation[2]), float(gltfNode.rotation[3]));
+    }
+    if (!gltfNode.scale.empty()) {
+      node.scale = vsg::vec3(float(gltfNode.scale[0]), float(gltfNode.scale[1]), float(gltfNode.scale[2]));
+    }
+
+    node.children = gltfNode.children;
+    node.skin = gltfNode.skin;
+
+    // Morph target weights of a node override those of its mesh
+    const std::vector<double>& weights = (!gltfNode.weights.empty() || gltfNode.mesh < 0) ? gltfNode.weights : model.meshes[gltfNode.mesh].weights;
+    node.weights.assign(weights.begin(), weights.end());
+
+    if (nodeInstances.find(int(i)) != nodeInstances.end()) {
+      node.instanceIds = nodeInstances[int(i)];
+    }
+  }
+
+  for (auto& gltfScene : model.scenes) {
+    animation->rootNodes.insert(animation->rootNodes.end(), gltfScene.nodes.begin(), gltfScene.nodes.end());
+  }
+
+  for (auto& gltfSkin : model.skins) {
+    GLTFAnimation::Skin skin;
+    skin.joints = gltfSkin.joints;
+    skin.inverseBindMatrices.resize(gltfSkin.joints.size()); // Default is identity
+    if (gltfSkin.inverseBindMatrices >= 0) {
+      auto matrices = readGLTFBufferAsFloats(gltfSkin.inverseBindMatrices, model);
+      if (!matrices || matrices->valueCount() < 16 * skin.joints.size()) {
+        std::cerr << "Invalid inverse bind matrices" << std::endl;
+        return false;
+      }
+      for (size_t i = 0; i < skin.joints.size(); ++i) {
+        const float* m = matrices->data() + 16 * i;
+        // Same order as node matrix (see loadNode)
+        skin.inverseBindMatrices[i] = vsg::mat4(
+          m[0], m[1], m[2], m[3],
+          m[4], m[5], m[6], m[7],
+          m[8], m[9], m[10], m[11],
+          m[12], m[13], m[14], m[15]);
+      }
+    }
+    animation->skins.push_back(skin);
+  }
+
+  // All animations are played simultaneously
+  for (auto& gltfAnimation : model.animations) {
+    for (auto& gltfChannel : gltfAnimation.channels) {
+      const tinygltf::AnimationSampler& sampler = gltfAnimation.samplers[gltfChannel.sampler];
+
+      GLTFAnimation::Channel channel;
+      channel.node = gltfChannel.target_node;
+
+      if (gltfChannel.target_path == "translation") {
+        channel.path = GLTFAnimation::Path::TRANSLATION;
+      } else if (gltfChannel.target_path == "rotation") {
+        channel.path = GLTFAnimation::Path::ROTATION;
+      } else if (gltfChannel.target_path == "scale") {
+        channel.path = GLTFAnimation::Path::SCALE;
+      } else if (gltfChannel.target_path == "weights") {
+        channel.path = GLTFAnimation::Path::WEIGHTS;
+      } else {
+        continue;
+      }
+
+      if (sampler.interpolation == "STEP") {
+        channel.interpolation = GLTFAnimation::Interpolation::STEP;
+      } else if (sampler.interpolation == "CUBICSPLINE") {
+        channel.interpolation = GLTFAnimation::Interpolation::CUBICSPLINE;
+      } else {
+        channel.interpolation = GLTFAnimation::Interpolation::LINEAR;
+      }
+
+      channel.times = readGLTFBuffer<float>(sampler.input, model);
+      channel.values = readGLTFBufferAsFloats(sampler.output, model);
+
+      if (!channel.times || !channel.values || channel.times->valueCount() == 0) {
+        std::cerr << "Unsupported animation sampler" << std::endl;
+        return false;
+      }
+
+      // Weights have as many components as morph targets
+      size_t numValues = channel.times->valueCount() * ((channel.interpolation == GLTFAnimation::Interpolation::CUBICSPLINE) ? 3 : 1);
+      channel.numComponents = uint32_t(channel.values->valueCount() / numValues);
+
+      if (channel.times->valueCount() > 0) {
+        animation->duration = std::max(animation->duration, double(channel.times->at(channel.times->valueCount() - 1)));
+      }
+
+      animation->channels.push_back(channel);
+    }
+  }
+
+  // Instances have to be movable after compile
+  scene->tlas->allowUpdate = true;
+
+  return true;
+}
+
+std::optional<RayTracingMaterial> GLTFLoader::loadMaterial(const tinygltf::Material& gltfMaterial, const tinygltf::Model& model)
+{
+  const tinygltf::PbrMetallicRoughness& pbr = gltfMaterial.pbrMetallicRoughness;
+  
+  RayTracingMaterial material;
+
+  material.color.r = float(pbr.baseColorFactor[0]);
+  material.color.g = float(pbr.baseColorFactor[1]);
+  material.color.b = float(pbr.baseColorFactor[2]);
+
+  material.metallic = float(pbr.metallicFactor);
+  material.roughness = float(pbr.roughnessFactor);
+
+  material.emissive.r = float(gltfMaterial.emissiveFactor[0]);
+  material.emissive.g = float(gltfMaterial.emissiveFactor[1]);
+  material.emissive.b = float(gltfMaterial.emissiveFactor[2]);
+
+  material.alphaFactor = float(pbr.baseColorFactor[3]);
+  material.alphaCutoff = float(gltfMaterial.alphaCutoff);
+  if (gltfMaterial.alphaMode == "OPAQUE") {
+    material.alphaMode = AlphaMode::Opaque;
+  } else if (gltfMaterial.alphaMode == "MASK") {
+    material.alphaMode = AlphaMode::Mask;
+  } else {
+    material.alphaMode = AlphaMode::Opaque; // BLEND is not supported
+  }
+
+  if (pbr.baseColorTexture.index >= 0) {  // Has a base color texture
+    if (pbr.baseColorTexture.texCoord != 0) {
+      return std::nullopt;  // Only TEXCOORD_0 is supported
+    }
+
+    auto textureIdx = loadTextureCached(pbr.baseColorTexture.index, model);
+    if (!textureIdx) {
+      return std::nullopt;
+    }
+    material.colorTextureIdx = textureIdx.value();
+  } else {
+    material.colorTextureIdx = -1;
+  }
+
+  if (pbr.metallicRoughnessTexture.index >= 0) {  // Has a metallic/roughness texture
+    if (pbr.metallicRoughnessTexture.texCoord != 0) {
+      return std::nullopt;  // Only TEXCOORD_0 is supported
+    }
+
+    auto textureIdx = loadTextureCached(pbr.metallicRoughnessTexture.index, model);
+    if (!textureIdx) {
+      return std::nullopt;
+    }
+    material.metallicRoughnessTextureIdx = textureIdx.value();
+  } else {
+    material.metallicRoughnessTextureIdx = -1;
+  }
+
+  if (gltfMaterial.normalTexture.index >= 0) {  // Has a normal texture
+    if (gltfMaterial.normalTexture.texCoord != 0) {
+      return std::nullopt;  // Only TEXCOORD_0 is supported
+    }
+
+    auto textureIdx = loadTextureCached(gltfMaterial.normalTexture.index, model);
+    if (!textureIdx) {
+      return std::nullopt;
+    }
+    material.normalTextureIdx = textureIdx.value();
+
+    material.normalTextureScale = float(gltfMaterial.normalTexture.scale);
+  } else {
+    material.normalTextureIdx = -1;
+  }
+
+  if (gltfMaterial.emissiveTexture.index >= 0) {  // Has an emissive texture
+    if (gltfMaterial.emissiveTexture.texCoord != 0) {
+      return std::nullopt;  // Only TEXCOORD_0 is supported
+    }
+
+    auto textureIdx = loadTextureCached(gltfMaterial.emissiveTexture.index, model);
+    if (!textureIdx) {
+      return std::nullopt;
+    }
+    material.emissiveTextureIdx = textureIdx.value();
+  } else {
+    material.emissiveTextureIdx = -1;
+  }
+
+  return material;
+}
+
+std::optional<uint32_t> GLTFLoader::loadTexture(const tinygltf::Texture& gltfTexture, const tinygltf::Model& model)
+{
+  const tinygltf::Image& gltfImage = model.images[gltfTexture.source];
+
+  vsg::ref_ptr<vsg::Data> imageData = readImageData(gltfImage.image, gltfImage.width, gltfImage.height, gltfImage.component, gltfImage.pixel_type);
+  if (!imageData) {
+    return std::nullopt;  // Unsupported image format
+  }
+
+  // Identical images referenced by several textures or files are uploaded once. Images are hashed as decoded by tinygltf,
+  // and textures with the same hash are compared with imageData by the scene
+  uint64_t contentKey = hashBytes(gltfImage.image.data(), gltfImage.image.size());
+  int imageFormat[] = { gltfImage.width, gltfImage.height, gltfImage.component, gltfImage.pixel_type };
+  contentKey = hashBytes(imageFormat, sizeof(imageFormat), contentKey);
+  std::vector<int> samplerState;
+  if (gltfTexture.sampler >= 0) {
+    const tinygltf::Sampler& gltfSampler = model.samplers[gltfTexture.sampler];
+    samplerState = { gltfSampler.minFilter, gltfSampler.magFilter, gltfSampler.wrapS, gltfSampler.wrapT };
+    contentKey = hashBytes(samplerState.data(), samplerState.size() * sizeof(int), contentKey);
+  }
+  if (auto cached = scene->findTexture(contentKey, *imageData, samplerState)) {
+    return cached;
+  }
+
+  auto sampler = vsg::Sampler::create();
+  // TODO: sampler setting
+
+  return scene->addTexture(contentKey, imageData, sampler, samplerState);
+}
+
+std::optional<uint32_t> GLTFLoader::loadMaterialCached(int materialIdx, const tinygltf::Model& model)
+{
+  if (materialCache.find(materialIdx) != materialCache.end()) {  // Material for this materialIdx was already added
+    return materialCache[materialIdx];
+  }
+
+  // Default values of tinygltf::Material are the ones defined by glTF
+  std::optional<RayTracingMaterial> material = loadMaterial((materialIdx >= 0) ? model.materials[materialIdx] : tinygltf::Material(), model);
+  if (!material) {
+    return std::nullopt;
+  }
+
+  uint32_t id = scene->addMaterial(material.value());
+  materialCache[materialIdx] = id; // Cache
+
+  return id;
+}
+
+std::optional<uint32_t> GLTFLoader::loadTextureCached(int textureIdx, const tinygltf::Model& model)
+{
+  if (textureCache.find(textureIdx) != textureCache.end()) {  // Texture for this textureIdx was already created
+    return textureCache[textureIdx];
+  }
+
+  std::optional<uint32_t> idx = loadTexture(model.textures[textureIdx], model);
+  if (!idx) {
+    return std::nullopt;
+  }
+
+  textureCache[textureIdx] = idx.value(); // Cache
+
+  return idx;
+}
+
+vsg::ref_ptr<vsg::Data> GLTFLoader::readImageData(const std::vector<unsigned char>& data, int width, int height, int numComp, int compType)
+{
+  vsg::ref_ptr<vsg::Data> imageData;
+
+  // Image format have to be specified in the layout of a vsg::Data.
+  // It did not work when tried with format property of vsg::Image only.
+  //  See: https://github.com/vsg-dev/vsgXchange/blob/fb0f0754b72112edb821814f28d25a070790a89a/src/stbi/stbi.cpp#L134
+
+  if (numComp == 1) {
+    switch (compType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      imageData = vsg::ubyteArray2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8_UNORM });
+      break;
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      imageData = vsg::floatArray2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32_SFLOAT });
+      break;
+    default:
+      return {};  // Unsupported component type
+    }
+  } else if (numComp == 2) {
+    switch (compType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      imageData = vsg::ubvec2Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8G8_UNORM });
+      break;
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      imageData = vsg::vec2Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32_SFLOAT });
+      break;
+    default:
+      return {};  // Unsupported component type
+    }
+  } else if (numComp == 3) {
+    switch (compType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      imageData = vsg::ubvec3Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8G8B8_UNORM });
+      break;
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      imageData = vsg::vec3Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32B32_SFLOAT });
+      break;
+    default:
+      return {};  // Unsupported component type
+    }
+  } else if (numComp == 4) {
+    switch (compType) {
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+      imageData = vsg::ubvec4Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R8G8B8A8_UNORM });
+      break;
+    case TINYGLTF_COMPONENT_TYPE_FLOAT:
+      imageData = vsg::vec4Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32B32A32_SFLOAT });
+      break;
+    default:
+      return {};  // Unsupported component type
+    }
+  } else {
+    return {};  // Unsupported number of components
+  }
+
+  std::memcpy(imageData->dataPointer(), data.data(), imageData->dataSize());
+
+  return imageData;
+}
@@ -0,0 +1,102 @@
+#include "GPUTimer.h"
+
+#include <cstdint>
+#include <vsg/vk/CommandBuffer.h>
+
+// Resets the query pool and writes the start timestamp
+class StartTimerCommand : public vsg::Inherit<vsg::Command, StartTimerCommand>
+{
+public:
+  StartTimerCommand(GPUTimer* timer) : timer(timer) {}
+
+  void record(vsg::CommandBuffer& commandBuffer) const override
+  {
+    // Queries have to be reset before writing timestamps every frame
+    vkCmdResetQueryPool(commandBuffer, timer->queryPool(), timer->recordingQuery(), 2);
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timer->queryPool(), timer->recordingQuery());
+  }
+
+  GPUTimer* timer;
+};
+
+// Writes the stop timestamp after all preceding commands have finished
+class StopTimerCommand : public vsg::Inherit<vsg::Command, StopTimerCommand>
+{
+public:
+  StopTimerCommand(GPUTimer* timer) : timer(timer) {}
+
+  void record(vsg::CommandBuffer& commandBuffer) const override
+  {
+    vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timer->queryPool(), timer->recordingQuery() + 1);
+  }
+
+  GPUTimer* timer;
+};
+
+GPUTimer::GPUTimer(vsg::Device* device, uint32_t numFramesInFlight)
+  : device(device), numFramesInFlight(numFramesInFlight), numSlots(numFramesInFlight + 1), slotSamplesPerPixel(numSlots, 0)
+{
+  // The frame being read and the frames in flight use different slots
+  VkQueryPoolCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  createInfo.queryCount = 2 * numSlots;  // Start and stop of each slot
+  vkCreateQueryPool(*device, &createInfo, nullptr, &pool);
+
+  // Length of one tick of timestamp counter
+  // See: https://www.khronos.org/registry/vulkan/specs/1.2-extensions/html/vkspec.html#queries-timestamps
+  auto physicalDevice = device->getPhysicalDevice();
+  timestampPeriod = double(physicalDevice->getProperties().limits.timestampPeriod);
+
+  // Bits above timestampValidBits are undefined (same queue family as the command graph of the window)
+  int queueFamily = physicalDevice->getQueueFamily(VK_QUEUE_GRAPHICS_BIT);
+  uint32_t validBits = (queueFamily >= 0) ? physicalDevice->getQueueFamilyProperties()[queueFamily].timestampValidBits : 64;
+  timestampMask = (validBits >= 64) ? ~uint64_t(0) : ((uint64_t(1) << validBits) - 1);
+}
+
+GPUTimer::~GPUTimer()
+{
+  if (pool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(*device, pool, nullptr);
+  }
+}
+
+vsg::ref_ptr<vsg::Command> GPUTimer::createStartCommand()
+{
+  return StartTimerCommand::create(this);
+}
+
+vsg::ref_ptr<vsg::Command> GPUTimer::createStopCommand()
+{
+  return StopTimerCommand::create(this);
+}
+
+void GPUTimer::advanceFrame(uint32_t samplesPerPixel)
+{
+  ++numFrames;
+  slotSamplesPerPixel[(numFrames - 1) % numSlots] = samplesPerPixel;
+}
+
+std::optional<FrameTiming> GPUTimer::getFrameTiming()
+{
+  if (numFrames <= numFramesInFlight || numFrames - numFramesInFlight <= numReadFrames) {
+    return std::nullopt;  // The frame is not recorded yet, or its result was already returned
+  }
+
+  // The fence of this frame was waited before its command buffer was reused, so waiting does not stall
+  uint64_t frame = numFrames - 1 - numFramesInFlight;
+  uint32_t slot = uint32_t(frame % numSlots);
+  uint32_t firstQuery = 2 * slot;
+  uint64_t results[2] = {};
+  VkResult result = vkGetQueryPoolResults(
+    *device, pool, firstQuery, 2, sizeof(results), results, sizeof(uint64_t),
+    VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+  if (result != VK_SUCCESS) {
+    return std::nullopt;
+  }
+  numReadFrames = frame + 1;
+
+  // Masking also handles wrap-around of the counter between the timestamps
+  double milliseconds = double((results[1] - results[0]) & timestampMask) * timestampPeriod / 1e6;
+  return FrameTiming{ milliseconds, slotSamplesPerPixel[slot] };
+}
@@ -0,0 +1,389 @@
+#include "MeshDeformer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vsg/all.h>
+#include "RayTracingScene.h"
+#include "utils.h"
+
+const uint32_t DEFORM_WORKGROUP_SIZE = 64; // This must agree with local_size_x in shader deform.comp
+const VkDeviceSize SCRATCH_ALIGNMENT = 256; // Conservative value of minAccelerationStructureScratchOffsetAlignment
+const VkDeviceSize MAX_UPDATE_SIZE = 65536; // Limit of vkCmdUpdateBuffer
+
+// Runs the compute shader and refits BLASes only in frames where joint matrices or morph weights were changed
+class DeformMeshes : public vsg::Inherit<vsg::Command, DeformMeshes>
+{
+public:
+  DeformMeshes(MeshDeformer* deformer, RayTracingScene* scene, vsg::ref_ptr<vsg::Commands> computeCommands)
+    : deformer(deformer), scene(scene), computeCommands(computeCommands) {}
+
+  void compile(vsg::Context& context) override
+  {
+    computeCommands->compile(context);
+  }
+
+  void record(vsg::CommandBuffer& commandBuffer) const override
+  {
+    if (!deformer->deformationRequired) {
+      return;
+    }
+
+    // The previous frame may still read deformed attributes in shaders and refit BLASes from deformed positions
+    VkMemoryBarrier readBarrier{};
+    readBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    readBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+    vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+      0, 1, &readBarrier, 0, nullptr, 0, nullptr);
+
+    deformer->recordUpload(commandBuffer);
+    computeCommands->record(commandBuffer);
+
+    // Deformed attributes are read by BLAS build and closest-hit shader
+    VkMemoryBarrier computeBarrier{};
+    computeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    computeBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    computeBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+    vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+      0, 1, &computeBarrier, 0, nullptr, 0, nullptr);
+
+    deformer->recordBLASRefit(commandBuffer);
+
+    // Bounds of the instances were changed, therefore TLAS also has to be updated
+    scene->transformsModified = true;
+    deformer->deformationRequired = false;
+  }
+
+  MeshDeformer* deformer;
+  RayTracingScene* scene;
+  vsg::ref_ptr<vsg::Commands> computeCommands;
+};
+
+MeshDeformer::MeshDeformer(vsg::Device* device)
+  : device(device)
+{
+}
+
+void MeshDeformer::addMesh(uint32_t instanceId, vsg::ref_ptr<DynamicBottomLevelAccelerationStructure> blas, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec4Array> tangents, const MeshDeformation& deformation)
+{
+  uint32_t numVertices = uint32_t(vertices->valueCount());
+  uint32_t numMorphTargets = uint32_t(deformation.morphWeights.size());
+
+  DeformInfo info{};
+  info.numVertices = numVertices;
+  info.sourceOffset = numSourceVertices;
+  info.jointMatrixOffset = uint32_t(jointMatrices.size());
+  info.numJoints = deformation.joints ? deformation.numJoints : 0;
+  info.morphWeightOffset = uint32_t(morphWeights.size());
+  info.numMorphTargets = numMorphTargets;
+  info.morphOffset = 0;
+  for (auto& arr : morphVerticesList) {
+    info.morphOffset += uint32_t(arr->valueCount());
+  }
+
+  instanceToDeformInfo[instanceId] = deformInfoList.size();
+  deformInfoList.push_back(info);
+  instanceIdList.push_back(instanceId);
+  blasList.push_back(blas);
+
+  // Refitting requires the flag at the first build
+  blas->allowUpdate = true;
+
+  // Bind pose
+  indicesList.push_back(indices);
+  verticesList.push_back(vertices);
+  normalsList.push_back(normals);
+  tangentsList.push_back(tangents);
+
+  // Skinning (dummy data is used for meshes without skin to keep offsets consistent)
+  jointsList.push_back(deformation.joints ? deformation.joints : vsg::uivec4Array::create(numVertices));
+  weightsList.push_back(deformation.weights ? deformation.weights : vsg::vec4Array::create(numVertices));
+  jointMatrices.resize(jointMatrices.size() + info.numJoints, vsg::mat4());
+
+  // Morph targets. Missing attributes are treated as zero displacement
+  auto zeros = vsg::vec3Array::create(numVertices, vsg::vec3(0.0f, 0.0f, 0.0f));
+  for (uint32_t i = 0; i < numMorphTargets; ++i) {
+    auto targetVertices = (i < deformation.morphVertices.size()) ? deformation.morphVertices[i] : vsg::ref_ptr<vsg::vec3Array>();
+    auto targetNormals = (i < deformation.morphNormals.size()) ? deformation.morphNormals[i] : vsg::ref_ptr<vsg::vec3Array>();
+    auto targetTangents = (i < deformation.morphTangents.size()) ? deformation.morphTangents[i] : vsg::ref_ptr<vsg::vec3Array>();
+    morphVerticesList.push_back(targetVertices ? targetVertices : zeros);
+    morphNormalsList.push_back(targetNormals ? targetNormals : zeros);
+    morphTangentsList.push_back(targetTangents ? targetTangents : zeros);
+  }
+  morphWeights.insert(morphWeights.end(), deformation.morphWeights.begin(), deformation.morphWeights.end());
+
+  numSourceVertices += numVertices;
+  maxNumVertices = std::max(maxNumVertices, numVertices);
+
+  modified = true;
+}
+
+void MeshDeformer::setJointMatrices(uint32_t instanceId, const std::vector<vsg::mat4>& matrices)
+{
+  auto it = instanceToDeformInfo.find(instanceId);
+  if (it == instanceToDeformInfo.end()) {
+    return;
+  }
+
+  const DeformInfo& info = deformInfoList[it->second];
+  size_t count = std::min(size_t(info.numJoints), matrices.size());
+  auto target = jointMatrices.begin() + info.jointMatrixOffset;
+  // Skip unchanged poses so a paused or finished animation does not deform and refit every frame
+  auto sameMatrix = [](const vsg::mat4& a, const vsg::mat4& b) { return std::equal(a.data(), a.data() + 16, b.data()); };
+  if (std::equal(matrices.begin(), matrices.begin() + count, target, sameMatrix)) {
+    return;
+  }
+  std::copy(matrices.begin(), matrices.begin() + count, target);
+  modified = true;
+}
+
+void MeshDeformer::setMorphWeights(uint32_t instanceId, const std::vector<float>& weights)
+{
+  auto it = instanceToDeformInfo.find(instanceId);
+  if (it == instanceToDeformInfo.end()) {
+    return;
+  }
+
+  const DeformInfo& info = deformInfoList[it->second];
+  size_t count = std::min(size_t(info.numMorphTargets), weights.size());
+  auto target = morphWeights.begin() + info.morphWeightOffset;
+  if (std::equal(weights.begin(), weights.begin() + count, target)) {
+    return;
+  }
+  std::copy(weights.begin(), weights.begin() + count, target);
+  modified = true;
+}
+
+void MeshDeformer::update()
+{
+  if (!modified || !jointMatricesBuffer) {
+    return;
+  }
+
+  // Values are uploaded when the deformation is recorded
+  modified = false;
+  deformationRequired = true;
+}
+
+vsg::ref_ptr<vsg::Command> MeshDeformer::createCommands(RayTracingScene* scene)
+{
+  auto computeShader = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/deform.spv");
+  if (!computeShader) {
+    std::cerr << "Cannot load shaders" << std::endl;
+  }
+
+  // Storage buffers must not be empty
+  auto nonEmptyVec3 = [](vsg::ref_ptr<vsg::vec3Array> arr) { return (arr->valueCount() > 0) ? arr : vsg::vec3Array::create(1); };
+
+  // Deformed attributes are written into the geometry buffer of each mesh
+  auto objectInfo = scene->getObjectInfo();
+  for (size_t i = 0; i < deformInfoList.size(); ++i) {
+    const ObjectInfo& meshInfo = objectInfo->at(scene->tlas->geometryInstances[instanceIdList[i]]->id);
+    deformInfoList[i].vertices = meshInfo.vertices;
+    deformInfoList[i].normals = meshInfo.normals;
+    deformInfoList[i].tangents = meshInfo.tangents;
+  }
+
+  auto deformInfos = vsg::Array<DeformInfo>::create(uint32_t(deformInfoList.size()));
+  std::copy(deformInfoList.begin(), deformInfoList.end(), deformInfos->begin());
+
+  // Joint matrices and morph weights are written by vkCmdUpdateBuffer, so that frames in flight keep reading their own values
+  VkDeviceSize jointMatricesSize = VkDeviceSize(std::max<size_t>(jointMatrices.size(), 1)) * sizeof(vsg::mat4);
+  jointMatricesBuffer = vsg::createBufferAndMemory(
+    device, jointMatricesSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VkDeviceSize morphWeightsSize = VkDeviceSize(std::max<size_t>(morphWeights.size(), 1)) * sizeof(float);
+  morphWeightsBuffer = vsg::createBufferAndMemory(
+    device, morphWeightsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  // Deformed vertex positions are written into a buffer which is also used as an input of BLAS refit
+  VkDeviceSize blasVertexBufferSize = VkDeviceSize(numSourceVertices) * sizeof(vsg::vec3);
+  blasVertexBuffer = vsg::createBufferAndMemory(
+    device, blasVertexBufferSize,
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  // Indices never change
+  blasIndexBuffer = createHostVisibleBuffer(
+    device, concatArray(indicesList),
+    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR);
+
+  vsg::DescriptorSetLayoutBindings descriptorBindings;
+  for (auto binding : { DeformBindings::DEFORM_INFOS, DeformBindings::SOURCE_VERTICES, DeformBindings::SOURCE_NORMALS, DeformBindings::SOURCE_TANGENTS,
+                        DeformBindings::JOINTS, DeformBindings::WEIGHTS, DeformBindings::MORPH_VERTICES, DeformBindings::MORPH_NORMALS, DeformBindings::MORPH_TANGENTS,
+                        DeformBindings::JOINT_MATRICES, DeformBindings::MORPH_WEIGHTS, DeformBindings::BLAS_VERTICES }) {
+    descriptorBindings.push_back({ static_cast<uint32_t>(binding), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr });
+  }
+  auto descriptorLayout = vsg::DescriptorSetLayout::create(descriptorBindings);
+
+  auto storageDescriptor = [](vsg::ref_ptr<vsg::Data> data, DeformBindings binding) {
+    return vsg::DescriptorBuffer::create(data, static_cast<uint32_t>(binding), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  };
+  auto jointMatricesDescriptor = vsg::DescriptorBuffer::create(
+    vsg::BufferInfoList{ vsg::BufferInfo(jointMatricesBuffer, 0, jointMatricesSize) },
+    static_cast<uint32_t>(DeformBindings::JOINT_MATRICES), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  auto morphWeightsDescriptor = vsg::DescriptorBuffer::create(
+    vsg::BufferInfoList{ vsg::BufferInfo(morphWeightsBuffer, 0, morphWeightsSize) },
+    static_cast<uint32_t>(DeformBindings::MORPH_WEIGHTS), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  auto blasVerticesDescriptor = vsg::DescriptorBuffer::create(
+    vsg::BufferInfoList{ vsg::BufferInfo(blasVertexBuffer, 0, blasVertexBufferSize) },
+    static_cast<uint32_t>(DeformBindings::BLAS_VERTICES), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+  vsg::Descriptors descriptors = {
+    storageDescriptor(deformInfos, DeformBindings::DEFORM_INFOS),
+    storageDescriptor(concatArray(verticesList), DeformBindings::SOURCE_VERTICES),
+    storageDescriptor(concatArray(normalsList), DeformBindings::SOURCE_NORMALS),
+    storageDescriptor(concatArray(tangentsList), DeformBindings::SOURCE_TANGENTS),
+    storageDescriptor(concatArray(jointsList), DeformBindings::JOINTS),
+    storageDescriptor(concatArray(weightsList), DeformBindings::WEIGHTS),
+    storageDescriptor(nonEmptyVec3(concatArray(morphVerticesList)), DeformBindings::MORPH_VERTICES),
+    storageDescriptor(nonEmptyVec3(concatArray(morphNormalsList)), DeformBindings::MORPH_NORMALS),
+    storageDescriptor(nonEmptyVec3(concatArray(morphTangentsList)), DeformBindings::MORPH_TANGENTS),
+    jointMatricesDescriptor,
+    morphWeightsDescriptor,
+    blasVerticesDescriptor
+  };
+  auto descriptorSet = vsg::DescriptorSet::create(descriptorLayout, descriptors);
+
+  auto pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{ descriptorLayout }, vsg::PushConstantRanges{});
+  auto pipeline = vsg::ComputePipeline::create(pipelineLayout, computeShader);
+
+  // One row of workgroups per mesh
+  auto computeCommands = vsg::Commands::create();
+  computeCommands->addChild(vsg::BindComputePipeline::create(pipeline));
+  computeCommands->addChild(vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, descriptorSet));
+  computeCommands->addChild(vsg::Dispatch::create((maxNumVertices + DEFORM_WORKGROUP_SIZE - 1) / DEFORM_WORKGROUP_SIZE, uint32_t(deformInfoList.size()), 1));
+
+  // Geometry for refitting BLASes reads deformed positions
+  VkDeviceAddress vertexAddress = getBufferDeviceAddress(device, blasVertexBuffer);
+  VkDeviceAddress indexAddress = getBufferDeviceAddress(device, blasIndexBuffer);
+  auto extensions = device->getExtensions();
+  refits.clear();
+  VkDeviceSize scratchSize = 0;
+  VkDeviceSize indexOffset = 0;
+  for (size_t i = 0; i < deformInfoList.size(); ++i) {
+    const DeformInfo& info = deformInfoList[i];
+
+    BLASRefit refit;
+    refit.blas = blasList[i];
+
+    refit.geometry = {};
+    refit.geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+    refit.geometry.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR;
+    refit.geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;  // Same as vsg::AccelerationGeometry
+    auto& triangles = refit.geometry.geometry.triangles;
+    triangles.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR;
+    triangles.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT;
+    triangles.vertexData.deviceAddress = vertexAddress + VkDeviceSize(info.sourceOffset) * sizeof(vsg::vec3);
+    triangles.vertexStride = sizeof(vsg::vec3);
+    triangles.maxVertex = info.numVertices; // Same as vsg::AccelerationGeometry
+    triangles.indexType = VK_INDEX_TYPE_UINT16;
+    triangles.indexData.deviceAddress = indexAddress + indexOffset * sizeof(uint16_t);
+
+    refit.range = {};
+    refit.range.primitiveCount = uint32_t(indicesList[i]->valueCount() / 3);
+
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{};
+    buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    buildInfo.flags = refit.blas->buildFlags() | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+    buildInfo.geometryCount = 1;
+    buildInfo.pGeometries = &refit.geometry;
+
+    VkAccelerationStructureBuildSizesInfoKHR sizeInfo{};
+    sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+    extensions->vkGetAccelerationStructureBuildSizesKHR(*device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &refit.range.primitiveCount, &sizeInfo);
+
+    // Each BLAS uses separate region of scratch buffer because they are refitted in one command
+    refit.scratchOffset = scratchSize;
+    scratchSize += (sizeInfo.updateScratchSize + SCRATCH_ALIGNMENT - 1) / SCRATCH_ALIGNMENT * SCRATCH_ALIGNMENT;
+
+    refits.push_back(refit);
+    indexOffset += indicesList[i]->valueCount();
+  }
+  scratchBuffer = vsg::createBufferAndMemory(
+    device, std::max<VkDeviceSize>(scratchSize, SCRATCH_ALIGNMENT),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  deformationRequired = true; // Deform at the first frame
+  modified = false;
+
+  return DeformMeshes::create(this, scene, computeCommands);
+}
+
+void MeshDeformer::recordUpload(vsg::CommandBuffer& commandBuffer) const
+{
+  auto upload = [&](vsg::Buffer* buffer, const void* data, VkDeviceSize dataSize) {
+    if (dataSize == 0) {
+      return;
+    }
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = buffer->vk(commandBuffer.deviceID);
+    barrier.offset = 0;
+    barrier.size = dataSize;
+
+    // The compute shader of the previous frame may still read the values
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (VkDeviceSize offset = 0; offset < dataSize; offset += MAX_UPDATE_SIZE) {
+      vkCmdUpdateBuffer(commandBuffer, barrier.buffer, offset, std::min(MAX_UPDATE_SIZE, dataSize - offset), bytes + offset);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+  };
+
+  upload(jointMatricesBuffer, jointMatrices.data(), VkDeviceSize(jointMatrices.size()) * sizeof(vsg::mat4));
+  upload(morphWeightsBuffer, morphWeights.data(), VkDeviceSize(morphWeights.size()) * sizeof(float));
+}
+
+void MeshDeformer::recordBLASRefit(vsg::CommandBuffer& commandBuffer) const
+{
+  auto extensions = device->getExtensions();
+  VkDeviceAddress scratchAddress = getBufferDeviceAddress(device, scratchBuffer);
+
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos;
+  std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> rangeInfos;
+  for (auto& refit : refits) {
+    VkAccelerationStructureKHR vkBLAS = refit.blas->vk(device->deviceID);
+
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{};
+    buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+    buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+    buildInfo.flags = refit.blas->buildFlags();
+    buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+    buildInfo.srcAccelerationStructure = vkBLAS;
+    buildInfo.dstAccelerationStructure = vkBLAS;
+    buildInfo.geometryCount = 1;
+    buildInfo.pGeometries = &refit.geometry;
+    buildInfo.scratchData.deviceAddress = scratchAddress + refit.scratchOffset;
+
+    buildInfos.push_back(buildInfo);
+    rangeInfos.push_back(&refit.range);
+  }
+
+  extensions->vkCmdBuildAccelerationStructuresKHR(commandBuffer, uint32_t(buildInfos.size()), buildInfos.data(), rangeInfos.data());
+
+  // BLASes are read by TLAS update
+  VkMemoryBarrier buildBarrier{};
+  buildBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  buildBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  buildBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+    0, 1, &buildBarrier, 0, nullptr, 0, nullptr);
+}
@@ -0,0 +1,176 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <vsg/maths/vec3.h>
+
+// Bytes per vertex of all attributes and per index
+static size_t meshBytes(const MeshData& mesh)
+{
+  size_t vertexSize = sizeof(vsg::vec3) * 2 + sizeof(vsg::vec2) + sizeof(vsg::vec4);
+  return mesh.vertices->valueCount() * vertexSize + mesh.indices->valueCount() * sizeof(uint16_t);
+}
+
+// Interleave lower 10 bits of x, y and z
+static uint32_t mortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+  auto spread = [](uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+  };
+  return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+}
+
+void MeshOptimizer::optimize(MeshData& mesh)
+{
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  size_t numVertices = mesh.vertices->valueCount();
+  size_t numTriangles = mesh.indices->valueCount() / 3;
+
+  verticesBefore += numVertices;
+  trianglesBefore += numTriangles;
+  bytesBefore += meshBytes(mesh);
+
+  // Weld vertices using all attributes as a key
+  struct PackedVertex
+  {
+    vsg::vec3 vertex, normal;
+    vsg::vec2 texCoord;
+    vsg::vec4 tangent;
+  };
+  auto packVertex = [&](size_t i) {
+    PackedVertex v;
+    std::memset(&v, 0, sizeof(v)); // Padding must not affect keys
+    v.vertex = mesh.vertices->at(i);
+    v.normal = mesh.normals->at(i);
+    v.texCoord = mesh.texCoords->at(i);
+    v.tangent = mesh.tangents->at(i);
+    return std::string(reinterpret_cast<const char*>(&v), sizeof(v));
+  };
+  std::unordered_map<std::string, uint32_t> uniqueVertices;
+  std::vector<uint32_t> weldRemap(numVertices);
+  std::vector<uint32_t> weldedSource;  // Original index of each welded vertex
+  for (size_t i = 0; i < numVertices; ++i) {
+    auto [it, inserted] = uniqueVertices.try_emplace(packVertex(i), uint32_t(weldedSource.size()));
+    if (inserted) {
+      weldedSource.push_back(uint32_t(i));
+    }
+    weldRemap[i] = it->second;
+  }
+
+  // Remove degenerate triangles
+  std::vector<uint32_t> triangles; // Welded indices
+  triangles.reserve(numTriangles * 3);
+  for (size_t t = 0; t < numTriangles; ++t) {
+    uint32_t i0 = weldRemap[mesh.indices->at(3 * t)];
+    uint32_t i1 = weldRemap[mesh.indices->at(3 * t + 1)];
+    uint32_t i2 = weldRemap[mesh.indices->at(3 * t + 2)];
+    if (i0 == i1 || i1 == i2 || i2 == i0) {
+      continue;
+    }
+    const vsg::vec3& p0 = mesh.vertices->at(weldedSource[i0]);
+    const vsg::vec3& p1 = mesh.vertices->at(weldedSource[i1]);
+    const vsg::vec3& p2 = mesh.vertices->at(weldedSource[i2]);
+    if (vsg::length2(vsg::cross(p1 - p0, p2 - p0)) == 0.0f) {
+      continue;
+    }
+    triangles.insert(triangles.end(), { i0, i1, i2 });
+  }
+  size_t numNewTriangles = triangles.size() / 3;
+  if (numNewTriangles == 0) {
+    // Keep the mesh as it is, because acceleration structures cannot be built without triangles
+    verticesAfter += numVertices;
+    trianglesAfter += numTriangles;
+    bytesAfter += meshBytes(mesh);
+    return;
+  }
+
+  // Sort triangles by Morton code of centroids
+  vsg::vec3 minPos(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+  vsg::vec3 maxPos = -minPos;
+  for (uint32_t source : weldedSource) {
+    const vsg::vec3& p = mesh.vertices->at(source);
+    for (int c = 0; c < 3; ++c) {
+      minPos[c] = std::min(minPos[c], p[c]);
+      maxPos[c] = std::max(maxPos[c], p[c]);
+    }
+  }
+  vsg::vec3 extent = maxPos - minPos;
+  std::vector<uint32_t> codes(numNewTriangles);
+  for (size_t t = 0; t < numNewTriangles; ++t) {
+    vsg::vec3 centroid = (mesh.vertices->at(weldedSource[triangles[3 * t]])
+      + mesh.vertices->at(weldedSource[triangles[3 * t + 1]])
+      + mesh.vertices->at(weldedSource[triangles[3 * t + 2]])) / 3.0f;
+    uint32_t quantized[3];
+    for (int c = 0; c < 3; ++c) {
+      float normalized = (extent[c] > 0.0f) ? (centroid[c] - minPos[c]) / extent[c] : 0.0f;
+      quantized[c] = uint32_t(std::clamp(normalized, 0.0f, 1.0f) * 1023.0f);
+    }
+    codes[t] = mortonCode(quantized[0], quantized[1], quantized[2]);
+  }
+  std::vector<uint32_t> triangleOrder(numNewTriangles);
+  std::iota(triangleOrder.begin(), triangleOrder.end(), 0);
+  std::stable_sort(triangleOrder.begin(), triangleOrder.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+
+  // Reorder vertices in order of first use (unused vertices are dropped)
+  const uint32_t UNASSIGNED = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> newIndexOfWelded(weldedSource.size(), UNASSIGNED);
+  std::vector<uint32_t> newVertexSource;
+  auto newIndices = vsg::ushortArray::create(uint32_t(numNewTriangles * 3));
+  for (size_t t = 0; t < numNewTriangles; ++t) {
+    for (int k = 0; k < 3; ++k) {
+      uint32_t welded = triangles[3 * triangleOrder[t] + k];
+      if (newIndexOfWelded[welded] == UNASSIGNED) {
+        newIndexOfWelded[welded] = uint32_t(newVertexSource.size());
+        newVertexSource.push_back(weldedSource[welded]);
+      }
+      newIndices->at(3 * t + k) = uint16_t(newIndexOfWelded[welded]);
+    }
+  }
+
+  size_t numNewVertices = newVertexSource.size();
+  auto newVertices = vsg::vec3Array::create(uint32_t(numNewVertices));
+  auto newNormals = vsg::vec3Array::create(uint32_t(numNewVertices));
+  auto newTexCoords = vsg::vec2Array::create(uint32_t(numNewVertices));
+  auto newTangents = vsg::vec4Array::create(uint32_t(numNewVertices));
+  for (size_t i = 0; i < numNewVertices; ++i) {
+    uint32_t source = newVertexSource[i];
+    newVertices->at(i) = mesh.vertices->at(source);
+    newNormals->at(i) = mesh.normals->at(source);
+    newTexCoords->at(i) = mesh.texCoords->at(source);
+    newTangents->at(i) = mesh.tangents->at(source);
+  }
+
+  mesh.indices = newIndices;
+  mesh.vertices = newVertices;
+  mesh.normals = newNormals;
+  mesh.texCoords = newTexCoords;
+  mesh.tangents = newTangents;
+
+  verticesAfter += numNewVertices;
+  trianglesAfter += numNewTriangles;
+  bytesAfter += meshBytes(mesh);
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+  milliseconds += elapsed.count();
+}
+
+void MeshOptimizer::report(std::ostream& stream) const
+{
+  stream << "Mesh optimization (" << milliseconds << " ms):" << std::endl;
+  stream << "  vertices: " << verticesBefore << " -> " << verticesAfter << std::endl;
+  stream << "  triangles: " << trianglesBefore << " -> " << trianglesAfter << std::endl;
+  stream << "  bytes: " << bytesBefore << " -> " << bytesAfter << std::endl;
+}
@@ -0,0 +1,121 @@
+#include "PipelineCache.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include "utils.h"
+
+PipelineCache::PipelineCache(const std::filesystem::path& directory)
+  : directory(directory)
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+  if (pipelineCache != VK_NULL_HANDLE) {
+    vkDestroyPipelineCache(*device, pipelineCache, device->getAllocationCallbacks());
+  }
+}
+
+VkPipelineCache PipelineCache::load(vsg::Device* device, const vsg::ShaderStages& shaderStages)
+{
+  if (pipelineCache != VK_NULL_HANDLE) {
+    return pipelineCache; // Already loaded
+  }
+
+  this->device = device;
+
+  // Hash of SPIR-V code, entry points and specialization constants of all stages
+  uint64_t shaderHash = hashBytes(nullptr, 0);
+  for (auto& stage : shaderStages) {
+    shaderHash = hashBytes(&stage->stage, sizeof(stage->stage), shaderHash);
+    shaderHash = hashBytes(stage->entryPointName.data(), stage->entryPointName.size(), shaderHash);
+    shaderHash = hashBytes(stage->module->code.data(), stage->module->code.size() * sizeof(uint32_t), shaderHash);
+    for (auto& [constantId, value] : stage->specializationConstants) {
+      shaderHash = hashBytes(&constantId, sizeof(constantId), shaderHash);
+      shaderHash = hashBytes(value->dataPointer(), value->dataSize(), shaderHash);
+    }
+  }
+
+  const VkPhysicalDeviceProperties& properties = device->getPhysicalDevice()->getProperties();
+  std::ostringstream fileName;
+  fileName << std::hex << std::setfill('0')
+    << std::setw(4) << properties.vendorID << "_" << std::setw(4) << properties.deviceID << "_"
+    << std::setw(8) << properties.driverVersion << "_" << std::setw(16) << shaderHash << ".bin";
+  path = directory / fileName.str();
+
+  // Initial data is used only if its header matches this device (drivers also validate it, but not always gracefully)
+  std::vector<char> initialData;
+  std::ifstream file(path, std::ios::binary);
+  if (file) {
+    initialData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    const size_t headerSize = 16 + VK_UUID_SIZE;
+    if (initialData.size() < headerSize
+      || std::memcmp(initialData.data() + 16, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+      std::cerr << "Ignoring incompatible pipeline cache " << path << std::endl;
+      initialData.clear();
+    }
+  }
+  loadedFromFile = !initialData.empty();
+  savedData = initialData;
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = initialData.size();
+  createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+  if (vkCreatePipelineCache(*device, &createInfo, device->getAllocationCallbacks(), &pipelineCache) != VK_SUCCESS) {
+    std::cerr << "Cannot create pipeline cache" << std::endl;
+    pipelineCache = VK_NULL_HANDLE;
+    loadedFromFile = false;
+  }
+
+  return pipelineCache;
+}
+
+bool PipelineCache::save()
+{
+  if (pipelineCache == VK_NULL_HANDLE) {
+    return false;
+  }
+
+  size_t size = 0;
+  vkGetPipelineCacheData(*device, pipelineCache, &size, nullptr);
+  std::vector<char> data(size);
+  if (vkGetPipelineCacheData(*device, pipelineCache, &size, data.data()) != VK_SUCCESS) {
+    return false;
+  }
+  data.resize(size);
+
+  // Recreated pipelines are usually found in the cache, which leaves the data unchanged
+  if (data == savedData) {
+    return true;
+  }
+
+  // Written into a temporary file and renamed, so that another process never reads a partially written cache
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  std::filesystem::path temporaryPath = path;
+  temporaryPath += ".tmp";
+  {
+    std::ofstream file(temporaryPath, std::ios::binary);
+    file.write(data.data(), std::streamsize(size));
+    if (!file) {
+      std::cerr << "Cannot write pipeline cache " << temporaryPath << std::endl;
+      std::filesystem::remove(temporaryPath, error);
+      return false;
+    }
+  }
+  std::filesystem::rename(temporaryPath, path, error);
+  if (error) {
+    std::cerr << "Cannot replace pipeline cache " << path << ": " << error.message() << std::endl;
+    std::filesystem::remove(temporaryPath, error);
+    return false;
+  }
+
+  savedData = std::move(data);
+  return true;
+}
@@ -0,0 +1,42 @@
+#include "ProceduralBottomLevelAccelerationStructure.h"
+
+#include <cassert>
+#include <vsg/core/Array.h>
+#include <vsg/raytracing/BuildAccelerationStructureCommand.h>
+#include "utils.h"
+
+ProceduralBottomLevelAccelerationStructure::ProceduralBottomLevelAccelerationStructure(vsg::Device* device, PrimitiveShape shape)
+  : Inherit(device), shape(shape)
+{
+  assert(shape != PrimitiveShape::TRIANGLES);
+}
+
+void ProceduralBottomLevelAccelerationStructure::compile(vsg::Context& context)
+{
+  if (isCompiled) {
+    return;
+  }
+
+  applyBuildFlags();
+
+  // Flat shapes are padded, so that their boxes have volume
+  float halfDepth = (shape == PrimitiveShape::SPHERE) ? 1.0f : 0.001f;
+  auto aabb = vsg::floatArray::create({ -1.0f, -1.0f, -halfDepth, 1.0f, 1.0f, halfDepth }); // As VkAabbPositionsKHR
+  aabbBuffer = createHostVisibleBuffer(_device, aabb, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+
+  VkAccelerationStructureGeometryKHR geometry{};
+  geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+  geometry.geometryType = VK_GEOMETRY_TYPE_AABBS_KHR;
+  geometry.flags = VK_GEOMETRY_OPAQUE_BIT_KHR;  // Alpha masking is not supported for analytic shapes
+  geometry.geometry.aabbs.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_AABBS_DATA_KHR;
+  geometry.geometry.aabbs.data.deviceAddress = getBufferDeviceAddress(_device, aabbBuffer);
+  geometry.geometry.aabbs.stride = sizeof(VkAabbPositionsKHR);
+  _geometries.push_back(geometry);
+  _geometryPrimitiveCounts.push_back(1);
+
+  // Same as vsg::BottomLevelAccelerationStructure::compile, which only handles triangles
+  vsg::AccelerationStructure::compile(context);
+  context.buildAccelerationStructureCommands.push_back(vsg::BuildAccelerationStructureCommand::create(
+    context.device, _accelerationStructureBuildGeometryInfo, _accelerationStructure, _geometryPrimitiveCounts, context.getAllocator()));
+  isCompiled = true;
+}
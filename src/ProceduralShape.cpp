@@ -0,0 +1,19 @@
+#include "ProceduralShape.h"
+
+#include "RayTracingVisitor.h"
+
+ProceduralShape::ProceduralShape(PrimitiveShape shape, const vsg::mat4& transform)
+  : shape(shape), transform(transform)
+{
+}
+
+void ProceduralShape::accept(vsg::Visitor& visitor)
+{
+  // Custom node type is handled in the same way as RayTracingMaterialGroup
+  RayTracingVisitor* rtVisitor = dynamic_cast<RayTracingVisitor*>(&visitor);
+  if (rtVisitor) {
+    rtVisitor->apply(*this);
+  } else {
+    visitor.apply(*this);
+  }
+}
@@ -1,202 +1,685 @@
-#include "RayTracer.h"
-
-#include <cstdint>
-#include <iostream>
-#include <vsg/all.h>
-#include "RayTracingUniform.h"
-#include "hammersley.h"
-
-RayTracer::RayTracer(vsg::Device* device, int width, int height, vsg::ref_ptr<RayTracingScene> scene, SamplingAlgorithm algorithm)
-  : device(device), screenSize({ uint32_t(width), uint32_t(height) }),
-    scene(scene),
-    algorithm(algorithm)
-{
-  uniformValue = RayTracingUniformValue::create();
-
-  // Choose ray generation shader for specified sampling algorithm
-  std::string rayGenerationShaderPath;
-  switch (algorithm) {
-  case SamplingAlgorithm::PATH_TRACING:
-    rayGenerationShaderPath = "shaders/rayGeneration.spv";
-    break;
-  case SamplingAlgorithm::QUASI_MONTE_CARLO:
-    rayGenerationShaderPath = "shaders/rayGenerationQMC.spv";
-    break;
-  default:
-    break;
-  }
-
-  // Load shaders
-  rayGenerationShader = vsg::ShaderStage::read(VK_SHADER_STAGE_RAYGEN_BIT_KHR, "main", rayGenerationShaderPath);
-  missShader = vsg::ShaderStage::read(VK_SHADER_STAGE_MISS_BIT_KHR, "main", "shaders/miss.spv");
-  closestHitShader = vsg::ShaderStage::read(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, "main", "shaders/closestHit.spv");
-  if (!rayGenerationShader || !missShader || !closestHitShader) {
-    std::cout << "Cannot load shaders" << std::endl;
-  }
-
-  auto shaderStages = vsg::ShaderStages{ rayGenerationShader, missShader, closestHitShader };
-
-  rayGenerationShaderGroup = vsg::RayTracingShaderGroup::create();
-  rayGenerationShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-  rayGenerationShaderGroup->generalShader = 0;  // Index in shaderStages
-
-  missShaderGroup = vsg::RayTracingShaderGroup::create();
-  missShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
-  missShaderGroup->generalShader = 1; // Index in shaderStages
-
-  closestHitShaderGroup = vsg::RayTracingShaderGroup::create();
-  closestHitShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
-  closestHitShaderGroup->closestHitShader = 2;  // Index in shaderStages
-
-  auto shaderGroups = vsg::RayTracingShaderGroups{ rayGenerationShaderGroup, missShaderGroup, closestHitShaderGroup };
-
-  vsg::ref_ptr<vsg::TopLevelAccelerationStructure> tlas = scene->tlas;
-  auto objectInfo = scene->getObjectInfo();
-  auto indices = scene->getIndices();
-  auto vertices = scene->getVertices();
-  auto normals = scene->getNormals();
-  auto texCoords = scene->getTexCoords();
-  auto tangents = scene->getTangents();
-
-  // Create a target image for rendering
-  targetImage = vsg::Image::create();
-  targetImage->imageType = VK_IMAGE_TYPE_2D;
-  targetImage->format = VK_FORMAT_B8G8R8A8_UNORM; // 4-channel, normalized (float in shader but actually integer) See: https://www.khronos.org/opengl/wiki/Image_Format
-  targetImage->extent.width = screenSize.width;
-  targetImage->extent.height = screenSize.height;
-  targetImage->extent.depth = 1; // Because this is a 2D image, it has only one depth
-  targetImage->mipLevels = 1; // No mipmap
-  targetImage->arrayLayers = 1; // Only one layer
-  targetImage->samples = VK_SAMPLE_COUNT_1_BIT; // No multisampling
-  targetImage->tiling = VK_IMAGE_TILING_OPTIMAL;  // Placed in optimal memory layout
-  targetImage->usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-  targetImage->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  targetImage->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  targetImage->flags = 0;
-  // Create an image view as a color image
-  targetImageView = vsg::createImageView(device, targetImage, VK_IMAGE_ASPECT_COLOR_BIT);
-  // Image information for creating a descriptor
-  vsg::ImageInfo targetImageInfo(nullptr, targetImageView, VK_IMAGE_LAYOUT_GENERAL);;
-
-  // Descriptor layout which specifies types of descriptors passed to shaders
-  vsg::DescriptorSetLayoutBindings descriptorBindings{
-    // Acceleration structure which contains the scene
-    { static_cast<uint32_t>(Bindings::TLAS), VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr },
-    // The target image
-    { static_cast<uint32_t>(Bindings::TARGET_IMAGE), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr },
-    // The uniform buffer
-    { static_cast<uint32_t>(Bindings::UNIFORMS), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr },
-    // Array of ObjectInfo, which contains offsets of indices and vertex attributes
-    { static_cast<uint32_t>(Bindings::OBJECT_INFOS), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-    // Array of indices of all objects combined
-    { static_cast<uint32_t>(Bindings::INDICES), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-    // Array of vertices of all objects combined
-    { static_cast<uint32_t>(Bindings::VERTICES), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-    // Array of normals of all objects combined
-    { static_cast<uint32_t>(Bindings::NORMALS), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-    // Array of texture coords of all objects combined
-    { static_cast<uint32_t>(Bindings::TEX_COORDS), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-    // Array of tangents of all objects combined
-    { static_cast<uint32_t>(Bindings::TANGENTS), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-    // Textures
-    { static_cast<uint32_t>(Bindings::TEXTURES), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, uint32_t(MAX_NUM_TEXTURES), VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
-    // Environment map
-    { static_cast<uint32_t>(Bindings::ENV_MAP), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_MISS_BIT_KHR, nullptr }
-  };
-  // If algorithm is QMC, add binding for hammersley sequence
-  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
-    descriptorBindings.push_back(VkDescriptorSetLayoutBinding{ static_cast<uint32_t>(Bindings::HAMMERSLEY), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr });
-  }
-  auto descriptorLayout = vsg::DescriptorSetLayout::create(descriptorBindings);
-
-  // Create descriptors
-  tlasDescriptor = vsg::DescriptorAccelerationStructure::create(vsg::AccelerationStructures{ tlas }, static_cast<uint32_t>(Bindings::TLAS), 0);
-  targetImageDescriptor = vsg::DescriptorImage::create(targetImageInfo, static_cast<uint32_t>(Bindings::TARGET_IMAGE), 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-  uniformDescriptor = vsg::DescriptorBuffer::create(uniformValue, static_cast<uint32_t>(Bindings::UNIFORMS), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-  objectInfoDescriptor = vsg::DescriptorBuffer::create(objectInfo, static_cast<uint32_t>(Bindings::OBJECT_INFOS), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-  indicesDescriptor = vsg::DescriptorBuffer::create(indices, static_cast<uint32_t>(Bindings::INDICES), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-  verticesDescriptor = vsg::DescriptorBuffer::create(vertices, static_cast<uint32_t>(Bindings::VERTICES) , 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-  normalsDescriptor = vsg::DescriptorBuffer::create(normals, static_cast<uint32_t>(Bindings::NORMALS), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-  texCoordsDescriptor = vsg::DescriptorBuffer::create(texCoords, static_cast<uint32_t>(Bindings::TEX_COORDS), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-  tangentsDescriptor = vsg::DescriptorBuffer::create(tangents, static_cast<uint32_t>(Bindings::TANGENTS), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-
-  // Prepare descriptor for texture
-  auto emptyImageData = vsg::vec3Array2D::create(1, 1, vsg::Data::Layout{ VK_FORMAT_R32G32B32_SFLOAT });
-  auto emptyImage = vsg::Image::create(emptyImageData);
-  emptyImage->usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-  emptyImage->format = VK_FORMAT_R32G32B32_SFLOAT;
-  emptyImage->tiling = VK_IMAGE_TILING_LINEAR;
-  vsg::ImageInfo emptyImageInfo(vsg::Sampler::create(), vsg::ImageView::create(emptyImage), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-  vsg::ImageInfoList imageInfoList(MAX_NUM_TEXTURES, emptyImageInfo);
-  std::copy(
-    scene->textures.cbegin(),
-    scene->textures.cbegin() + std::min(MAX_NUM_TEXTURES, scene->textures.size()),
-    imageInfoList.begin());
-  textureDescriptor = vsg::DescriptorImage::create(imageInfoList, static_cast<uint32_t>(Bindings::TEXTURES), 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-  // When algorithm is QMC, create a descriptor for low-discrepancy sequence
-  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
-    hammersley = vsg::floatArray::create(); // Actual content is set later (in setSamplesPerPixel)
-    hammersleyDescriptor = vsg::DescriptorBuffer::create(hammersley, static_cast<uint32_t>(Bindings::HAMMERSLEY), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);  // Binding 11
-  }
-
-  // Create descriptor for environment map
-  envMapDescriptor = vsg::DescriptorImage::create(
-    vsg::Sampler::create(),
-    scene->envMap,
-    static_cast<uint32_t>(Bindings::ENV_MAP), 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-  // Combine descriptor into a descriptor set
-  vsg::Descriptors descriptors = { tlasDescriptor, targetImageDescriptor, uniformDescriptor, objectInfoDescriptor, indicesDescriptor, verticesDescriptor, normalsDescriptor, texCoordsDescriptor, tangentsDescriptor, textureDescriptor, envMapDescriptor };
-  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
-    descriptors.push_back(hammersleyDescriptor);
-  }
-  descriptorSet = vsg::DescriptorSet::create(descriptorLayout, descriptors);
-
-  // Create ray tracing pipeline
-  pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{ descriptorLayout }, vsg::PushConstantRanges{});
-  rayTracingPipeline = vsg::RayTracingPipeline::create(pipelineLayout, shaderStages, shaderGroups);
-}
-
-void RayTracer::setSamplesPerPixel(int samplesPerPixel)
-{
-  uniformValue->value().samplesPerPixel = uint32_t(samplesPerPixel);
-  uniformDescriptor->copyDataListToBuffers();
-
-  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
-    // Generate low-discrepancy sequence for specified number of samples
-    int numElems = HAMMERSLEY_REPLICATIONS * SAMPLING_DIMENSIONS * samplesPerPixel;
-    hammersley->assign(numElems, (float*)malloc(numElems * sizeof(float)));
-    generateScrambledHammersley(SAMPLING_DIMENSIONS, samplesPerPixel, HAMMERSLEY_REPLICATIONS, hammersley);  // Fill data
-  }
-}
-
-void RayTracer::setCameraParams(const vsg::mat4& viewMat, const vsg::mat4& projectionMat)
-{
-  uniformValue->value().invViewMat = vsg::inverse(viewMat);
-  uniformValue->value().invProjectionMat = vsg::inverse(projectionMat);
-  uniformDescriptor->copyDataListToBuffers();
-}
-
-vsg::ref_ptr<vsg::CommandGraph> RayTracer::createCommandGraph(vsg::ref_ptr<vsg::Window> window)
-{
-  // Prepare commands for ray tracing
-  auto commands = vsg::Commands::create();
-  commands->addChild(vsg::BindRayTracingPipeline::create(rayTracingPipeline));
-  commands->addChild(vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0, descriptorSet));
-  auto traceRaysCommand = vsg::TraceRays::create();
-  traceRaysCommand->raygen = rayGenerationShaderGroup;
-  traceRaysCommand->missShader = missShaderGroup;
-  traceRaysCommand->hitShader = closestHitShaderGroup;
-  traceRaysCommand->width = screenSize.width;
-  traceRaysCommand->height = screenSize.height;
-  traceRaysCommand->depth = 1;
-  commands->addChild(traceRaysCommand);
-
-  // Command graph to render the result into the window
-  auto commandGraph = vsg::CommandGraph::create(window);
-  commandGraph->addChild(commands);
-  commandGraph->addChild(vsg::CopyImageViewToWindow::create(targetImageView, window));  // Target image is copied into window
-
-  return commandGraph;
-}
+#include "RayTracer.h"
+
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <iostream>
+#include <vsg/all.h>
+#include "RayTracingUniform.h"
+#include "hammersley.h"
+#include "UpdateTopLevelAccelerationStructure.h"
+
+// Records the command of the current frame of RayTracer
+class FrameCommand : public vsg::Inherit<vsg::Command, FrameCommand>
+{
+public:
+  FrameCommand(const RayTracer* rayTracer, const std::vector<vsg::ref_ptr<vsg::Command>>& commands) : rayTracer(rayTracer), commands(commands) {}
+
+  void compile(vsg::Context& context) override
+  {
+    for (auto& command : commands) {
+      command->compile(context);
+    }
+  }
+
+  void record(vsg::CommandBuffer& commandBuffer) const override
+  {
+    commands[rayTracer->getFrameIndex() % commands.size()]->record(commandBuffer);
+  }
+
+  const RayTracer* rayTracer;
+  std::vector<vsg::ref_ptr<vsg::Command>> commands;
+};
+
+// Records the scene update commands of RayTracer, which are replaced when the scene is (see RayTracer::setScene)
+class SceneUpdateCommand : public vsg::Inherit<vsg::Command, SceneUpdateCommand>
+{
+public:
+  SceneUpdateCommand(const vsg::ref_ptr<vsg::Commands>& commands) : commands(commands) {}
+
+  void compile(vsg::Context& context) override { commands->compile(context); }
+  void record(vsg::CommandBuffer& commandBuffer) const override { commands->record(commandBuffer); }
+
+  const vsg::ref_ptr<vsg::Commands>& commands;  // Member of RayTracer
+};
+
+// Copies uniforms of RayTracer into the uniform buffer of the current frame inside the command buffer,
+// so that the CPU never writes memory which frames in flight may be reading
+class UploadUniformsCommand : public vsg::Inherit<vsg::Command, UploadUniformsCommand>
+{
+public:
+  UploadUniformsCommand(const RayTracer* rayTracer) : rayTracer(rayTracer) {}
+
+  void record(vsg::CommandBuffer& commandBuffer) const override
+  {
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = rayTracer->getUniformBuffer()->vk(commandBuffer.deviceID);
+    barrier.offset = 0;
+    barrier.size = sizeof(RayTracingUniform);
+
+    // Previous use of the buffer by shaders has to finish before it is overwritten
+    barrier.srcAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // Values at the time of recording are stored in the command buffer (the limit of vkCmdUpdateBuffer is 64 KiB)
+    vkCmdUpdateBuffer(commandBuffer, barrier.buffer, 0, sizeof(RayTracingUniform), &rayTracer->getUniforms());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+  }
+
+  const RayTracer* rayTracer;
+};
+
+// Copies materials of RayTracer into the material buffer inside the command buffer when they were modified.
+// Frames in flight read the same buffer, but the barrier orders the copy after their shaders
+class UploadMaterialsCommand : public vsg::Inherit<vsg::Command, UploadMaterialsCommand>
+{
+public:
+  UploadMaterialsCommand(const RayTracer* rayTracer) : rayTracer(rayTracer) {}
+
+  void record(vsg::CommandBuffer& commandBuffer) const override
+  {
+    if (uploadedVersion == rayTracer->getMaterialVersion()) {
+      return;
+    }
+
+    const auto& materials = rayTracer->getMaterials();
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = rayTracer->getMaterialBuffer()->vk(commandBuffer.deviceID);
+    barrier.offset = 0;
+    barrier.size = materials.dataSize();
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    // Uploaded in chunks, because the limit of vkCmdUpdateBuffer is 64 KiB
+    const VkDeviceSize maxUpdateSize = 65536;
+    auto bytes = static_cast<const uint8_t*>(materials.dataPointer());
+    for (VkDeviceSize offset = 0; offset < materials.dataSize(); offset += maxUpdateSize) {
+      VkDeviceSize size = std::min(maxUpdateSize, VkDeviceSize(materials.dataSize()) - offset);
+      vkCmdUpdateBuffer(commandBuffer, barrier.buffer, offset, size, bytes + offset);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    uploadedVersion = rayTracer->getMaterialVersion();
+  }
+
+  const RayTracer* rayTracer;
+  mutable uint32_t uploadedVersion = 0;
+};
+
+RayTracer::RayTracer(vsg::Device* device, int width, int height, vsg::ref_ptr<RayTracingScene> scene, SamplingAlgorithm algorithm, VkFormat targetFormat, uint32_t numViews, bool writeAOVs)
+  : device(device), screenSize({ uint32_t(width), uint32_t(height) }),
+    numViews(std::clamp(numViews, 1u, MAX_NUM_VIEWS)),
+    targetFormat(targetFormat),
+    scene(scene),
+    algorithm(algorithm)
+{
+  uniformValue = RayTracingUniformValue::create();
+  uniformValue->value().maxHistorySamples = 0;
+  uniformValue->value().historyValid = 0;
+  uniformValue->value().randomSeed = 0;
+  viewProjectionMats.resize(this->numViews);
+  toneMapParams = ToneMapParamsValue::create();
+
+  tileParams = TileParamsValue::create();
+  tileParams->value().tileOffset = vsg::uivec2(0, 0);
+  tileParams->value().imageSize = vsg::uivec2(screenSize.width, screenSize.height);
+  tileParams->value().sampleOffset = 0;
+  tileParams->value().sampleCount = 0;  // Set by setSamplesPerPixel
+
+  // Choose ray generation shader for specified sampling algorithm (and a variant writing AOVs)
+  std::string rayGenerationShaderPath;
+  switch (algorithm) {
+  case SamplingAlgorithm::PATH_TRACING:
+    rayGenerationShaderPath = writeAOVs ? "shaders/rayGenerationAOV.spv" : "shaders/rayGeneration.spv";
+    break;
+  case SamplingAlgorithm::QUASI_MONTE_CARLO:
+    rayGenerationShaderPath = writeAOVs ? "shaders/rayGenerationQMCAOV.spv" : "shaders/rayGenerationQMC.spv";
+    break;
+  default:
+    break;
+  }
+
+  // Load shaders
+  rayGenerationShader = vsg::ShaderStage::read(VK_SHADER_STAGE_RAYGEN_BIT_KHR, "main", rayGenerationShaderPath);
+  missShader = vsg::ShaderStage::read(VK_SHADER_STAGE_MISS_BIT_KHR, "main", "shaders/miss.spv");
+  closestHitShader = vsg::ShaderStage::read(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, "main", "shaders/closestHit.spv");
+  anyHitShader = vsg::ShaderStage::read(VK_SHADER_STAGE_ANY_HIT_BIT_KHR, "main", "shaders/anyHit.spv");
+  proceduralClosestHitShader = vsg::ShaderStage::read(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, "main", "shaders/closestHitProcedural.spv");
+  intersectionShader = vsg::ShaderStage::read(VK_SHADER_STAGE_INTERSECTION_BIT_KHR, "main", "shaders/intersection.spv");
+  if (!rayGenerationShader || !missShader || !closestHitShader || !anyHitShader || !proceduralClosestHitShader || !intersectionShader) {
+    std::cerr << "Cannot load shaders" << std::endl;
+  }
+
+  // Shader stages are ordered as raygen, miss, any-hit and shaders of hit groups (see updateHitGroups)
+  rayGenerationShaderGroup = vsg::RayTracingShaderGroup::create();
+  rayGenerationShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+  rayGenerationShaderGroup->generalShader = 0;  // Index in shaderStages
+
+  missShaderGroup = vsg::RayTracingShaderGroup::create();
+  missShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR;
+  missShaderGroup->generalShader = 1; // Index in shaderStages
+
+  auto objectInfo = scene->getObjectInfo();
+
+  // Target images are created per frame (see addFrame)
+
+  // Create an image for AOVs
+  if (writeAOVs) {
+    aovImage = vsg::Image::create();
+    aovImage->imageType = VK_IMAGE_TYPE_2D;
+    aovImage->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    aovImage->extent = { screenSize.width, screenSize.height, 1 };
+    aovImage->mipLevels = 1;
+    aovImage->arrayLayers = this->numViews * NUM_AOV_LAYERS;
+    aovImage->samples = VK_SAMPLE_COUNT_1_BIT;
+    aovImage->tiling = VK_IMAGE_TILING_OPTIMAL;
+    aovImage->usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    aovImage->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    aovImage->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    aovImage->flags = 0;
+    aovImageView = vsg::ImageView::create(aovImage, VK_IMAGE_ASPECT_COLOR_BIT);
+    aovImageView->viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    aovImageView->subresourceRange.layerCount = aovImage->arrayLayers;
+    aovImageView->compile(device);
+  }
+
+  // Descriptor layout which specifies types of descriptors passed to shaders
+  vsg::DescriptorSetLayoutBindings descriptorBindings{
+    // Acceleration structure which contains the scene
+    { static_cast<uint32_t>(Bindings::TLAS), VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr },
+    // The target image
+    { static_cast<uint32_t>(Bindings::TARGET_IMAGE), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr },
+    // The uniform buffer
+    { static_cast<uint32_t>(Bindings::UNIFORMS), VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
+    // Array of ObjectInfo, which contains materials and device addresses of indices and vertex attributes
+    { static_cast<uint32_t>(Bindings::OBJECT_INFOS), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
+    // Array of materials shared by objects
+    { static_cast<uint32_t>(Bindings::MATERIALS), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
+    // Textures
+    { static_cast<uint32_t>(Bindings::TEXTURES), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, uint32_t(MAX_NUM_TEXTURES), VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR, nullptr },
+    // Environment map
+    { static_cast<uint32_t>(Bindings::ENV_MAP), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_MISS_BIT_KHR, nullptr },
+    // Texture sizes requested by hits (for texture streaming)
+    { static_cast<uint32_t>(Bindings::TEXTURE_FEEDBACK), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, nullptr },
+    // First-hit normal and depth of this frame and the previous one, and the previous target image (for temporal reprojection)
+    { static_cast<uint32_t>(Bindings::GBUFFER), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr },
+    { static_cast<uint32_t>(Bindings::PREV_TARGET_IMAGE), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr },
+    { static_cast<uint32_t>(Bindings::PREV_GBUFFER), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr }
+  };
+  // If AOVs are written, add binding for the AOV image
+  if (writeAOVs) {
+    descriptorBindings.push_back(VkDescriptorSetLayoutBinding{ static_cast<uint32_t>(Bindings::AOV_IMAGE), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr });
+  }
+  // If algorithm is QMC, add binding for hammersley sequence
+  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
+    descriptorBindings.push_back(VkDescriptorSetLayoutBinding{ static_cast<uint32_t>(Bindings::HAMMERSLEY), VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR, nullptr });
+  }
+  descriptorLayout = vsg::DescriptorSetLayout::create(descriptorBindings);
+
+  // Create descriptors
+  createSceneDescriptors(objectInfo);
+
+  // Prepare descriptor for texture
+  auto emptyImageData = vsg::vec3Array2D::create(1, 1, vsg::Data::Layout{ VK_FORMAT_R32G32B32_SFLOAT });
+  auto emptyImage = vsg::Image::create(emptyImageData);
+  emptyImage->usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  emptyImage->format = VK_FORMAT_R32G32B32_SFLOAT;
+  emptyImage->tiling = VK_IMAGE_TILING_LINEAR;
+  vsg::ImageInfo emptyImageInfo(vsg::Sampler::create(), vsg::ImageView::create(emptyImage), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+  vsg::ImageInfoList imageInfoList(MAX_NUM_TEXTURES, emptyImageInfo);
+  std::copy(
+    scene->textures.cbegin(),
+    scene->textures.cbegin() + std::min(MAX_NUM_TEXTURES, scene->textures.size()),
+    imageInfoList.begin());
+  textureDescriptor = vsg::DescriptorImage::create(imageInfoList, static_cast<uint32_t>(Bindings::TEXTURES), 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+  // When algorithm is QMC, create a descriptor for low-discrepancy sequence
+  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
+    hammersley = vsg::floatArray::create(); // Actual content is set later (in setSamplesPerPixel)
+    hammersleyDescriptor = vsg::DescriptorBuffer::create(hammersley, static_cast<uint32_t>(Bindings::HAMMERSLEY), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);  // Binding 11
+  }
+
+  // Feedback buffer is read by TextureStreamer on CPU. Without streaming, shaders write into a buffer nobody reads
+  if (scene->textureStreamer) {
+    vsg::BufferInfoList feedbackBufferInfo{ vsg::BufferInfo(scene->textureStreamer->getFeedbackBuffer(), 0, scene->textureStreamer->getFeedbackBufferSize()) };
+    textureFeedbackDescriptor = vsg::DescriptorBuffer::create(feedbackBufferInfo, static_cast<uint32_t>(Bindings::TEXTURE_FEEDBACK), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  } else {
+    textureFeedbackDescriptor = vsg::DescriptorBuffer::create(vsg::uintArray::create(uint32_t(MAX_NUM_TEXTURES), 0), static_cast<uint32_t>(Bindings::TEXTURE_FEEDBACK), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  }
+
+  // Descriptors shared by descriptor sets of frames (images and uniforms of frames are added per frame)
+  sharedDescriptors = { tlasDescriptor, objectInfoDescriptor, materialDescriptor, textureDescriptor, envMapDescriptor, textureFeedbackDescriptor };
+  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
+    sharedDescriptors.push_back(hammersleyDescriptor);
+  }
+  if (writeAOVs) {
+    aovImageDescriptor = vsg::DescriptorImage::create(vsg::ImageInfo(nullptr, aovImageView, VK_IMAGE_LAYOUT_GENERAL), static_cast<uint32_t>(Bindings::AOV_IMAGE), 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    sharedDescriptors.push_back(aovImageDescriptor);
+  }
+  addFrame();
+  createDescriptorSets();
+
+  // Create ray tracing pipeline
+  vsg::PushConstantRanges pushConstantRanges{ { VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, sizeof(TileParams) } };
+  pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{ descriptorLayout }, pushConstantRanges);
+  rayTracingPipeline = CachedRayTracingPipeline::create(pipelineLayout, vsg::ShaderStages{}, vsg::RayTracingShaderGroups{});  // Shaders are set by updateHitGroups
+  updateHitGroups(*objectInfo);
+}
+
+void RayTracer::createSceneDescriptors(vsg::ref_ptr<vsg::Array<ObjectInfo>> objectInfo)
+{
+  // Materials are uploaded by trace commands (see UploadMaterialsCommand)
+  materials = scene->getMaterials();
+  materialBuffer = vsg::createBufferAndMemory(
+    device, materials->dataSize(),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  ++materialVersion;
+
+  tlasDescriptor = vsg::DescriptorAccelerationStructure::create(vsg::AccelerationStructures{ scene->tlas }, static_cast<uint32_t>(Bindings::TLAS), 0);
+  objectInfoDescriptor = vsg::DescriptorBuffer::create(objectInfo, static_cast<uint32_t>(Bindings::OBJECT_INFOS), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+  vsg::BufferInfoList materialBufferInfo{ vsg::BufferInfo(materialBuffer, 0, materials->dataSize()) };
+  materialDescriptor = vsg::DescriptorBuffer::create(materialBufferInfo, static_cast<uint32_t>(Bindings::MATERIALS), 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+  // The environment map is uploaded again only if it was replaced
+  if (!envMapDescriptor || scene->envMap != envMap) {
+    envMap = scene->envMap;
+    envMapDescriptor = vsg::DescriptorImage::create(
+      vsg::Sampler::create(),
+      envMap,
+      static_cast<uint32_t>(Bindings::ENV_MAP), 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  }
+}
+
+bool RayTracer::updateHitGroups(const vsg::Array<ObjectInfo>& objectInfo)
+{
+  // A hit group has a specialized closest-hit shader for a combination of primitive shape and material features used in the scene,
+  // and each primitive selects its hit group through its record in the shader binding table.
+  // Hit groups are never removed, so that a growing scene keeps the pipeline while it uses combinations seen before
+  auto hitGroupKey = [&](const ObjectInfo& info) {
+    return std::make_pair(info.shape, getMaterialFeatures(scene->getMaterial(info.materialId)));
+  };
+  bool added = false;
+  for (uint32_t i = 0; i < objectInfo.valueCount(); ++i) {
+    added |= hitGroupIndices.emplace(hitGroupKey(objectInfo.at(i)), 0).second;
+  }
+  if (hitGroupIndices.empty()) {
+    hitGroupIndices.emplace(std::make_pair(uint32_t(PrimitiveShape::TRIANGLES), 0u), 0);  // The pipeline needs at least one hit group
+    added = true;
+  }
+
+  if (added) {
+    auto shaderStages = vsg::ShaderStages{ rayGenerationShader, missShader, anyHitShader };
+    auto shaderGroups = vsg::RayTracingShaderGroups{ rayGenerationShaderGroup, missShaderGroup };
+    hitShaderGroups.clear();
+    for (auto& [key, hitGroupIdx] : hitGroupIndices) {
+      auto [shape, features] = key;
+      bool procedural = shape != uint32_t(PrimitiveShape::TRIANGLES);
+
+      auto specializedShader = vsg::ShaderStage::create(VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR, "main", (procedural ? proceduralClosestHitShader : closestHitShader)->module);
+      for (uint32_t constantId = 0; constantId < NUM_MATERIAL_FEATURES; ++constantId) {
+        specializedShader->specializationConstants[constantId] = vsg::uintValue::create((features >> constantId) & 1);  // As VkBool32
+      }
+      shaderStages.push_back(specializedShader);
+
+      auto hitShaderGroup = vsg::RayTracingShaderGroup::create();
+      hitShaderGroup->closestHitShader = uint32_t(shaderStages.size() - 1);  // Index in shaderStages
+      if (procedural) {
+        // Analytic shapes are opaque, so they have an intersection shader for the shape but no any-hit shader
+        auto shapeShader = vsg::ShaderStage::create(VK_SHADER_STAGE_INTERSECTION_BIT_KHR, "main", intersectionShader->module);
+        shapeShader->specializationConstants[0] = vsg::uintValue::create(shape);
+        shaderStages.push_back(shapeShader);
+
+        hitShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR;
+        hitShaderGroup->intersectionShader = uint32_t(shaderStages.size() - 1);
+      } else {
+        hitShaderGroup->type = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR;
+        hitShaderGroup->anyHitShader = 2;  // Only invoked for alpha-masked (non-opaque) instances
+      }
+
+      hitGroupIdx = uint32_t(hitShaderGroups.size());
+      hitShaderGroups.push_back(hitShaderGroup);
+      shaderGroups.push_back(hitShaderGroup);
+    }
+
+    rayTracingPipeline->shaderStages = shaderStages;
+    rayTracingPipeline->shaderGroups = shaderGroups;
+    rayTracingPipeline->release();
+  }
+
+  // Hit records are ordered as object infos (GeometryInstance::shaderOffset is set by RayTracingScene)
+  hitRecords.clear();
+  for (uint32_t i = 0; i < objectInfo.valueCount(); ++i) {
+    hitRecords.push_back(hitGroupIndices[hitGroupKey(objectInfo.at(i))]);
+  }
+  if (hitRecords.empty()) {
+    hitRecords.push_back(0);
+  }
+  for (auto& observer : traceRaysCommands) {
+    if (auto command = vsg::ref_ptr<TraceRaysWithHitGroups>(observer)) {
+      command->setHitGroups(uint32_t(hitShaderGroups.size()), hitRecords);
+    }
+  }
+
+  return added;
+}
+
+void RayTracer::addFrame()
+{
+  Frame frame;
+
+  // Create a target image for rendering
+  frame.targetImage = vsg::Image::create();
+  frame.targetImage->imageType = VK_IMAGE_TYPE_2D;
+  frame.targetImage->format = targetFormat; // By default 4-channel 32-bit float, which keeps radiance above 1
+  frame.targetImage->extent.width = screenSize.width;
+  frame.targetImage->extent.height = screenSize.height;
+  frame.targetImage->extent.depth = 1; // Because this is a 2D image, it has only one depth
+  frame.targetImage->mipLevels = 1; // No mipmap
+  frame.targetImage->arrayLayers = numViews; // One layer per view
+  frame.targetImage->samples = VK_SAMPLE_COUNT_1_BIT; // No multisampling
+  frame.targetImage->tiling = VK_IMAGE_TILING_OPTIMAL;  // Placed in optimal memory layout
+  frame.targetImage->usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  frame.targetImage->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  frame.targetImage->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  frame.targetImage->flags = 0;
+  // Create an image view as an array of color images (even with a single view, because the shader uses image2DArray)
+  frame.targetImageView = vsg::ImageView::create(frame.targetImage, VK_IMAGE_ASPECT_COLOR_BIT);
+  frame.targetImageView->viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+  frame.targetImageView->subresourceRange.layerCount = numViews;
+  frame.targetImageView->compile(device);
+
+  // G-buffer of the first view for temporal reprojection
+  auto gBufferImage = vsg::Image::create();
+  gBufferImage->imageType = VK_IMAGE_TYPE_2D;
+  gBufferImage->format = VK_FORMAT_R32G32B32A32_SFLOAT;
+  gBufferImage->extent = { screenSize.width, screenSize.height, 1 };
+  gBufferImage->mipLevels = 1;
+  gBufferImage->arrayLayers = 1;
+  gBufferImage->samples = VK_SAMPLE_COUNT_1_BIT;
+  gBufferImage->tiling = VK_IMAGE_TILING_OPTIMAL;
+  gBufferImage->usage = VK_IMAGE_USAGE_STORAGE_BIT;
+  gBufferImage->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  gBufferImage->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  gBufferImage->flags = 0;
+  frame.gBufferImageView = vsg::ImageView::create(gBufferImage, VK_IMAGE_ASPECT_COLOR_BIT);
+  frame.gBufferImageView->compile(device);
+
+  // Uniform buffer filled by UploadUniformsCommand
+  frame.uniformBuffer = vsg::createBufferAndMemory(
+    device, sizeof(RayTracingUniform),
+    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  frames.push_back(frame);
+}
+
+void RayTracer::createDescriptorSets()
+{
+  auto storageImageDescriptor = [](vsg::ref_ptr<vsg::ImageView> imageView, Bindings binding) {
+    return vsg::DescriptorImage::create(vsg::ImageInfo(nullptr, imageView, VK_IMAGE_LAYOUT_GENERAL), static_cast<uint32_t>(binding), 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  };
+
+  for (size_t i = 0; i < frames.size(); ++i) {
+    Frame& frame = frames[i];
+    const Frame& prevFrame = frames[(i + frames.size() - 1) % frames.size()];  // Itself when there is only one frame
+
+    vsg::BufferInfoList uniformBufferInfo{ vsg::BufferInfo(frame.uniformBuffer, 0, sizeof(RayTracingUniform)) };
+
+    // Combine descriptors into a descriptor set
+    vsg::Descriptors descriptors = sharedDescriptors;
+    descriptors.push_back(vsg::DescriptorBuffer::create(uniformBufferInfo, static_cast<uint32_t>(Bindings::UNIFORMS), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER));
+    descriptors.push_back(storageImageDescriptor(frame.targetImageView, Bindings::TARGET_IMAGE));
+    descriptors.push_back(storageImageDescriptor(frame.gBufferImageView, Bindings::GBUFFER));
+    descriptors.push_back(storageImageDescriptor(prevFrame.targetImageView, Bindings::PREV_TARGET_IMAGE));
+    descriptors.push_back(storageImageDescriptor(prevFrame.gBufferImageView, Bindings::PREV_GBUFFER));
+    frame.descriptorSet = vsg::DescriptorSet::create(descriptorLayout, descriptors);
+  }
+
+  if (scene->textureStreamer) {
+    std::vector<vsg::ref_ptr<vsg::DescriptorSet>> descriptorSets;
+    for (auto& f : frames) {
+      descriptorSets.push_back(f.descriptorSet);
+    }
+    scene->textureStreamer->setDescriptorSets(descriptorSets, static_cast<uint32_t>(Bindings::TEXTURES));
+  }
+}
+
+void RayTracer::advanceFrame()
+{
+  frameIndex = (frameIndex + 1) % uint32_t(frames.size());
+
+  // The first frame has no history. While history is accumulated, each frame traces different samples
+  RayTracingUniform& uniforms = uniformValue->value();
+  uniforms.maxHistorySamples = maxHistorySamples;
+  uniforms.historyValid = (numAdvancedFrames > 0 && frames.size() > 1) ? 1 : 0;
+  uniforms.randomSeed = (maxHistorySamples > 0) ? numAdvancedFrames : 0;
+  ++numAdvancedFrames;
+
+  // The timer uses queries of this frame, and remembers its samples per pixel
+  if (gpuTimer) {
+    gpuTimer->advanceFrame(uniforms.samplesPerPixel);
+  }
+}
+
+void RayTracer::setSamplesPerPixel(int samplesPerPixel)
+{
+  uniformValue->value().samplesPerPixel = uint32_t(samplesPerPixel);
+  tileParams->value().sampleCount = uint32_t(samplesPerPixel);
+
+  if (algorithm == SamplingAlgorithm::QUASI_MONTE_CARLO) {
+    // Generate low-discrepancy sequence for specified number of samples
+    int numElems = HAMMERSLEY_REPLICATIONS * SAMPLING_DIMENSIONS * samplesPerPixel;
+    hammersley->assign(numElems, (float*)malloc(numElems * sizeof(float)));
+    generateScrambledHammersley(SAMPLING_DIMENSIONS, samplesPerPixel, HAMMERSLEY_REPLICATIONS, hammersley);  // Fill data
+  }
+}
+
+void RayTracer::setCameraParams(const vsg::mat4& viewMat, const vsg::mat4& projectionMat, uint32_t view)
+{
+  if (view >= numViews) {
+    std::cerr << "View " << view << " is out of range (" << numViews << " views)" << std::endl;
+    return;
+  }
+
+  // The first camera of a view has no motion
+  vsg::mat4 viewProjectionMat = projectionMat * viewMat;
+  uniformValue->value().prevViewProjectionMat[view] = viewProjectionMats[view].value_or(viewProjectionMat);
+  viewProjectionMats[view] = viewProjectionMat;
+
+  uniformValue->value().invViewMat[view] = vsg::inverse(viewMat);
+  uniformValue->value().invProjectionMat[view] = vsg::inverse(projectionMat);
+  // Vertical field of view divided by number of pixels (see: T. Akenine-Moller et al., "Texture Level of Detail Strategies for Real-Time Ray Tracing," in Ray Tracing Gems, 2019)
+  // It is shared by all views, which are assumed to have the same field of view
+  uniformValue->value().pixelSpreadAngle = 2.0f * std::atan(1.0f / std::abs(projectionMat[1][1])) / float(tileParams->value().imageSize.y);
+}
+
+void RayTracer::resetCameraHistory()
+{
+  std::fill(viewProjectionMats.begin(), viewProjectionMats.end(), std::nullopt);
+}
+
+vsg::ref_ptr<vsg::CommandGraph> RayTracer::createCommandGraph(vsg::ref_ptr<vsg::Window> window)
+{
+  // The next frame can be recorded and uploaded while the GPU is still using resources of the previous one
+  while (frames.size() < NUM_FRAMES_IN_FLIGHT) {
+    addFrame();
+  }
+  createDescriptorSets();
+
+  // Prepare commands for ray tracing. Scene update commands are replaced by setScene
+  auto commands = vsg::Commands::create();
+  sceneUpdateCommands = createSceneUpdateCommands();
+  commands->addChild(SceneUpdateCommand::create(sceneUpdateCommands));
+  // Radiance and G-buffer written by the previous frame are read by temporal reprojection
+  auto historyBarrier = vsg::MemoryBarrier::create();
+  historyBarrier->srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  historyBarrier->dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  commands->addChild(vsg::PipelineBarrier::create(
+    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, 0, historyBarrier));
+  if (gpuTimer) {
+    commands->addChild(gpuTimer->createStartCommand());
+  }
+  commands->addChild(createTraceCommands(tileParams, screenSize.width, screenSize.height));
+  if (gpuTimer) {
+    commands->addChild(gpuTimer->createStopCommand());
+  }
+
+  // Convert radiance of each frame into display colors, and copy them into the window
+  std::vector<vsg::ref_ptr<vsg::Command>> toneMapCommands, copyCommands;
+  for (auto& frame : frames) {
+    auto toneMapper = ToneMapper::create(device, frame.targetImage, frame.targetImageView, screenSize.width, screenSize.height, toneMapParams);
+    toneMapCommands.push_back(toneMapper->createCommands());
+    copyCommands.push_back(vsg::CopyImageViewToWindow::create(toneMapper->getDisplayImageView(), window));
+  }
+  commands->addChild(FrameCommand::create(this, toneMapCommands));
+
+  // Command graph to render the result into the window
+  auto commandGraph = vsg::CommandGraph::create(window);
+  commandGraph->addChild(commands);
+  commandGraph->addChild(FrameCommand::create(this, copyCommands));  // Tone-mapped image is copied into window
+
+  return commandGraph;
+}
+
+vsg::ref_ptr<vsg::Commands> RayTracer::createSceneUpdateCommands()
+{
+  auto commands = vsg::Commands::create();
+  if (!scene->deformer->empty()) {
+    // Skinning and morph targets
+    commands->addChild(scene->deformer->createCommands(scene));
+  }
+  if (scene->tlas->allowUpdate) {
+    // Refit TLAS when instances were moved
+    commands->addChild(UpdateTopLevelAccelerationStructure::create(scene));
+  }
+  return commands;
+}
+
+void RayTracer::updateMaterials()
+{
+  if (!scene->materialsModified) {
+    return;
+  }
+
+  auto updated = scene->getMaterials();
+  std::copy(updated->begin(), updated->end(), materials->begin());
+  ++materialVersion;  // Uploaded by the next trace commands, so that frames in flight keep reading the previous materials
+  scene->materialsModified = false;
+}
+
+void RayTracer::setScene(vsg::ref_ptr<RayTracingScene> newScene, vsg::ref_ptr<vsg::Window> window)
+{
+  auto previousScene = scene;  // Frames in flight may still use it
+  scene = newScene;
+  auto objectInfo = scene->getObjectInfo();
+
+  // Build TLAS and upload buffers of the new scene while frames in flight still use the previous one
+  vsg::Descriptors previousDescriptors{ tlasDescriptor, objectInfoDescriptor, materialDescriptor, envMapDescriptor };
+  createSceneDescriptors(objectInfo);
+  vsg::Descriptors newDescriptors{ tlasDescriptor, objectInfoDescriptor, materialDescriptor, envMapDescriptor };
+
+  // Only textures added since the previous scene are written, so that textures streamed in are kept
+  size_t firstNewTexture = std::min(MAX_NUM_TEXTURES, previousScene->textures.size());
+  size_t numTextures = std::min(MAX_NUM_TEXTURES, scene->textures.size());
+  vsg::ref_ptr<vsg::DescriptorImage> newTextureDescriptor;
+  if (firstNewTexture < numTextures) {
+    vsg::ImageInfoList newTextures(scene->textures.cbegin() + firstNewTexture, scene->textures.cbegin() + numTextures);
+    std::copy(newTextures.begin(), newTextures.end(), textureDescriptor->imageInfoList.begin() + firstNewTexture);
+    newTextureDescriptor = vsg::DescriptorImage::create(newTextures, static_cast<uint32_t>(Bindings::TEXTURES), uint32_t(firstNewTexture), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+  }
+
+  auto compileTraversal = vsg::CompileTraversal::create(window);
+  auto& context = *compileTraversal->contexts.front();
+  for (auto& descriptor : newDescriptors) {
+    descriptor->compile(context);
+  }
+  if (newTextureDescriptor) {
+    newTextureDescriptor->compile(context);
+  }
+  context.record();
+  context.waitForCompletion();
+
+  // The pipeline, the shader binding table and descriptor sets may be used by frames in flight
+  vkDeviceWaitIdle(*device);
+
+  // The pipeline is created again (and reported by CachedRayTracingPipeline) only if hit groups were added
+  updateHitGroups(*objectInfo);
+  for (auto& observer : traceRaysCommands) {
+    if (auto command = vsg::ref_ptr<TraceRaysWithHitGroups>(observer)) {
+      command->compile(context);
+    }
+  }
+  if (sceneUpdateCommands) {
+    sceneUpdateCommands = createSceneUpdateCommands();
+    sceneUpdateCommands->compile(context);
+  }
+  context.record();
+  context.waitForCompletion();
+
+  // Rewrite replaced descriptors in descriptor sets of all frames
+  std::vector<vsg::ref_ptr<vsg::Descriptor>> writtenDescriptors;
+  for (size_t i = 0; i < newDescriptors.size(); ++i) {
+    if (newDescriptors[i] != previousDescriptors[i]) {
+      std::replace(sharedDescriptors.begin(), sharedDescriptors.end(), previousDescriptors[i], newDescriptors[i]);
+      writtenDescriptors.push_back(newDescriptors[i]);
+    }
+  }
+  if (newTextureDescriptor) {
+    writtenDescriptors.push_back(newTextureDescriptor);
+  }
+  std::vector<VkWriteDescriptorSet> writes;
+  for (auto& frame : frames) {
+    for (auto& descriptor : writtenDescriptors) {
+      VkWriteDescriptorSet write{};
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptor->assignTo(context, write);
+      write.dstSet = frame.descriptorSet->vk(device->deviceID);
+      writes.push_back(write);
+    }
+  }
+  vkUpdateDescriptorSets(*device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+}
+
+vsg::ref_ptr<vsg::Commands> RayTracer::createTraceCommands(vsg::ref_ptr<TileParamsValue> params, uint32_t width, uint32_t height, uint32_t numLaunchViews)
+{
+  auto commands = vsg::Commands::create();
+  commands->addChild(UploadUniformsCommand::create(this));
+  commands->addChild(UploadMaterialsCommand::create(this));
+  commands->addChild(BindCachedRayTracingPipeline::create(rayTracingPipeline));
+  std::vector<vsg::ref_ptr<vsg::Command>> bindCommands;
+  for (auto& frame : frames) {
+    bindCommands.push_back(vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, pipelineLayout, 0, frame.descriptorSet));
+  }
+  commands->addChild(FrameCommand::create(this, bindCommands));
+  commands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_RAYGEN_BIT_KHR, 0, params));
+  // Shader groups are ordered as raygen, miss and hit groups (see constructor)
+  auto traceRaysCommand = TraceRaysWithHitGroups::create(rayTracingPipeline, 0, 1, 2, uint32_t(hitShaderGroups.size()), hitRecords);
+  traceRaysCommand->width = width;
+  traceRaysCommand->height = height;
+  traceRaysCommand->depth = std::clamp(numLaunchViews, 1u, numViews); // gl_LaunchIDEXT.z selects the view
+  commands->addChild(traceRaysCommand);
+
+  // Commands released by callers are forgotten
+  traceRaysCommands.erase(
+    std::remove_if(traceRaysCommands.begin(), traceRaysCommands.end(), [](const vsg::observer_ptr<TraceRaysWithHitGroups>& observer) { return !observer.valid(); }),
+    traceRaysCommands.end());
+  traceRaysCommands.push_back(traceRaysCommand);
+  return commands;
+}
@@ -1,116 +1,478 @@
-#include <cassert>
-#include "RayTracingScene.h"
-#include "utils.h"
-
-RayTracingScene::RayTracingScene(vsg::Device* device)
-  : device(device), numIndices(0), numVertices(0)
-{
-  tlas = vsg::TopLevelAccelerationStructure::create(device);
-}
-
-uint32_t RayTracingScene::addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, vsg::ref_ptr<vsg::vec4Array> tangents, const RayTracingMaterial& material)
-{
-  // ID (index of a object)
-  uint32_t id = uint32_t(tlas->geometryInstances.size());
-
-  // Vertex positions and indices needed for acceleration structure
-  auto accelGeom = vsg::AccelerationGeometry::create();
-  accelGeom->verts = vertices;
-  accelGeom->indices = indices;
-  
-  // Create a Bottom-Level Acceleration Structure which represents a mesh object
-  auto blas = vsg::BottomLevelAccelerationStructure::create(device);
-  blas->geometries.push_back(accelGeom);
-  
-  // Create an instance of BLAS
-  auto instance = vsg::GeometryInstance::create();
-  instance->transform = transform;
-  instance->accelerationStructure = blas;
-  instance->id = id;
-  
-  // Add the instance into the TLAS
-  tlas->geometryInstances.push_back(instance);
-
-  // Store offset information
-  ObjectInfo info;
-  info.indexOffset = numIndices;
-  info.vertexOffset = numVertices;
-  info.material = material;
-  objectInfoList.push_back(info);
-
-  // Store indices and vertex attributes for closest-hit shader
-  indicesList.push_back(indices);
-  verticesList.push_back(vertices);
-  normalsList.push_back(normals);
-  texCoordsList.push_back(texCoords);
-  tangentsList.push_back(tangents);
-
-  // Count indices and vertex attributes for offsets
-  numIndices += uint32_t(indices->valueCount());
-  numVertices += uint32_t(vertices->valueCount());
-
-  assert(tlas->geometryInstances.size() == objectInfoList.size());
-  assert(tlas->geometryInstances.size() == indicesList.size());
-  assert(tlas->geometryInstances.size() == verticesList.size());
-  assert(tlas->geometryInstances.size() == normalsList.size());
-  assert(tlas->geometryInstances.size() == texCoordsList.size());
-  assert(tlas->geometryInstances.size() == tangentsList.size());
-
-  return id;
-}
-
-uint32_t RayTracingScene::addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, const RayTracingMaterial& material)
-{
-  auto tangents = vsg::vec4Array::create(vertices->valueCount()); // Create tangent data with default value of vec4
-  return addMesh(transform, indices, vertices, normals, texCoords, tangents, material);
-}
-
-uint32_t RayTracingScene::addTexture(const vsg::ImageInfo& imageInfo)
-{
-  textures.push_back(imageInfo);
-
-  return uint32_t(textures.size() - 1);
-}
-
-uint32_t RayTracingScene::addTexture(vsg::ref_ptr<vsg::Data> imageData, vsg::ref_ptr<vsg::Sampler> sampler)
-{
-  auto image = vsg::Image::create(imageData);
-  image->usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-  image->tiling = VK_IMAGE_TILING_LINEAR;
-
-  auto imageView = vsg::ImageView::create(image);
-
-  return addTexture(vsg::ImageInfo(sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
-}
-
-vsg::ref_ptr<vsg::Array<ObjectInfo>> RayTracingScene::getObjectInfo() const
-{
-  auto arr = vsg::Array<ObjectInfo>::create(uint32_t(objectInfoList.size()));
-  std::copy(objectInfoList.begin(), objectInfoList.end(), arr->begin());
-  return arr;
-}
-
-vsg::ref_ptr<vsg::ushortArray> RayTracingScene::getIndices() const
-{
-  return concatArray(indicesList);
-}
-
-vsg::ref_ptr<vsg::vec3Array> RayTracingScene::getVertices() const
-{
-  return concatArray(verticesList);
-}
-
-vsg::ref_ptr<vsg::vec3Array> RayTracingScene::getNormals() const
-{
-  return concatArray(normalsList);
-}
-
-vsg::ref_ptr<vsg::vec2Array> RayTracingScene::getTexCoords() const
-{
-  return concatArray(texCoordsList);
-}
-
-vsg::ref_ptr<vsg::vec4Array> RayTracingScene::getTangents() const
-{
-  return concatArray(tangentsList);
-}
+#include <cassert>
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <tuple>
+#include <vsg/maths/transform.h>
+#include <vsg/all.h>
+#include "RayTracingScene.h"
+#include "utils.h"
+
+const VkDeviceSize GEOMETRY_ALIGNMENT = 16; // Alignment of each array in the buffer of PrimitiveGeometry (default buffer_reference_align)
+
+static VkDeviceSize alignGeometrySize(VkDeviceSize size)
+{
+  return (size + GEOMETRY_ALIGNMENT - 1) / GEOMETRY_ALIGNMENT * GEOMETRY_ALIGNMENT;
+}
+
+PrimitiveGeometry::PrimitiveGeometry(const MeshPrimitive& primitive)
+  : indices(primitive.indices), vertices(primitive.vertices), normals(primitive.normals), texCoords(primitive.texCoords), tangents(primitive.tangents)
+{
+}
+
+VkDeviceSize PrimitiveGeometry::dataSize() const
+{
+  VkDeviceSize size = 0;
+  for (auto& data : arrays()) {
+    size += alignGeometrySize(data->dataSize());
+  }
+  return size;
+}
+
+std::pair<vsg::ref_ptr<vsg::Buffer>, VkDeviceSize> GeometryBufferPool::allocate(VkDeviceSize size)
+{
+  if (!block || blockUsed + size > blockSize) {
+    // The rest of the current block is left unused
+    blockSize = std::max(BLOCK_SIZE, size);
+    blockUsed = 0;
+    // Deformable meshes are also written by the compute shader of MeshDeformer
+    block = vsg::createBufferAndMemory(
+      device, blockSize,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+
+  VkDeviceSize offset = blockUsed;
+  blockUsed += size;
+  return { block, offset };
+}
+
+void PrimitiveGeometry::setAddresses(ObjectInfo& info) const
+{
+  assert(buffer);
+
+  VkDeviceAddress* targets[] = { &info.indices, &info.vertices, &info.normals, &info.texCoords, &info.tangents };
+  VkDeviceAddress arrayAddress = address;
+  auto data = arrays();
+  for (size_t i = 0; i < data.size(); ++i) {
+    *targets[i] = arrayAddress;
+    arrayAddress += alignGeometrySize(data[i]->dataSize());
+  }
+}
+
+RayTracingScene::RayTracingScene(vsg::Device* device)
+  : device(device)
+{
+  tlas = DynamicTopLevelAccelerationStructure::create(device);
+  deformer = MeshDeformer::create(device);
+  geometryPool = GeometryBufferPool::create(device);
+}
+
+uint32_t RayTracingScene::addMesh(const vsg::mat4& transform, const std::vector<MeshPrimitive>& primitives)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  assert(!primitives.empty());
+
+  // ID (index of a instance)
+  uint32_t id = uint32_t(tlas->geometryInstances.size());
+
+  // Create a Bottom-Level Acceleration Structure which represents a mesh object
+  auto blas = DynamicBottomLevelAccelerationStructure::create(device);
+  blas->buildPreference = blasBuildPreference;
+  blas->allowCompaction = compactBLAS;
+
+  // Create an instance of BLAS
+  auto instance = vsg::GeometryInstance::create();
+  instance->transform = transform;
+  instance->accelerationStructure = blas;
+  instance->id = uint32_t(objectInfoList.size());  // Used as instance custom index, which points to the object info of the first primitive
+  instance->shaderOffset = instance->id;  // Hit records are ordered as object infos (see RayTracer::updateHitGroups)
+
+  for (auto& primitive : primitives) {
+    // Vertex positions and indices needed for acceleration structure. Geometry index in BLAS is the index in primitives
+    auto accelGeom = vsg::AccelerationGeometry::create();
+    accelGeom->verts = primitive.vertices;
+    accelGeom->indices = primitive.indices;
+    blas->geometries.push_back(accelGeom);
+
+    // Geometries are built with VK_GEOMETRY_OPAQUE_BIT_KHR, so that only alpha-masked instances invoke the any-hit shader.
+    // The any-hit shader accepts hits on opaque primitives of the same instance immediately
+    assert(primitive.materialId < materialList.size());
+    if (materialList[primitive.materialId].alphaMode == AlphaMode::Mask) {
+      instance->flags |= VK_GEOMETRY_INSTANCE_FORCE_NO_OPAQUE_BIT_KHR;
+    }
+
+    // Indices and vertex attributes for closest-hit shader are uploaded later (see uploadGeometry)
+    ObjectInfo info{};
+    info.materialId = primitive.materialId;
+    info.shape = uint32_t(PrimitiveShape::TRIANGLES);
+    objectInfoList.push_back(info);
+    geometryList.push_back(PrimitiveGeometry::create(primitive));
+  }
+
+  // Add the instance into the TLAS
+  tlas->geometryInstances.push_back(instance);
+
+  assert(objectInfoList.size() == geometryList.size());
+
+  return id;
+}
+
+uint32_t RayTracingScene::addShape(const vsg::mat4& transform, PrimitiveShape shape, uint32_t materialId)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  assert(shape != PrimitiveShape::TRIANGLES);
+  assert(materialId < materialList.size());
+
+  uint32_t id = uint32_t(tlas->geometryInstances.size());
+
+  auto& blas = shapeBLASes[shape];
+  if (!blas) {
+    blas = ProceduralBottomLevelAccelerationStructure::create(device, shape);
+    blas->buildPreference = blasBuildPreference;
+    blas->allowCompaction = compactBLAS;
+  }
+
+  auto instance = vsg::GeometryInstance::create();
+  instance->transform = transform;
+  instance->accelerationStructure = blas;
+  instance->id = uint32_t(objectInfoList.size());
+  instance->shaderOffset = instance->id;
+
+  ObjectInfo info{};
+  info.materialId = materialId;
+  info.shape = uint32_t(shape);
+  objectInfoList.push_back(info);
+  geometryList.push_back(vsg::ref_ptr<PrimitiveGeometry>());
+
+  tlas->geometryInstances.push_back(instance);
+
+  return id;
+}
+
+uint32_t RayTracingScene::addInstance(uint32_t id, const vsg::mat4& transform, std::optional<uint32_t> materialId)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  assert(id < tlas->geometryInstances.size());
+  assert(!materialId || materialId.value() < materialList.size());
+
+  auto& source = tlas->geometryInstances[id];
+  auto blas = source->accelerationStructure.cast<vsg::BottomLevelAccelerationStructure>();
+  uint32_t numPrimitives = blas.cast<ProceduralBottomLevelAccelerationStructure>() ? 1 : uint32_t(blas->geometries.size());
+
+  auto instance = vsg::GeometryInstance::create();
+  instance->transform = transform;
+  instance->accelerationStructure = source->accelerationStructure;
+  instance->flags = source->flags;
+  instance->id = uint32_t(objectInfoList.size());
+  instance->shaderOffset = instance->id;
+
+  // Object infos are copied, so that the instance can have its own materials and hit groups
+  for (uint32_t i = 0; i < numPrimitives; ++i) {
+    ObjectInfo info = objectInfoList[source->id + i];
+    if (materialId) {
+      info.materialId = materialId.value();
+    }
+    objectInfoList.push_back(info);
+    geometryList.push_back(geometryList[source->id + i]);
+  }
+  if (materialId && materialList[materialId.value()].alphaMode == AlphaMode::Mask) {
+    instance->flags |= VK_GEOMETRY_INSTANCE_FORCE_NO_OPAQUE_BIT_KHR;
+  }
+
+  tlas->geometryInstances.push_back(instance);
+
+  return uint32_t(tlas->geometryInstances.size() - 1);
+}
+
+uint32_t RayTracingScene::addSphere(const vsg::vec3& center, float radius, uint32_t materialId)
+{
+  return addShape(vsg::translate(center) * vsg::scale(radius), PrimitiveShape::SPHERE, materialId);
+}
+
+uint32_t RayTracingScene::addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, vsg::ref_ptr<vsg::vec4Array> tangents, uint32_t materialId)
+{
+  return addMesh(transform, { MeshPrimitive{ indices, vertices, normals, texCoords, tangents, materialId } });
+}
+
+uint32_t RayTracingScene::addMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, uint32_t materialId)
+{
+  auto tangents = vsg::vec4Array::create(vertices->valueCount()); // Create tangent data with default value of vec4
+  return addMesh(transform, indices, vertices, normals, texCoords, tangents, materialId);
+}
+
+uint32_t RayTracingScene::addDeformableMesh(const vsg::mat4& transform, vsg::ref_ptr<vsg::ushortArray> indices, vsg::ref_ptr<vsg::vec3Array> vertices, vsg::ref_ptr<vsg::vec3Array> normals, vsg::ref_ptr<vsg::vec2Array> texCoords, vsg::ref_ptr<vsg::vec4Array> tangents, uint32_t materialId, const MeshDeformation& deformation)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  uint32_t id = addMesh(transform, indices, vertices, normals, texCoords, tangents, materialId);
+
+  auto blas = tlas->geometryInstances[id]->accelerationStructure.cast<DynamicBottomLevelAccelerationStructure>();
+  blas->allowCompaction = false;
+  deformer->addMesh(id, blas, indices, vertices, normals, tangents, deformation);
+
+  // TLAS has to follow the refitted BLAS
+  tlas->allowUpdate = true;
+
+  return id;
+}
+
+void RayTracingScene::setInstanceTransform(uint32_t id, const vsg::mat4& transform)
+{
+  assert(id < tlas->geometryInstances.size());
+
+  // Animations set every animated node each frame, so only flag an update when the instance actually moved
+  auto& instanceTransform = tlas->geometryInstances[id]->transform;
+  vsg::mat4 current(instanceTransform);
+  if (std::equal(transform.data(), transform.data() + 16, current.data())) {
+    return;
+  }
+  instanceTransform = transform;
+  transformsModified = true;
+}
+
+void RayTracingScene::setMeshBuildPreference(uint32_t id, AccelerationStructureBuildPreference preference)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  assert(id < tlas->geometryInstances.size());
+
+  auto blas = tlas->geometryInstances[id]->accelerationStructure.cast<DynamicBottomLevelAccelerationStructure>();
+  assert(!blas->compiled());
+  assert(!blas.cast<ProceduralBottomLevelAccelerationStructure>());
+  blas->buildPreference = preference;
+}
+
+uint32_t RayTracingScene::addMaterial(const RayTracingMaterial& material)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  materialList.push_back(material);
+
+  return uint32_t(materialList.size() - 1);
+}
+
+void RayTracingScene::setMaterial(uint32_t id, const RayTracingMaterial& material)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  assert(id < materialList.size());
+  assert(getMaterialFeatures(material) == getMaterialFeatures(materialList[id]));
+  assert(material.alphaMode == materialList[id].alphaMode);
+
+  materialList[id] = material;
+  materialsModified = true;
+}
+
+uint32_t RayTracingScene::addTexture(const vsg::ImageInfo& imageInfo)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  textures.push_back(imageInfo);
+
+  return uint32_t(textures.size() - 1);
+}
+
+uint32_t RayTracingScene::addTexture(vsg::ref_ptr<vsg::Data> imageData, vsg::ref_ptr<vsg::Sampler> sampler)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  if (textureStreamer) {
+    imageData = textureStreamer->addTexture(uint32_t(textures.size()), imageData, sampler);
+  }
+
+  auto image = vsg::Image::create(imageData);
+  image->usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  image->tiling = VK_IMAGE_TILING_LINEAR;
+
+  auto imageView = vsg::ImageView::create(image);
+
+  return addTexture(vsg::ImageInfo(sampler, imageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL));
+}
+
+uint32_t RayTracingScene::addTexture(uint64_t contentKey, vsg::ref_ptr<vsg::Data> imageData, vsg::ref_ptr<vsg::Sampler> sampler, const std::vector<int>& samplerState)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  uint32_t id = addTexture(imageData, sampler);
+  textureContentCache.emplace(contentKey, CachedTexture{ id, imageData, samplerState });
+
+  return id;
+}
+
+std::optional<uint32_t> RayTracingScene::findTexture(uint64_t contentKey, const vsg::Data& imageData, const std::vector<int>& samplerState)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  // The key is only a hash, therefore textures with the same key are compared with the image
+  auto [first, last] = textureContentCache.equal_range(contentKey);
+  for (auto it = first; it != last; ++it) {
+    const CachedTexture& cached = it->second;
+    const vsg::Data& cachedData = *cached.imageData;
+    if (cachedData.width() != imageData.width() || cachedData.height() != imageData.height()
+      || cachedData.getLayout().format != imageData.getLayout().format || cachedData.dataSize() != imageData.dataSize()
+      || cached.samplerState != samplerState
+      || std::memcmp(cachedData.dataPointer(), imageData.dataPointer(), imageData.dataSize()) != 0) {
+      continue;
+    }
+
+    // Size of what is actually uploaded for the shared texture (a proxy if it is streamed)
+    const vsg::ImageInfo& texture = textures[cached.id];
+    if (texture.imageView && texture.imageView->image && texture.imageView->image->data) {
+      deduplicatedTextureBytes += texture.imageView->image->data->dataSize();
+    }
+    return cached.id;
+  }
+
+  return std::nullopt;
+}
+
+VkDeviceSize RayTracingScene::getDeduplicatedTextureBytes() const
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  return deduplicatedTextureBytes;
+}
+
+vsg::ref_ptr<RayTracingScene> RayTracingScene::createSnapshot() const
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  auto snapshot = RayTracingScene::create(device);
+
+  // Instances are copied because TLAS is built from them, but BLASes are shared
+  for (auto& instance : tlas->geometryInstances) {
+    auto copied = vsg::GeometryInstance::create();
+    copied->id = instance->id;
+    copied->mask = instance->mask;
+    copied->shaderOffset = instance->shaderOffset;
+    copied->flags = instance->flags;
+    copied->transform = instance->transform;
+    copied->accelerationStructure = instance->accelerationStructure;
+    snapshot->tlas->geometryInstances.push_back(copied);
+  }
+
+  snapshot->objectInfoList = objectInfoList;
+  snapshot->geometryList = geometryList;
+  snapshot->geometryPool = geometryPool;
+  snapshot->materialList = materialList;
+  snapshot->shapeBLASes = shapeBLASes;
+
+  snapshot->textures = textures;
+  snapshot->textureContentCache = textureContentCache;
+  snapshot->deduplicatedTextureBytes = deduplicatedTextureBytes;
+  snapshot->textureStreamer = textureStreamer;
+  snapshot->envMap = envMap;
+
+  return snapshot;
+}
+
+uint32_t RayTracingScene::numInstances() const
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  return uint32_t(tlas->geometryInstances.size());
+}
+
+void RayTracingScene::setEnvMap(vsg::ref_ptr<vsg::Data> data)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  envMap = data;
+}
+
+void RayTracingScene::uploadGeometry(vsg::CommandPool* commandPool, vsg::Queue* queue)
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  // Geometry shared by instances or uploaded through a snapshot is skipped
+  std::vector<PrimitiveGeometry*> newGeometries;
+  std::set<PrimitiveGeometry*> visited;
+  VkDeviceSize stagingSize = 0;
+  for (auto& geometry : geometryList) {
+    if (geometry && !geometry->buffer && visited.insert(geometry.get()).second) {
+      newGeometries.push_back(geometry.get());
+      stagingSize += geometry->dataSize();
+    }
+  }
+  if (newGeometries.empty()) {
+    return;
+  }
+
+  // All new geometry is packed into one staging buffer and copied by one submission
+  auto stagingBuffer = vsg::createBufferAndMemory(
+    device, stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  auto stagingMemory = stagingBuffer->getDeviceMemory(device->deviceID);
+  void* mappedData;
+  stagingMemory->map(stagingBuffer->getMemoryOffset(device->deviceID), stagingSize, 0, &mappedData);
+  VkDeviceSize offset = 0;
+  for (auto geometry : newGeometries) {
+    for (auto& data : geometry->arrays()) {
+      std::memcpy(static_cast<char*>(mappedData) + offset, data->dataPointer(), data->dataSize());
+      offset += alignGeometrySize(data->dataSize());
+    }
+  }
+  stagingMemory->unmap();
+
+  // Ranges of a few large buffers, whose offsets keep the alignment of arrays
+  for (auto geometry : newGeometries) {
+    std::tie(geometry->buffer, geometry->offset) = geometryPool->allocate(geometry->dataSize());
+    geometry->address = getBufferDeviceAddress(device, geometry->buffer) + geometry->offset;
+  }
+
+  vsg::submitCommandsToQueue(device, commandPool, queue, [&](vsg::CommandBuffer& commandBuffer) {
+    VkDeviceSize srcOffset = 0;
+    for (auto geometry : newGeometries) {
+      VkBufferCopy region{ srcOffset, geometry->offset, geometry->dataSize() };
+      vkCmdCopyBuffer(commandBuffer, stagingBuffer->vk(device->deviceID), geometry->buffer->vk(device->deviceID), 1, &region);
+      srcOffset += geometry->dataSize();
+    }
+
+    // Geometry is read by ray tracing shaders and written by deformation in later submissions
+    VkMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+      0, 1, &barrier, 0, nullptr, 0, nullptr);
+  });
+}
+
+vsg::ref_ptr<vsg::Array<ObjectInfo>> RayTracingScene::getObjectInfo() const
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  auto arr = vsg::Array<ObjectInfo>::create(uint32_t(objectInfoList.size()));
+  for (size_t i = 0; i < objectInfoList.size(); ++i) {
+    ObjectInfo info = objectInfoList[i];
+    if (geometryList[i]) {
+      geometryList[i]->setAddresses(info);
+    }
+    arr->at(i) = info;
+  }
+  return arr;
+}
+
+vsg::ref_ptr<vsg::Array<RayTracingMaterial>> RayTracingScene::getMaterials() const
+{
+  // The buffer cannot be empty
+  auto arr = vsg::Array<RayTracingMaterial>::create(uint32_t(std::max(materialList.size(), size_t(1))));
+  std::copy(materialList.begin(), materialList.end(), arr->begin());
+  return arr;
+}
+
+VkDeviceSize RayTracingScene::getAttributeBufferSize() const
+{
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+
+  VkDeviceSize size = objectInfoList.size() * sizeof(ObjectInfo) + std::max(materialList.size(), size_t(1)) * sizeof(RayTracingMaterial);
+  std::set<PrimitiveGeometry*> visited;
+  for (auto& geometry : geometryList) {
+    if (geometry && visited.insert(geometry.get()).second) {
+      size += geometry->dataSize();
+    }
+  }
+  return size;
+}
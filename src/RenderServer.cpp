@@ -0,0 +1,157 @@
+#include "RenderServer.h"
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vsg/all.h>
+#include "tiny_gltf.h"  // For nlohmann::json bundled with tinygltf
+
+using nlohmann::json;
+
+const int64_t MAX_IMAGE_SIZE = 16384;  // Width and height above this are rejected (common maxImageDimension2D)
+
+RenderServer::RenderServer(vsg::ref_ptr<RayTracer> rayTracer, vsg::ref_ptr<TiledRenderer> tiledRenderer, const RenderJob& defaultJob)
+  : rayTracer(rayTracer), tiledRenderer(tiledRenderer), defaultJob(defaultJob)
+{
+}
+
+void RenderServer::run(std::istream& input, std::ostream& output)
+{
+  std::string line;
+  while (std::getline(input, line)) {
+    if (line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue; // Empty line
+    }
+
+    json result;
+    std::string error;
+    auto job = parseJob(line, error);
+    if (!job) {
+      result["status"] = "error";
+      result["error"] = error;
+    } else {
+      auto startTime = std::chrono::high_resolution_clock::now();
+      bool succeeded = render(job.value());
+      std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+
+      if (job->views.size() == 1) {
+        result["output"] = job->views[0].output;
+      } else {
+        std::vector<std::string> outputs;
+        for (const auto& view : job->views) {
+          outputs.push_back(view.output);
+        }
+        result["output"] = outputs;
+      }
+      result["status"] = succeeded ? "ok" : "error";
+      if (!succeeded) {
+        result["error"] = "Cannot write the output";
+      }
+      result["milliseconds"] = elapsed.count();
+    }
+
+    // One line per job, flushed so that clients can wait for it
+    output << result.dump() << std::endl;
+  }
+}
+
+std::optional<RenderJob> RenderServer::parseJob(const std::string& line, std::string& error) const
+{
+  json params = json::parse(line, nullptr, false);
+  if (params.is_discarded() || !params.is_object()) {
+    error = "Invalid JSON";
+    return std::nullopt;
+  }
+
+  RenderJob job = defaultJob;
+  try {
+    auto readVec3 = [&](const json& object, const char* key, vsg::dvec3& value) {
+      if (object.contains(key)) {
+        auto arr = object.at(key).get<std::vector<double>>();
+        if (arr.size() != 3) {
+          throw std::runtime_error(std::string(key) + " must have 3 elements");
+        }
+        value = vsg::dvec3(arr[0], arr[1], arr[2]);
+      }
+    };
+    auto readView = [&](const json& object) {
+      if (!object.is_object()) {
+        throw std::runtime_error("views must be objects");
+      }
+      RenderView view = defaultJob.views.front();
+      readVec3(object, "camera", view.cameraPos);
+      readVec3(object, "lookat", view.lookAtPos);
+      readVec3(object, "up", view.cameraUp);
+      view.output = object.value("output", view.output);
+      return view;
+    };
+
+    // Either a list of views, or a single view given by keys of the job itself
+    job.views.clear();
+    if (params.contains("views")) {
+      if (!params.at("views").is_array()) {
+        throw std::runtime_error("views must be an array");
+      }
+      for (const auto& view : params.at("views")) {
+        job.views.push_back(readView(view));
+      }
+    } else {
+      job.views.push_back(readView(params));
+    }
+
+    // Counts are read as signed integers, because a negative value would wrap around as uint32_t
+    auto readCount = [&](const char* key, uint32_t& value, int64_t maxValue) {
+      int64_t count = params.value(key, int64_t(value));
+      if (count <= 0 || count > maxValue) {
+        throw std::runtime_error(std::string(key) + " must be between 1 and " + std::to_string(maxValue));
+      }
+      value = uint32_t(count);
+    };
+
+    job.fov = params.value("fov", job.fov);
+    readCount("width", job.width, MAX_IMAGE_SIZE);
+    readCount("height", job.height, MAX_IMAGE_SIZE);
+    readCount("samples", job.samplesPerPixel, UINT32_MAX);
+    readCount("batch_samples", job.samplesPerBatch, UINT32_MAX);
+    job.time = params.value("time", job.time);
+  } catch (const std::exception& e) {
+    error = e.what();
+    return std::nullopt;
+  }
+
+  if (job.views.empty() || job.views.size() > rayTracer->getNumViews()) {
+    error = "Number of views must be between 1 and " + std::to_string(rayTracer->getNumViews());
+    return std::nullopt;
+  }
+  for (const auto& view : job.views) {
+    if (view.output.empty()) {
+      error = "output is not specified";
+      return std::nullopt;
+    }
+  }
+  return job;
+}
+
+bool RenderServer::render(const RenderJob& job)
+{
+  // Motion vectors of a job must not refer to cameras of the previous one
+  rayTracer->resetCameraHistory();
+
+  vsg::dmat4 projectionMat;
+  vsg::Perspective::create(job.fov, double(job.width) / double(job.height), 0.1, 1000.0)->get(projectionMat);
+
+  std::vector<std::string> outputs;
+  for (uint32_t i = 0; i < job.views.size(); ++i) {
+    const RenderView& view = job.views[i];
+    vsg::dmat4 viewMat;
+    vsg::LookAt::create(view.cameraPos, view.lookAtPos, view.cameraUp)->get(viewMat);
+    rayTracer->setCameraParams(viewMat, projectionMat, i);
+    outputs.push_back(view.output);
+  }
+
+  if (animation) {
+    animation->update(job.time);
+  }
+
+  return tiledRenderer->render(outputs, job.width, job.height, job.samplesPerPixel, job.samplesPerBatch);
+}
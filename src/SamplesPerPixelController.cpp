@@ -0,0 +1,34 @@
+#include "SamplesPerPixelController.h"
+
+#include <algorithm>
+#include <cmath>
+
+SamplesPerPixelController::SamplesPerPixelController(double targetMilliseconds, uint32_t initialSamplesPerPixel, uint32_t minSamplesPerPixel, uint32_t maxSamplesPerPixel)
+  : targetMilliseconds(targetMilliseconds),
+    samplesPerPixel(std::clamp(initialSamplesPerPixel, minSamplesPerPixel, maxSamplesPerPixel)),
+    minSamplesPerPixel(minSamplesPerPixel), maxSamplesPerPixel(maxSamplesPerPixel),
+    millisecondsPerSample(-1.0)
+{
+}
+
+uint32_t SamplesPerPixelController::update(double frameMilliseconds, uint32_t frameSamplesPerPixel)
+{
+  // Frame time is assumed to be proportional to samples per pixel
+  double measured = frameMilliseconds / std::max(frameSamplesPerPixel, 1u);
+  if (millisecondsPerSample < 0.0) {
+    millisecondsPerSample = measured;
+  } else {
+    millisecondsPerSample = smoothing * measured + (1.0 - smoothing) * millisecondsPerSample;
+  }
+
+  // Keep current value while frame time is inside the band
+  if (std::abs(frameMilliseconds - targetMilliseconds) <= tolerance * targetMilliseconds) {
+    return samplesPerPixel;
+  }
+
+  // Aim at the center of the band
+  double desired = std::floor(targetMilliseconds / std::max(millisecondsPerSample, 1e-6));
+  samplesPerPixel = uint32_t(std::clamp(desired, double(minSamplesPerPixel), double(maxSamplesPerPixel)));
+
+  return samplesPerPixel;
+}
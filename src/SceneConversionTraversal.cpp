@@ -1,56 +1,66 @@
-#include "SceneConversionTraversal.h"
-
-#include <cassert>
-#include <cstdint>
-#include <algorithm>
-#include "RayTracingMaterialGroup.h"
-#include "utils.h"
-
-SceneConversionTraversal::SceneConversionTraversal(vsg::Device* device)
-  : device(device), materialStack({ RayTracingMaterial { vsg::vec3(1.0, 1.0, 1.0) } })
-{
-  scene = RayTracingScene::create(device);
-}
-
-void SceneConversionTraversal::apply(vsg::Object& object)
-{
-  object.traverse(*this);
-}
-
-void SceneConversionTraversal::apply(vsg::MatrixTransform& transform)
-{
-  matrixStack.pushAndPostMult(transform.matrix);
-  transform.traverse(*this);
-  matrixStack.pop();
-}
-
-void SceneConversionTraversal::apply(vsg::Geometry& geometry)
-{
-  scene->addMesh(
-    matrixStack.top(),
-    geometry.indices.cast<vsg::ushortArray>(),
-    geometry.arrays[0].cast<vsg::vec3Array>(),
-    geometry.arrays[1].cast<vsg::vec3Array>(),
-    geometry.arrays[2].cast<vsg::vec2Array>(),
-    materialStack.top());
-}
-
-void SceneConversionTraversal::apply(vsg::VertexIndexDraw& vertexIndexDraw)
-{
-  scene->addMesh(
-    matrixStack.top(),
-    vertexIndexDraw.indices.cast<vsg::ushortArray>(),
-    vertexIndexDraw.arrays[0].cast<vsg::vec3Array>(),
-    vertexIndexDraw.arrays[1].cast<vsg::vec3Array>(),
-    vertexIndexDraw.arrays[2].cast<vsg::vec2Array>(),
-    materialStack.top());
-}
-
-void SceneConversionTraversal::apply(RayTracingMaterialGroup& rtMatGroup)
-{
-  materialStack.push(rtMatGroup.material);
-
-  rtMatGroup.traverse(*this);
-
-  materialStack.pop();
-}
+#include "SceneConversionTraversal.h"
+
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include "RayTracingMaterialGroup.h"
+#include "utils.h"
+
+SceneConversionTraversal::SceneConversionTraversal(vsg::Device* device)
+  : device(device)
+{
+  scene = RayTracingScene::create(device);
+  materialStack.push(scene->addMaterial(RayTracingMaterial{ vsg::vec3(1.0, 1.0, 1.0) }));
+}
+
+void SceneConversionTraversal::apply(vsg::Object& object)
+{
+  object.traverse(*this);
+}
+
+void SceneConversionTraversal::apply(vsg::MatrixTransform& transform)
+{
+  matrixStack.pushAndPostMult(transform.matrix);
+  transform.traverse(*this);
+  matrixStack.pop();
+}
+
+void SceneConversionTraversal::apply(vsg::Geometry& geometry)
+{
+  scene->addMesh(
+    matrixStack.top(),
+    geometry.indices.cast<vsg::ushortArray>(),
+    geometry.arrays[0].cast<vsg::vec3Array>(),
+    geometry.arrays[1].cast<vsg::vec3Array>(),
+    geometry.arrays[2].cast<vsg::vec2Array>(),
+    materialStack.top());
+}
+
+void SceneConversionTraversal::apply(vsg::VertexIndexDraw& vertexIndexDraw)
+{
+  scene->addMesh(
+    matrixStack.top(),
+    vertexIndexDraw.indices.cast<vsg::ushortArray>(),
+    vertexIndexDraw.arrays[0].cast<vsg::vec3Array>(),
+    vertexIndexDraw.arrays[1].cast<vsg::vec3Array>(),
+    vertexIndexDraw.arrays[2].cast<vsg::vec2Array>(),
+    materialStack.top());
+}
+
+void SceneConversionTraversal::apply(ProceduralShape& shape)
+{
+  scene->addShape(matrixStack.top() * shape.transform, shape.shape, materialStack.top());
+}
+
+void SceneConversionTraversal::apply(RayTracingMaterialGroup& rtMatGroup)
+{
+  auto materialId = materialIds.find(&rtMatGroup);
+  if (materialId == materialIds.end()) {
+    materialId = materialIds.emplace(&rtMatGroup, scene->addMaterial(rtMatGroup.material)).first;
+  }
+  materialStack.push(materialId->second);
+
+  rtMatGroup.traverse(*this);
+
+  materialStack.pop();
+}
@@ -0,0 +1,185 @@
+#include "StressSceneGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <optional>
+#include <vsg/core/Array2D.h>
+#include <vsg/maths/transform.h>
+#include <vsg/state/Sampler.h>
+
+const uint32_t MAX_STRESS_TEXTURES = 32;  // This must agree with MAX_NUM_TEXTURES in RayTracer.h
+const uint32_t STRESS_TEXTURE_SIZE = 256;
+const uint32_t MAX_TRIANGLES_PER_MESH = 120000; // Vertices of the grid stay below 65536
+const float INSTANCE_SPACING = 3.0f;  // Average distance between instances
+const float EMISSIVE_INTENSITY = 4.0f;
+
+float StressSceneGenerator::random()
+{
+  // Xorshift, so that scenes do not depend on the standard library
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return float(randomState >> 8) / float(1 << 24);
+}
+
+MeshData StressSceneGenerator::createMesh(uint32_t numTriangles)
+{
+  // Grid of quads in spherical coordinate, with twice as many columns as rows
+  uint32_t rows = std::max(2u, uint32_t(std::sqrt(numTriangles / 4.0) + 0.5));
+  uint32_t cols = std::max(3u, (numTriangles + 2 * rows - 1) / (2 * rows));
+  uint32_t numVertices = (rows + 1) * (cols + 1);  // Seam vertices are duplicated for texture coordinates
+
+  // Radius is modulated by waves with integer frequencies, which vanish at the poles and meet at the seam
+  float amplitude = 0.05f + 0.25f * random();
+  float thetaFrequency = float(1 + uint32_t(random() * 8.0f));
+  float phiFrequency = float(1 + uint32_t(random() * 8.0f));
+
+  MeshData mesh;
+  mesh.vertices = vsg::vec3Array::create(numVertices);
+  mesh.normals = vsg::vec3Array::create(numVertices);
+  mesh.texCoords = vsg::vec2Array::create(numVertices);
+  mesh.indices = vsg::ushortArray::create(6 * rows * cols);
+
+  for (uint32_t i = 0; i <= rows; ++i) {
+    float v = float(i) / rows;
+    float theta = vsg::PIf * v;
+    for (uint32_t j = 0; j <= cols; ++j) {
+      float u = float(j) / cols;
+      float phi = 2.0f * vsg::PIf * u;
+
+      float radius = 1.0f + amplitude * std::sin(thetaFrequency * theta) * std::sin(phiFrequency * phi);
+      uint32_t vertexId = (cols + 1) * i + j;
+      mesh.vertices->set(vertexId, radius * vsg::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta)));
+      mesh.normals->set(vertexId, vsg::vec3(0.0f, 0.0f, 0.0f));
+      mesh.texCoords->set(vertexId, vsg::vec2(u, v));
+    }
+  }
+
+  uint32_t index = 0;
+  for (uint32_t i = 0; i < rows; ++i) {
+    for (uint32_t j = 0; j < cols; ++j) {
+      uint16_t v00 = uint16_t((cols + 1) * i + j);
+      uint16_t v01 = uint16_t(v00 + 1);
+      uint16_t v10 = uint16_t(v00 + cols + 1);
+      uint16_t v11 = uint16_t(v10 + 1);
+      for (uint16_t vertexId : { v00, v10, v11, v00, v11, v01 }) {
+        mesh.indices->set(index++, vertexId);
+      }
+    }
+  }
+
+  // Area-weighted vertex normals
+  for (uint32_t t = 0; t < mesh.indices->valueCount(); t += 3) {
+    uint16_t idx0 = mesh.indices->at(t), idx1 = mesh.indices->at(t + 1), idx2 = mesh.indices->at(t + 2);
+    vsg::vec3 faceNormal = vsg::cross(mesh.vertices->at(idx1) - mesh.vertices->at(idx0), mesh.vertices->at(idx2) - mesh.vertices->at(idx0));
+    for (uint16_t idx : { idx0, idx1, idx2 }) {
+      mesh.normals->at(idx) += faceNormal;
+    }
+  }
+  for (uint32_t v = 0; v < numVertices; ++v) {
+    vsg::vec3& normal = mesh.normals->at(v);
+    normal = (vsg::length(normal) > 0.0f) ? vsg::normalize(normal) : vsg::normalize(mesh.vertices->at(v));
+  }
+
+  mesh.tangents = vsg::vec4Array::create(numVertices);  // Normal maps are not used
+  return mesh;
+}
+
+void StressSceneGenerator::generate(RayTracingScene* scene)
+{
+  auto startTime = std::chrono::high_resolution_clock::now();
+  randomState = std::max(seed, 1u);  // Xorshift state cannot be zero
+
+  // Checkerboard textures
+  numGeneratedTextures = std::min(numTextures, MAX_STRESS_TEXTURES);
+  if (numGeneratedTextures < numTextures) {
+    std::cerr << "Stress scene is limited to " << MAX_STRESS_TEXTURES << " textures" << std::endl;
+  }
+  std::vector<uint32_t> textureIds;
+  for (uint32_t t = 0; t < numGeneratedTextures; ++t) {
+    vsg::ubvec4 colors[2];
+    for (auto& color : colors) {
+      color = vsg::ubvec4(uint8_t(255 * random()), uint8_t(255 * random()), uint8_t(255 * random()), 255);
+    }
+    uint32_t cellSize = 8u << uint32_t(random() * 3.0f);
+
+    auto image = vsg::ubvec4Array2D::create(STRESS_TEXTURE_SIZE, STRESS_TEXTURE_SIZE, vsg::Data::Layout{ VK_FORMAT_R8G8B8A8_UNORM });
+    for (uint32_t y = 0; y < STRESS_TEXTURE_SIZE; ++y) {
+      for (uint32_t x = 0; x < STRESS_TEXTURE_SIZE; ++x) {
+        image->set(x, y, colors[(x / cellSize + y / cellSize) % 2]);
+      }
+    }
+    textureIds.push_back(scene->addTexture(image, vsg::Sampler::create()));
+  }
+
+  // Materials. The first ones are emissive
+  uint32_t materialCount = std::max(numMaterials, 1u);
+  numEmissiveMaterials = std::min(materialCount, uint32_t(std::ceil(emissiveFraction * materialCount)));
+  std::vector<uint32_t> materialIds;
+  for (uint32_t m = 0; m < materialCount; ++m) {
+    RayTracingMaterial material;
+    material.color = vsg::vec3(random(), random(), random());
+    material.metallic = (random() < 0.3f) ? 1.0f : 0.0f;
+    material.roughness = random();
+    if (!textureIds.empty()) {
+      material.colorTextureIdx = int32_t(textureIds[m % textureIds.size()]);
+    }
+    if (m < numEmissiveMaterials) {
+      material.emissive = EMISSIVE_INTENSITY * material.color;
+    }
+    materialIds.push_back(scene->addMaterial(material));
+  }
+
+  // Unique meshes. Each becomes a separate BLAS shared by its instances
+  uint32_t meshCount = std::max(numMeshes, 1u);
+  uint32_t meshTriangles = std::clamp(trianglesPerMesh, 1u, MAX_TRIANGLES_PER_MESH);
+  if (meshTriangles < trianglesPerMesh) {
+    std::cerr << "Stress scene meshes are limited to " << MAX_TRIANGLES_PER_MESH << " triangles" << std::endl;
+  }
+  std::vector<MeshData> meshes;
+  uniqueTriangles = 0;
+  for (uint32_t m = 0; m < meshCount; ++m) {
+    meshes.push_back(createMesh(meshTriangles));
+    uniqueTriangles += meshes.back().indices->valueCount() / 3;
+  }
+
+  // Instances scattered with random rotation and scale. Later instances of a mesh share geometry with the first one
+  float cubeSize = INSTANCE_SPACING * std::cbrt(float(numInstances));
+  std::vector<std::optional<uint32_t>> firstInstances(meshCount);
+  instancedTriangles = 0;
+  for (uint32_t i = 0; i < numInstances; ++i) {
+    uint32_t meshIdx = i % meshCount;
+    const MeshData& mesh = meshes[meshIdx];
+
+    vsg::vec3 position = cubeSize * (vsg::vec3(random(), random(), random()) - vsg::vec3(0.5f, 0.5f, 0.5f));
+    vsg::vec3 axis = vsg::vec3(random(), random(), random()) - vsg::vec3(0.5f, 0.5f, 0.5f);
+    if (vsg::length(axis) < 1e-3f) {
+      axis = vsg::vec3(0.0f, 1.0f, 0.0f);
+    }
+    float angle = 2.0f * vsg::PIf * random();
+    float scale = 0.5f + random();
+    vsg::mat4 transform = vsg::translate(position) * vsg::rotate(angle, vsg::normalize(axis)) * vsg::scale(scale);
+
+    uint32_t materialId = materialIds[uint32_t(random() * materialCount) % materialCount];
+    if (firstInstances[meshIdx]) {
+      scene->addInstance(firstInstances[meshIdx].value(), transform, materialId);
+    } else {
+      firstInstances[meshIdx] = scene->addMesh(transform, mesh.indices, mesh.vertices, mesh.normals, mesh.texCoords, mesh.tangents, materialId);
+    }
+    instancedTriangles += mesh.indices->valueCount() / 3;
+  }
+
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+  milliseconds = elapsed.count();
+}
+
+void StressSceneGenerator::report(std::ostream& stream) const
+{
+  stream << "Stress scene (" << milliseconds << " ms):" << std::endl;
+  stream << "  instances: " << numInstances << " of " << std::max(numMeshes, 1u) << " meshes" << std::endl;
+  stream << "  triangles: " << uniqueTriangles << " unique, " << instancedTriangles << " instanced" << std::endl;
+  stream << "  textures: " << numGeneratedTextures << std::endl;
+  stream << "  materials: " << std::max(numMaterials, 1u) << " (" << numEmissiveMaterials << " emissive)" << std::endl;
+}
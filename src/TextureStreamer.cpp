@@ -0,0 +1,367 @@
+#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vsg/all.h>
+#include "utils.h"
+
+const uint32_t MAX_NUM_FEEDBACK_TEXTURES = 32;  // This must agree with MAX_NUM_TEXTURES in RayTracer.h and common.glsl
+
+TextureStreamer::TextureStreamer(vsg::ref_ptr<vsg::Window> window, VkDeviceSize memoryBudget)
+  : window(window), memoryBudget(memoryBudget)
+{
+  feedbackBufferSize = MAX_NUM_FEEDBACK_TEXTURES * sizeof(uint32_t);
+  feedbackBuffer = createHostVisibleBuffer(window->getOrCreateDevice(), vsg::uintArray::create(MAX_NUM_FEEDBACK_TEXTURES, 0), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+  // Contexts have their own command pools, therefore the worker thread can record uploads while the viewer renders
+  uploadTraversal = vsg::CompileTraversal::create(window);
+
+  worker = std::thread(&TextureStreamer::workerLoop, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  condition.notify_all();
+  worker.join();
+}
+
+vsg::ref_ptr<vsg::Data> TextureStreamer::addTexture(uint32_t textureIdx, vsg::ref_ptr<vsg::Data> source, vsg::ref_ptr<vsg::Sampler> sampler)
+{
+  // Smallest level whose larger dimension fits in PROXY_SIZE
+  uint32_t proxyLevel = 0;
+  while (std::max(source->width(), source->height()) >> proxyLevel > PROXY_SIZE) {
+    ++proxyLevel;
+  }
+
+  std::lock_guard<std::mutex> lock(texturesMutex);
+  if (textures.size() <= textureIdx) {
+    textures.resize(textureIdx + 1);
+  }
+  Texture& texture = textures[textureIdx];
+  texture.source = source;
+  texture.sampler = sampler;
+  texture.proxyLevel = texture.residentLevel = texture.requestedLevel = proxyLevel;
+
+  residentSize += levelSize(texture, proxyLevel);
+
+  return downsampleImage(source, proxyLevel);
+}
+
+void TextureStreamer::setDescriptorSets(const std::vector<vsg::ref_ptr<vsg::DescriptorSet>>& newDescriptorSets, uint32_t newTextureBinding)
+{
+  std::lock_guard<std::mutex> lock(texturesMutex);
+
+  frameDescriptorSets.clear();
+  for (auto& descriptorSet : newDescriptorSets) {
+    frameDescriptorSets.push_back({ descriptorSet, {}, {}, {} });
+  }
+  textureBinding = newTextureBinding;
+
+  for (auto& texture : textures) {
+    if (!texture.source) {
+      continue;
+    }
+    residentSize = residentSize - levelSize(texture, texture.residentLevel) + levelSize(texture, texture.proxyLevel);
+    texture.residentLevel = texture.requestedLevel = texture.proxyLevel;
+  }
+}
+
+VkDeviceSize TextureStreamer::levelSize(const Texture& texture, uint32_t level) const
+{
+  VkDeviceSize width = std::max(1u, texture.source->width() >> level);
+  VkDeviceSize height = std::max(1u, texture.source->height() >> level);
+  return width * height * texture.source->valueSize();
+}
+
+void TextureStreamer::update(uint32_t frameIndex, vsg::ref_ptr<vsg::Fence> frameFence)
+{
+  if (frameDescriptorSets.empty()) {
+    return;
+  }
+
+  ++frameCount;
+
+  std::lock_guard<std::mutex> texturesLock(texturesMutex);
+
+  frameDescriptorSets[frameIndex % frameDescriptorSets.size()].fence = frameFence;
+
+  vsg::Device* device = window->getOrCreateDevice();
+
+  // Requested texture sizes written by hit shaders. Frames in flight may still be writing, which only delays requests
+  std::vector<uint32_t> requestedSizes(MAX_NUM_FEEDBACK_TEXTURES);
+  auto memory = feedbackBuffer->getDeviceMemory(device->deviceID);
+  void* mappedData;
+  memory->map(feedbackBuffer->getMemoryOffset(device->deviceID), feedbackBufferSize, 0, &mappedData);
+  std::memcpy(requestedSizes.data(), mappedData, feedbackBufferSize);
+  std::memset(mappedData, 0, feedbackBufferSize);
+  memory->unmap();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (uint32_t i = 0; i < textures.size() && i < MAX_NUM_FEEDBACK_TEXTURES; ++i) {
+      Texture& texture = textures[i];
+      if (!texture.source) {
+        continue;
+      }
+
+      if (requestedSizes[i] > 0) {
+        texture.lastUsedFrame = frameCount;
+
+        // Coarsest level which still has the requested number of texels
+        uint32_t largerDimension = std::max(texture.source->width(), texture.source->height());
+        uint32_t level = 0;
+        while (level < texture.proxyLevel && (largerDimension >> (level + 1)) >= requestedSizes[i]) {
+          ++level;
+        }
+
+        // Request only finer levels. Coarser ones are handled by eviction
+        if (level < texture.residentLevel && level != texture.requestedLevel) {
+          texture.requestedLevel = level;
+          pendingJobs.push_back({ i, level, {} });
+        }
+      } else if (texture.residentLevel != texture.proxyLevel && texture.requestedLevel != texture.proxyLevel
+        && frameCount - texture.lastUsedFrame > EVICTION_FRAMES) {
+        // Evict a cold texture back to its proxy
+        texture.requestedLevel = texture.proxyLevel;
+        pendingJobs.push_back({ i, texture.proxyLevel, {} });
+      }
+    }
+  }
+  condition.notify_one();
+
+  // Apply finished jobs within the budget
+  std::deque<Job> jobs;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    jobs.swap(finishedJobs);
+  }
+  std::deque<Job> deferredJobs;
+  std::vector<Job> evictionJobs;
+  for (auto& job : jobs) {
+    Texture& texture = textures[job.textureIdx];
+    if (job.level != texture.requestedLevel) {
+      continue; // Outdated request
+    }
+
+    VkDeviceSize newResidentSize = residentSize - levelSize(texture, texture.residentLevel) + levelSize(texture, job.level);
+    if (newResidentSize > memoryBudget && job.level < texture.residentLevel) {
+      // Memory of textures being evicted is counted as freed, because their proxies are being uploaded
+      VkDeviceSize evictedSize = 0;
+      std::vector<uint32_t> candidates;
+      for (uint32_t i = 0; i < textures.size(); ++i) {
+        const Texture& other = textures[i];
+        if (i == job.textureIdx || !other.source || other.residentLevel >= other.proxyLevel) {
+          continue;
+        }
+        if (other.requestedLevel == other.proxyLevel) {
+          evictedSize += levelSize(other, other.residentLevel) - levelSize(other, other.proxyLevel);
+        } else {
+          candidates.push_back(i);
+        }
+      }
+
+      // Make room by evicting the least recently used textures
+      std::sort(candidates.begin(), candidates.end(), [&](uint32_t a, uint32_t b) { return textures[a].lastUsedFrame < textures[b].lastUsedFrame; });
+      for (uint32_t i : candidates) {
+        if (newResidentSize - evictedSize <= memoryBudget || textures[i].lastUsedFrame >= texture.lastUsedFrame) {
+          break;
+        }
+        Texture& victim = textures[i];
+        evictedSize += levelSize(victim, victim.residentLevel) - levelSize(victim, victim.proxyLevel);
+        victim.requestedLevel = victim.proxyLevel;
+        evictionJobs.push_back({ i, victim.proxyLevel, {} });
+      }
+
+      if (newResidentSize - evictedSize > memoryBudget) {
+        // Not enough memory. The texture stays at its current level until it is requested again
+        texture.requestedLevel = texture.residentLevel;
+        continue;
+      }
+
+      // Applied in a later frame once the evictions are finished
+      deferredJobs.push_back(job);
+      continue;
+    }
+
+    replaceTexture(job.textureIdx, job.level, job.imageInfo);
+  }
+
+  if (!deferredJobs.empty() || !evictionJobs.empty()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      finishedJobs.insert(finishedJobs.begin(), deferredJobs.begin(), deferredJobs.end());
+      pendingJobs.insert(pendingJobs.end(), evictionJobs.begin(), evictionJobs.end());
+    }
+    condition.notify_one();
+  }
+
+  for (auto& frameDescriptorSet : frameDescriptorSets) {
+    writePendingImages(frameDescriptorSet);
+  }
+}
+
+void TextureStreamer::replaceTexture(uint32_t textureIdx, uint32_t level, const vsg::ImageInfo& imageInfo)
+{
+  Texture& texture = textures[textureIdx];
+
+  // Each descriptor set is written once the frames using it are finished
+  for (auto& frameDescriptorSet : frameDescriptorSets) {
+    frameDescriptorSet.pendingImages[textureIdx] = imageInfo;
+  }
+
+  residentSize = residentSize - levelSize(texture, texture.residentLevel) + levelSize(texture, level);
+  texture.residentLevel = texture.requestedLevel = level;
+}
+
+void TextureStreamer::writePendingImages(FrameDescriptorSet& frameDescriptorSet)
+{
+  if (frameDescriptorSet.pendingImages.empty() || (frameDescriptorSet.fence && frameDescriptorSet.fence->status() != VK_SUCCESS)) {
+    return;
+  }
+
+  vsg::Device* device = window->getOrCreateDevice();
+
+  std::vector<VkDescriptorImageInfo> vkImageInfos;
+  vkImageInfos.reserve(frameDescriptorSet.pendingImages.size());  // Pointed by writes
+  std::vector<VkWriteDescriptorSet> writes;
+  for (auto& [textureIdx, imageInfo] : frameDescriptorSet.pendingImages) {
+    VkDescriptorImageInfo vkImageInfo{};
+    vkImageInfo.sampler = imageInfo.sampler->vk(device->deviceID);
+    vkImageInfo.imageView = imageInfo.imageView->vk(device->deviceID);
+    vkImageInfo.imageLayout = imageInfo.imageLayout;
+    vkImageInfos.push_back(vkImageInfo);
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = frameDescriptorSet.descriptorSet->vk(device->deviceID);
+    write.dstBinding = textureBinding;
+    write.dstArrayElement = textureIdx;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &vkImageInfos.back();
+    writes.push_back(write);
+  }
+  vkUpdateDescriptorSets(*device, uint32_t(writes.size()), writes.data(), 0, nullptr);
+
+  // Images previously bound to this set are released here
+  for (auto& [textureIdx, imageInfo] : frameDescriptorSet.pendingImages) {
+    frameDescriptorSet.boundImages[textureIdx] = imageInfo;
+  }
+  frameDescriptorSet.pendingImages.clear();
+}
+
+void TextureStreamer::workerLoop()
+{
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [this] { return quit || !pendingJobs.empty(); });
+      if (quit) {
+        return;
+      }
+      job = pendingJobs.front();
+      pendingJobs.pop_front();
+    }
+
+    // Source images are never modified, therefore they can be read without the lock
+    vsg::ref_ptr<vsg::Data> source;
+    vsg::ref_ptr<vsg::Sampler> sampler;
+    {
+      std::lock_guard<std::mutex> texturesLock(texturesMutex);
+      source = textures[job.textureIdx].source;
+      sampler = textures[job.textureIdx].sampler;
+    }
+
+    auto image = vsg::Image::create(downsampleImage(source, job.level));
+    image->usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image->tiling = VK_IMAGE_TILING_LINEAR;
+    job.imageInfo = vsg::ImageInfo(sampler, vsg::ImageView::create(image), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    // Upload the image in the same way as descriptors of RayTracer, waiting only for this submission (vsg::Queue serializes it with the viewer)
+    auto descriptor = vsg::DescriptorImage::create(job.imageInfo, 0, 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    for (auto& context : uploadTraversal->contexts) {
+      descriptor->compile(*context);
+      context->record();
+      context->waitForCompletion();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    finishedJobs.push_back(job);
+  }
+}
+
+vsg::ref_ptr<vsg::Data> downsampleImage(vsg::ref_ptr<vsg::Data> source, uint32_t level)
+{
+  if (level == 0) {
+    return source;
+  }
+
+  VkFormat format = source->getLayout().format;
+  uint32_t width = std::max(1u, source->width() >> level);
+  uint32_t height = std::max(1u, source->height() >> level);
+  uint32_t factor = 1u << level;
+
+  vsg::ref_ptr<vsg::Data> result;
+  uint32_t numComp;
+  bool isFloat;
+  switch (format) {
+  case VK_FORMAT_R8_UNORM: result = vsg::ubyteArray2D::create(width, height, vsg::Data::Layout{ format }); numComp = 1; isFloat = false; break;
+  case VK_FORMAT_R8G8_UNORM: result = vsg::ubvec2Array2D::create(width, height, vsg::Data::Layout{ format }); numComp = 2; isFloat = false; break;
+  case VK_FORMAT_R8G8B8_UNORM: result = vsg::ubvec3Array2D::create(width, height, vsg::Data::Layout{ format }); numComp = 3; isFloat = false; break;
+  case VK_FORMAT_R8G8B8A8_UNORM: result = vsg::ubvec4Array2D::create(width, height, vsg::Data::Layout{ format }); numComp = 4; isFloat = false; break;
+  case VK_FORMAT_R32_SFLOAT: result = vsg::floatArray2D::create(width, height, vsg::Data::Layout{ format }); numComp = 1; isFloat = true; break;
+  case VK_FORMAT_R32G32_SFLOAT: result = vsg::vec2Array2D::create(width, height, vsg::Data::Layout{ format }); numComp = 2; isFloat = true; break;
+  case VK_FORMAT_R32G32B32_SFLOAT: result = vsg::vec3Array2D::create(width, height, vsg::Data::Layout{ format }); numComp = 3; isFloat = true; break;
+  case VK_FORMAT_R32G32B32A32_SFLOAT: result = vsg::vec4Array2D::create(width, height, vsg::Data::Layout{ format }); numComp = 4; isFloat = true; break;
+  default:
+    return source;  // Unsupported format is kept at full resolution
+  }
+
+  uint32_t sourceWidth = source->width();
+  uint32_t sourceHeight = source->height();
+  auto sourceBytes = static_cast<const uint8_t*>(source->dataPointer());
+  auto resultBytes = static_cast<uint8_t*>(result->dataPointer());
+
+  std::vector<float> sum(numComp);
+  for (uint32_t y = 0; y < height; ++y) {
+    for (uint32_t x = 0; x < width; ++x) {
+      std::fill(sum.begin(), sum.end(), 0.0f);
+      uint32_t count = 0;
+      for (uint32_t sy = y * factor; sy < std::min((y + 1) * factor, sourceHeight); ++sy) {
+        for (uint32_t sx = x * factor; sx < std::min((x + 1) * factor, sourceWidth); ++sx) {
+          size_t pixel = size_t(sy) * sourceWidth + sx;
+          for (uint32_t c = 0; c < numComp; ++c) {
+            if (isFloat) {
+              float value;
+              std::memcpy(&value, sourceBytes + (pixel * numComp + c) * sizeof(float), sizeof(float));
+              sum[c] += value;
+            } else {
+              sum[c] += float(sourceBytes[pixel * numComp + c]);
+            }
+          }
+          ++count;
+        }
+      }
+
+      size_t pixel = size_t(y) * width + x;
+      for (uint32_t c = 0; c < numComp; ++c) {
+        float mean = sum[c] / float(std::max(count, 1u));
+        if (isFloat) {
+          std::memcpy(resultBytes + (pixel * numComp + c) * sizeof(float), &mean, sizeof(float));
+        } else {
+          resultBytes[pixel * numComp + c] = uint8_t(std::lround(mean));
+        }
+      }
+    }
+  }
+
+  return result;
+}
@@ -0,0 +1,297 @@
+#include "TiledRenderer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <utility>
+#include <vector>
+#include <vsg/all.h>
+#include "utils.h"
+
+// EXR images are kept in host memory until all tiles are finished, because tinyexr writes a whole image at once.
+// Channels of all EXR outputs of a render must fit in this size (tinyexr needs about as much again while writing)
+const uint64_t MAX_EXR_IMAGE_BYTES = uint64_t(4) << 30;
+
+// Files with .exr extension receive raw radiance instead of tone-mapped colors
+static bool isEXRPath(const std::string& path)
+{
+  if (path.size() < 4) {
+    return false;
+  }
+  std::string extension = path.substr(path.size() - 4);
+  std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+  return extension == ".exr";
+}
+
+// Channels of AOVs in EXR files
+struct AOVChannel
+{
+  const char* name;
+  AOVLayers layer;
+  int component;
+};
+static const AOVChannel AOV_CHANNELS[] = {
+  { "normal.X", AOVLayers::NORMAL_DEPTH, 0 },
+  { "normal.Y", AOVLayers::NORMAL_DEPTH, 1 },
+  { "normal.Z", AOVLayers::NORMAL_DEPTH, 2 },
+  { "depth.Z", AOVLayers::NORMAL_DEPTH, 3 },
+  { "albedo.R", AOVLayers::ALBEDO_ROUGHNESS, 0 },
+  { "albedo.G", AOVLayers::ALBEDO_ROUGHNESS, 1 },
+  { "albedo.B", AOVLayers::ALBEDO_ROUGHNESS, 2 },
+  { "roughness", AOVLayers::ALBEDO_ROUGHNESS, 3 },
+  { "motion.X", AOVLayers::MOTION_METALLIC, 0 },
+  { "motion.Y", AOVLayers::MOTION_METALLIC, 1 },
+  { "metallic", AOVLayers::MOTION_METALLIC, 2 },
+  { "instanceId", AOVLayers::IDS, 0 },
+  { "materialId", AOVLayers::IDS, 1 }
+};
+
+TiledRenderer::TiledRenderer(vsg::ref_ptr<vsg::Window> window, vsg::ref_ptr<RayTracer> rayTracer, uint32_t tileSize)
+  : window(window), rayTracer(rayTracer), tileSize(tileSize)
+{
+  vsg::Device* device = window->getOrCreateDevice();
+
+  int queueFamily = device->getPhysicalDevice()->getQueueFamily(VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+  commandPool = vsg::CommandPool::create(device, queueFamily);
+  queue = device->getQueue(queueFamily);
+
+  // One RGBA32F tile per view, followed by AOV layers of all views
+  uint32_t layersPerView = rayTracer->getAOVImage() ? 1 + NUM_AOV_LAYERS : 1;
+  readbackBuffer = vsg::createBufferAndMemory(
+    device, VkDeviceSize(tileSize) * tileSize * rayTracer->getNumViews() * layersPerView * sizeof(vsg::vec4),
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  tileParams = TileParamsValue::create();
+}
+
+bool TiledRenderer::render(const std::string& path, uint32_t width, uint32_t height, uint32_t samplesPerPixel, uint32_t samplesPerBatch)
+{
+  return render(std::vector<std::string>{ path }, width, height, samplesPerPixel, samplesPerBatch);
+}
+
+bool TiledRenderer::render(const std::vector<std::string>& paths, uint32_t width, uint32_t height, uint32_t samplesPerPixel, uint32_t samplesPerBatch)
+{
+  vsg::Device* device = window->getOrCreateDevice();
+  samplesPerBatch = std::max(1u, std::min(samplesPerBatch, samplesPerPixel));
+
+  uint32_t numViews = uint32_t(paths.size());
+  if (numViews == 0 || numViews > rayTracer->getNumViews()) {
+    std::cerr << "Cannot render " << numViews << " views at once (at most " << rayTracer->getNumViews() << ")" << std::endl;
+    return false;
+  }
+
+  vsg::ref_ptr<vsg::Image> aovImage = rayTracer->getAOVImage();
+
+  uint64_t numEXRChannels = 0;
+  for (const auto& path : paths) {
+    if (isEXRPath(path)) {
+      numEXRChannels += aovImage ? 3 + std::size(AOV_CHANNELS) : 3;
+    }
+  }
+  uint64_t exrImageBytes = uint64_t(width) * height * numEXRChannels * sizeof(float);
+  if (exrImageBytes > MAX_EXR_IMAGE_BYTES) {
+    std::cerr << "EXR outputs of " << width << "x" << height << " need " << (exrImageBytes >> 20) << " MiB of memory (at most " << (MAX_EXR_IMAGE_BYTES >> 20) << " MiB)" << std::endl;
+    return false;
+  }
+
+  // Binary PPM (P6). Rows are written from top to bottom, so the files can be written while rendering.
+  // EXR images (with AOVs if the ray tracer writes them) are kept in memory and written after all tiles are finished (see MAX_EXR_IMAGE_BYTES)
+  std::vector<std::ofstream> files(numViews);
+  std::vector<std::vector<EXRChannel>> exrImages(numViews);
+  for (uint32_t view = 0; view < numViews; ++view) {
+    if (isEXRPath(paths[view])) {
+      std::vector<std::string> names{ "R", "G", "B" };
+      if (aovImage) {
+        for (const auto& channel : AOV_CHANNELS) {
+          names.push_back(channel.name);
+        }
+      }
+      for (const auto& name : names) {
+        exrImages[view].push_back({ name, std::vector<float>(size_t(width) * height) });
+      }
+      continue;
+    }
+    files[view].open(paths[view], std::ios::binary);
+    if (!files[view]) {
+      std::cerr << "Cannot open " << paths[view] << std::endl;
+      return false;
+    }
+    files[view] << "P6\n" << width << " " << height << "\n255\n";
+  }
+
+  rayTracer->setSamplesPerPixel(int(samplesPerPixel));
+
+  tileParams->value().imageSize = vsg::uivec2(width, height);
+
+  // Compile commands (including descriptors and acceleration structures) created by this render
+  vsg::ref_ptr<vsg::CompileTraversal> compileTraversal;
+  auto compileCommands = [&](vsg::ref_ptr<vsg::Commands> commands) {
+    if (!compileTraversal) {
+      compileTraversal = vsg::CompileTraversal::create(window);
+    }
+    commands->accept(*compileTraversal);
+    for (auto& context : compileTraversal->contexts) {
+      context->record();
+      context->waitForCompletion();
+    }
+  };
+  if (!sceneUpdateCommands || sceneUpdateScene != rayTracer->scene) {
+    sceneUpdateCommands = rayTracer->createSceneUpdateCommands();
+    sceneUpdateScene = rayTracer->scene;
+    compileCommands(sceneUpdateCommands);
+  }
+
+  vsg::ref_ptr<vsg::Image> targetImage = rayTracer->getTargetImage();
+  VkImage vkTargetImage = targetImage->vk(device->deviceID);
+  // Images written by the launch
+  std::vector<VkImage> vkImages{ vkTargetImage };
+  if (aovImage) {
+    vkImages.push_back(aovImage->vk(device->deviceID));
+  }
+
+  // Rows of the images under rendering (one band per view)
+  std::vector<std::vector<uint8_t>> bands(numViews, std::vector<uint8_t>(size_t(width) * tileSize * 3));
+
+  bool sceneUpdated = false;
+  for (uint32_t tileY = 0; tileY < height; tileY += tileSize) {
+    uint32_t tileHeight = std::min(tileSize, height - tileY);
+
+    for (uint32_t tileX = 0; tileX < width; tileX += tileSize) {
+      uint32_t tileWidth = std::min(tileSize, width - tileX);
+
+      auto& commands = traceCommands[{ tileWidth, tileHeight, numViews }];
+      if (!commands) {
+        commands = rayTracer->createTraceCommands(tileParams, tileWidth, tileHeight, numViews);
+        compileCommands(commands);
+      }
+
+      tileParams->value().tileOffset = vsg::uivec2(tileX, tileY);
+
+      for (uint32_t sampleOffset = 0; sampleOffset < samplesPerPixel; sampleOffset += samplesPerBatch) {
+        tileParams->value().sampleOffset = sampleOffset;
+        tileParams->value().sampleCount = std::min(samplesPerBatch, samplesPerPixel - sampleOffset);
+        bool lastBatch = sampleOffset + samplesPerBatch >= samplesPerPixel;
+
+        vsg::submitCommandsToQueue(device, commandPool, queue, [&](vsg::CommandBuffer& commandBuffer) {
+          if (!sceneUpdated) {
+            sceneUpdateCommands->record(commandBuffer);
+            sceneUpdated = true;
+          }
+
+          // The first batch discards the previous tile, and later batches read results of the previous batch
+          std::vector<VkImageMemoryBarrier> barriers(vkImages.size());
+          for (size_t i = 0; i < vkImages.size(); ++i) {
+            VkImageMemoryBarrier& barrier = barriers[i];
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = (sampleOffset == 0) ? 0 : VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.oldLayout = (sampleOffset == 0) ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_GENERAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = vkImages[i];
+            barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, VK_REMAINING_ARRAY_LAYERS };
+          }
+          vkCmdPipelineBarrier(
+            commandBuffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+            0, 0, nullptr, 0, nullptr, uint32_t(barriers.size()), barriers.data());
+
+          commands->record(commandBuffer);
+
+          if (lastBatch) {
+            // Copy the finished tile into the readback buffer (layers are stored one after another)
+            for (auto& barrier : barriers) {
+              barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+              barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+              barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+              barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            }
+            vkCmdPipelineBarrier(
+              commandBuffer,
+              VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_TRANSFER_BIT,
+              0, 0, nullptr, 0, nullptr, uint32_t(barriers.size()), barriers.data());
+
+            VkBufferImageCopy region{};
+            region.bufferRowLength = tileWidth;
+            region.bufferImageHeight = tileHeight;
+            region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, numViews };
+            region.imageExtent = { tileWidth, tileHeight, 1 };
+            vkCmdCopyImageToBuffer(commandBuffer, vkTargetImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer->vk(device->deviceID), 1, &region);
+
+            if (aovImage) {
+              // AOV layers of the rendered views follow the target layers
+              region.bufferOffset = VkDeviceSize(tileWidth) * tileHeight * numViews * sizeof(vsg::vec4);
+              region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, numViews * NUM_AOV_LAYERS };
+              vkCmdCopyImageToBuffer(commandBuffer, vkImages[1], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer->vk(device->deviceID), 1, &region);
+            }
+          }
+        });
+      }
+
+      // Convert the tile into tone-mapped 8-bit color, or keep the radiance (and AOVs) for EXR
+      size_t tilePixels = size_t(tileWidth) * tileHeight;
+      uint32_t numLayers = aovImage ? numViews * (1 + NUM_AOV_LAYERS) : numViews;
+      auto memory = readbackBuffer->getDeviceMemory(device->deviceID);
+      void* mappedData;
+      memory->map(readbackBuffer->getMemoryOffset(device->deviceID), VkDeviceSize(tilePixels) * numLayers * sizeof(vsg::vec4), 0, &mappedData);
+      auto layerPixels = [&](uint32_t layer) { return static_cast<const vsg::vec4*>(mappedData) + tilePixels * layer; };
+      for (uint32_t view = 0; view < numViews; ++view) {
+        auto pixels = layerPixels(view);
+        for (uint32_t y = 0; y < tileHeight; ++y) {
+          for (uint32_t x = 0; x < tileWidth; ++x) {
+            const vsg::vec4& pixel = pixels[y * tileWidth + x];
+            if (!exrImages[view].empty()) {
+              size_t dst = size_t(tileY + y) * width + tileX + x;
+              for (int c = 0; c < 3; ++c) {
+                exrImages[view][c].pixels[dst] = pixel[c];
+              }
+              if (aovImage) {
+                for (size_t i = 0; i < std::size(AOV_CHANNELS); ++i) {
+                  const AOVChannel& channel = AOV_CHANNELS[i];
+                  auto aovPixels = layerPixels(numViews + view * NUM_AOV_LAYERS + static_cast<uint32_t>(channel.layer));
+                  exrImages[view][3 + i].pixels[dst] = aovPixels[y * tileWidth + x][channel.component];
+                }
+              }
+            } else {
+              vsg::vec3 color = toneMap(vsg::vec3(pixel.r, pixel.g, pixel.b), toneMapParams);
+              uint8_t* dst = &bands[view][(size_t(y) * width + tileX + x) * 3];
+              for (int c = 0; c < 3; ++c) {
+                dst[c] = uint8_t(std::lround(color[c] * 255.0f));
+              }
+            }
+          }
+        }
+      }
+      memory->unmap();
+    }
+
+    // A row of tiles is finished
+    for (uint32_t view = 0; view < numViews; ++view) {
+      if (!files[view].is_open()) {
+        continue;
+      }
+      files[view].write(reinterpret_cast<const char*>(bands[view].data()), std::streamsize(size_t(width) * tileHeight * 3));
+    }
+    if (reportProgress) {
+      std::cout << "Rendered " << (tileY + tileHeight) << " / " << height << " rows" << std::endl;
+    }
+  }
+
+  bool succeeded = true;
+  for (uint32_t view = 0; view < numViews; ++view) {
+    if (!exrImages[view].empty()) {
+      // Moved to avoid another copy of the image
+      succeeded &= saveEXRImage(paths[view], int(width), int(height), std::move(exrImages[view]));
+    } else {
+      succeeded &= bool(files[view]);
+    }
+  }
+  return succeeded;
+}
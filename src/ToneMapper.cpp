@@ -0,0 +1,142 @@
+#include "ToneMapper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vsg/all.h>
+
+const uint32_t TONE_MAP_WORKGROUP_SIZE = 8;  // This must agree with local_size_x and local_size_y in toneMap.comp
+
+std::optional<ToneMapOperator> parseToneMapOperator(const std::string& name)
+{
+  if (name == "clamp") {
+    return ToneMapOperator::CLAMP;
+  } else if (name == "reinhard") {
+    return ToneMapOperator::REINHARD;
+  } else if (name == "aces") {
+    return ToneMapOperator::ACES;
+  }
+  return std::nullopt;
+}
+
+const char* toneMapOperatorName(ToneMapOperator toneMapOperator)
+{
+  switch (toneMapOperator) {
+  case ToneMapOperator::REINHARD:
+    return "reinhard";
+  case ToneMapOperator::ACES:
+    return "aces";
+  default:
+    return "clamp";
+  }
+}
+
+vsg::vec3 toneMap(const vsg::vec3& radiance, const ToneMapParams& params)
+{
+  float scale = std::exp2(params.exposure);
+  vsg::vec3 color;
+  for (int c = 0; c < 3; ++c) {
+    float x = std::max(radiance[c] * scale, 0.0f);
+    switch (ToneMapOperator(params.toneMapOperator)) {
+    case ToneMapOperator::REINHARD:
+      x = x / (1.0f + x);
+      break;
+    case ToneMapOperator::ACES:
+      x = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+      break;
+    default:
+      break;
+    }
+    // Gamma correction
+    color[c] = std::pow(std::clamp(x, 0.0f, 1.0f), 1.0f / 2.2f);
+  }
+  return color;
+}
+
+ToneMapper::ToneMapper(vsg::Device* device, vsg::ref_ptr<vsg::Image> radianceImage, vsg::ref_ptr<vsg::ImageView> radianceImageView, uint32_t width, uint32_t height, vsg::ref_ptr<ToneMapParamsValue> params)
+  : params(params), width(width), height(height), radianceImage(radianceImage)
+{
+  auto computeShader = vsg::ShaderStage::read(VK_SHADER_STAGE_COMPUTE_BIT, "main", "shaders/toneMap.spv");
+  if (!computeShader) {
+    std::cerr << "Cannot load shaders" << std::endl;
+  }
+
+  // 8-bit image which is copied into the window (created in the same way as the ray tracing target)
+  displayImage = vsg::Image::create();
+  displayImage->imageType = VK_IMAGE_TYPE_2D;
+  displayImage->format = VK_FORMAT_B8G8R8A8_UNORM;
+  displayImage->extent = { width, height, 1 };
+  displayImage->mipLevels = 1;
+  displayImage->arrayLayers = 1;
+  displayImage->samples = VK_SAMPLE_COUNT_1_BIT;
+  displayImage->tiling = VK_IMAGE_TILING_OPTIMAL;
+  displayImage->usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  displayImage->sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  displayImage->initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  displayImage->flags = 0;
+  displayImageView = vsg::createImageView(device, displayImage, VK_IMAGE_ASPECT_COLOR_BIT);
+
+  vsg::DescriptorSetLayoutBindings descriptorBindings{
+    { static_cast<uint32_t>(ToneMapBindings::RADIANCE), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr },
+    { static_cast<uint32_t>(ToneMapBindings::DISPLAY), VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+  };
+  auto descriptorLayout = vsg::DescriptorSetLayout::create(descriptorBindings);
+
+  auto radianceDescriptor = vsg::DescriptorImage::create(
+    vsg::ImageInfo(nullptr, radianceImageView, VK_IMAGE_LAYOUT_GENERAL),
+    static_cast<uint32_t>(ToneMapBindings::RADIANCE), 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  auto displayDescriptor = vsg::DescriptorImage::create(
+    vsg::ImageInfo(nullptr, displayImageView, VK_IMAGE_LAYOUT_GENERAL),
+    static_cast<uint32_t>(ToneMapBindings::DISPLAY), 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+  descriptorSet = vsg::DescriptorSet::create(descriptorLayout, vsg::Descriptors{ radianceDescriptor, displayDescriptor });
+
+  vsg::PushConstantRanges pushConstantRanges{ { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ToneMapParams) } };
+  pipelineLayout = vsg::PipelineLayout::create(vsg::DescriptorSetLayouts{ descriptorLayout }, pushConstantRanges);
+  pipeline = vsg::ComputePipeline::create(pipelineLayout, computeShader);
+}
+
+vsg::ref_ptr<vsg::Commands> ToneMapper::createCommands()
+{
+  auto commands = vsg::Commands::create();
+
+  // Wait for the ray generation shader writing radiance
+  auto radianceBarrier = vsg::ImageMemoryBarrier::create(
+    VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+    VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+    radianceImage, VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+  commands->addChild(vsg::PipelineBarrier::create(
+    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, radianceBarrier));
+
+  commands->addChild(vsg::BindComputePipeline::create(pipeline));
+  commands->addChild(vsg::BindDescriptorSet::create(VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, descriptorSet));
+  commands->addChild(vsg::PushConstants::create(VK_SHADER_STAGE_COMPUTE_BIT, 0, params));
+  commands->addChild(vsg::Dispatch::create((width + TONE_MAP_WORKGROUP_SIZE - 1) / TONE_MAP_WORKGROUP_SIZE, (height + TONE_MAP_WORKGROUP_SIZE - 1) / TONE_MAP_WORKGROUP_SIZE, 1));
+
+  // The display image is copied into the window after this
+  auto displayBarrier = vsg::ImageMemoryBarrier::create(
+    VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+    VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+    VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+    displayImage, VkImageSubresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 });
+  commands->addChild(vsg::PipelineBarrier::create(
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, displayBarrier));
+
+  return commands;
+}
+
+void ToneMapKeyHandler::apply(vsg::KeyPressEvent& keyPress)
+{
+  ToneMapParams& value = params->value();
+  if (keyPress.keyBase == vsg::KEY_Equals || keyPress.keyBase == vsg::KEY_Plus || keyPress.keyBase == vsg::KEY_KP_Add) {
+    value.exposure += 0.5f;
+  } else if (keyPress.keyBase == vsg::KEY_Minus || keyPress.keyBase == vsg::KEY_KP_Subtract) {
+    value.exposure -= 0.5f;
+  } else if (keyPress.keyBase == vsg::KEY_t) {
+    value.toneMapOperator = (value.toneMapOperator + 1) % 3;
+  } else {
+    return;
+  }
+
+  std::cout << "Tone mapping: " << toneMapOperatorName(ToneMapOperator(value.toneMapOperator)) << ", exposure " << value.exposure << " EV" << std::endl;
+}
@@ -0,0 +1,78 @@
+#include "TraceRaysWithHitGroups.h"
+
+#include <vector>
+#include <algorithm>
+#include <vsg/vk/Context.h>
+#include <vsg/vk/CommandBuffer.h>
+#include <vsg/vk/Extensions.h>
+#include "utils.h"
+
+static VkDeviceSize alignUp(VkDeviceSize size, VkDeviceSize alignment)
+{
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+TraceRaysWithHitGroups::TraceRaysWithHitGroups(vsg::ref_ptr<CachedRayTracingPipeline> pipeline, uint32_t raygenGroup, uint32_t missGroup, uint32_t firstHitGroup, uint32_t numHitGroups, const std::vector<uint32_t>& hitRecords)
+  : pipeline(pipeline), raygenGroup(raygenGroup), missGroup(missGroup), firstHitGroup(firstHitGroup), numHitGroups(numHitGroups), hitRecords(hitRecords)
+{
+}
+
+void TraceRaysWithHitGroups::setHitGroups(uint32_t newNumHitGroups, const std::vector<uint32_t>& newHitRecords)
+{
+  numHitGroups = newNumHitGroups;
+  hitRecords = newHitRecords;
+  bindingTableBuffer = nullptr;
+}
+
+void TraceRaysWithHitGroups::compile(vsg::Context& context)
+{
+  if (bindingTableBuffer) {
+    return; // Already compiled
+  }
+
+  vsg::Device* device = context.device;
+  auto extensions = device->getExtensions();
+
+  pipeline->compile(context);
+
+  auto properties = device->getPhysicalDevice()->getProperties<VkPhysicalDeviceRayTracingPipelinePropertiesKHR, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR>();
+  uint32_t handleSize = properties.shaderGroupHandleSize;
+  VkDeviceSize recordSize = alignUp(handleSize, properties.shaderGroupHandleAlignment);
+
+  // Each region starts at a multiple of shaderGroupBaseAlignment. Hit records are contiguous
+  VkDeviceSize raygenOffset = 0;
+  VkDeviceSize missOffset = alignUp(raygenOffset + recordSize, properties.shaderGroupBaseAlignment);
+  VkDeviceSize hitOffset = alignUp(missOffset + recordSize, properties.shaderGroupBaseAlignment);
+  VkDeviceSize tableSize = hitOffset + recordSize * hitRecords.size();
+
+  // Handles of the groups used here
+  auto readHandles = [&](uint32_t firstGroup, uint32_t numGroups) {
+    std::vector<uint8_t> handles(size_t(handleSize) * numGroups);
+    extensions->vkGetRayTracingShaderGroupHandlesKHR(*device, pipeline->vk(), firstGroup, numGroups, handles.size(), handles.data());
+    return handles;
+  };
+  auto raygenHandle = readHandles(raygenGroup, 1);
+  auto missHandle = readHandles(missGroup, 1);
+  auto hitHandles = readHandles(firstHitGroup, numHitGroups);
+
+  auto table = vsg::ubyteArray::create(uint32_t(tableSize), 0);
+  std::copy(raygenHandle.begin(), raygenHandle.end(), table->data() + raygenOffset);
+  std::copy(missHandle.begin(), missHandle.end(), table->data() + missOffset);
+  for (size_t i = 0; i < hitRecords.size(); ++i) {
+    std::copy_n(hitHandles.begin() + size_t(handleSize) * hitRecords[i], handleSize, table->data() + hitOffset + recordSize * i);
+  }
+
+  bindingTableBuffer = createHostVisibleBuffer(device, table, VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  VkDeviceAddress address = getBufferDeviceAddress(device, bindingTableBuffer);
+
+  // Stride and size of the raygen region must be equal
+  raygenRegion = { address + raygenOffset, recordSize, recordSize };
+  missRegion = { address + missOffset, recordSize, recordSize };
+  hitRegion = { address + hitOffset, recordSize, recordSize * hitRecords.size() };
+}
+
+void TraceRaysWithHitGroups::record(vsg::CommandBuffer& commandBuffer) const
+{
+  auto extensions = commandBuffer.getDevice()->getExtensions();
+  extensions->vkCmdTraceRaysKHR(commandBuffer, &raygenRegion, &missRegion, &hitRegion, &callableRegion, width, height, depth);
+}
@@ -0,0 +1,178 @@
+#include "UpdateTopLevelAccelerationStructure.h"
+
+#include <algorithm>
+#include <vsg/vk/Context.h>
+#include <vsg/vk/CommandBuffer.h>
+#include <vsg/vk/Extensions.h>
+#include "utils.h"
+
+// vkCmdUpdateBuffer can write at most 65536 bytes at once
+// See: https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/vkCmdUpdateBuffer.html
+const VkDeviceSize MAX_UPDATE_BUFFER_SIZE = 65536;
+
+UpdateTopLevelAccelerationStructure::UpdateTopLevelAccelerationStructure(vsg::ref_ptr<RayTracingScene> scene)
+  : scene(scene)
+{
+}
+
+void UpdateTopLevelAccelerationStructure::compile(vsg::Context& context)
+{
+  if (instanceBuffer) {
+    return; // Already compiled
+  }
+
+  vsg::Device* device = context.device;
+  auto extensions = device->getExtensions();
+  auto& tlas = scene->tlas;
+
+  // TLAS (and BLASes inside) have to exist before their addresses are taken
+  tlas->compile(context);
+
+  size_t numInstances = tlas->geometryInstances.size();
+
+  // Instance data is written into a device local buffer inside command buffer,
+  // so that a frame in flight never sees data of the next frame
+  VkDeviceSize instanceBufferSize = std::max<VkDeviceSize>(numInstances * sizeof(VkAccelerationStructureInstanceKHR), 16);
+  instanceBuffer = vsg::createBufferAndMemory(
+    device, instanceBufferSize,
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  instanceBufferAddress = getBufferDeviceAddress(device, instanceBuffer);
+
+  // Query scratch size required for both update and rebuild
+  VkAccelerationStructureGeometryKHR geometry{};
+  geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+  geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+  geometry.geometry.instances.arrayOfPointers = VK_FALSE;
+  geometry.geometry.instances.data.deviceAddress = instanceBufferAddress;
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{};
+  buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+  buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  buildInfo.flags = tlas->buildFlags();
+  buildInfo.geometryCount = 1;
+  buildInfo.pGeometries = &geometry;
+
+  uint32_t primitiveCount = uint32_t(numInstances);
+  VkAccelerationStructureBuildSizesInfoKHR sizeInfo{};
+  sizeInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
+  extensions->vkGetAccelerationStructureBuildSizesKHR(*device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &primitiveCount, &sizeInfo);
+
+  scratchBuffer = vsg::createBufferAndMemory(
+    device, std::max(sizeInfo.updateScratchSize, sizeInfo.buildScratchSize),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  scratchBufferAddress = getBufferDeviceAddress(device, scratchBuffer);
+
+  // Addresses of BLASes do not change because BLASes are never rebuilt here
+  blasReferences.clear();
+  for (auto& instance : tlas->geometryInstances) {
+    VkAccelerationStructureDeviceAddressInfoKHR addressInfo{};
+    addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+    addressInfo.accelerationStructure = instance->accelerationStructure->vk(device->deviceID);
+    blasReferences.push_back(extensions->vkGetAccelerationStructureDeviceAddressKHR(*device, &addressInfo));
+  }
+}
+
+void UpdateTopLevelAccelerationStructure::record(vsg::CommandBuffer& commandBuffer) const
+{
+  if (!scene->transformsModified || !instanceBuffer) {
+    return;
+  }
+
+  auto device = commandBuffer.getDevice();
+  auto extensions = device->getExtensions();
+  auto& tlas = scene->tlas;
+  VkBuffer vkInstanceBuffer = instanceBuffer->vk(device->deviceID);
+
+  // Convert instances into Vulkan structure
+  std::vector<VkAccelerationStructureInstanceKHR> instances(tlas->geometryInstances.size());
+  for (size_t i = 0; i < instances.size(); ++i) {
+    auto& geometryInstance = tlas->geometryInstances[i];
+    vsg::mat4 transform(geometryInstance->transform);
+
+    VkAccelerationStructureInstanceKHR& instance = instances[i];
+    // VkTransformMatrixKHR is a row-major 3x4 matrix, while VSG matrices are column-major
+    for (int row = 0; row < 3; ++row) {
+      for (int col = 0; col < 4; ++col) {
+        instance.transform.matrix[row][col] = transform[col][row];
+      }
+    }
+    instance.instanceCustomIndex = geometryInstance->id;
+    instance.mask = geometryInstance->mask;
+    instance.instanceShaderBindingTableRecordOffset = geometryInstance->shaderOffset;
+    instance.flags = geometryInstance->flags;
+    instance.accelerationStructureReference = blasReferences[i];
+  }
+
+  // The previous frame may still be tracing against the TLAS and reading its instances
+  VkMemoryBarrier traceBarrier{};
+  traceBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  traceBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+  traceBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+    VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+    0, 1, &traceBarrier, 0, nullptr, 0, nullptr);
+
+  // Upload instances in chunks
+  VkDeviceSize totalSize = instances.size() * sizeof(VkAccelerationStructureInstanceKHR);
+  auto instanceBytes = reinterpret_cast<const uint8_t*>(instances.data());
+  for (VkDeviceSize offset = 0; offset < totalSize; offset += MAX_UPDATE_BUFFER_SIZE) {
+    VkDeviceSize size = std::min(MAX_UPDATE_BUFFER_SIZE, totalSize - offset);
+    vkCmdUpdateBuffer(commandBuffer, vkInstanceBuffer, offset, size, instanceBytes + offset);
+  }
+
+  // Make instance data visible to acceleration structure build
+  VkMemoryBarrier uploadBarrier{};
+  uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  uploadBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+    0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+
+  VkAccelerationStructureGeometryKHR geometry{};
+  geometry.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR;
+  geometry.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR;
+  geometry.geometry.instances.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR;
+  geometry.geometry.instances.arrayOfPointers = VK_FALSE;
+  geometry.geometry.instances.data.deviceAddress = instanceBufferAddress;
+
+  // Refit in place, or rebuild periodically
+  bool rebuild = (rebuildInterval > 0) && (updateCount % rebuildInterval == rebuildInterval - 1);
+  VkAccelerationStructureKHR vkTLAS = tlas->vk(device->deviceID);
+
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{};
+  buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
+  buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
+  buildInfo.flags = tlas->buildFlags();
+  buildInfo.mode = rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR;
+  buildInfo.srcAccelerationStructure = rebuild ? VK_NULL_HANDLE : vkTLAS;
+  buildInfo.dstAccelerationStructure = vkTLAS;
+  buildInfo.geometryCount = 1;
+  buildInfo.pGeometries = &geometry;
+  buildInfo.scratchData.deviceAddress = scratchBufferAddress;
+
+  VkAccelerationStructureBuildRangeInfoKHR rangeInfo{};
+  rangeInfo.primitiveCount = uint32_t(instances.size());
+  const VkAccelerationStructureBuildRangeInfoKHR* rangeInfos[] = { &rangeInfo };
+
+  extensions->vkCmdBuildAccelerationStructuresKHR(commandBuffer, 1, &buildInfo, rangeInfos);
+
+  // Wait for the build before tracing rays
+  VkMemoryBarrier buildBarrier{};
+  buildBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  buildBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+  buildBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+  vkCmdPipelineBarrier(
+    commandBuffer,
+    VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+    0, 1, &buildBarrier, 0, nullptr, 0, nullptr);
+
+  ++updateCount;
+  scene->transformsModified = false;
+}
@@ -1,45 +1,180 @@
-#include "gltfUtils.h"
-
-size_t sizeOfGLTFComponentType(int compType)
-{
-  switch (compType) {
-  case TINYGLTF_COMPONENT_TYPE_BYTE:
-  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
-    return 1;
-  case TINYGLTF_COMPONENT_TYPE_SHORT:
-  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
-    return 2;
-  case TINYGLTF_COMPONENT_TYPE_INT:
-  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
-  case TINYGLTF_COMPONENT_TYPE_FLOAT:
-    return 4;
-  case TINYGLTF_COMPONENT_TYPE_DOUBLE:
-    return 8;
-  default:
-    assert(false);
-    return 0;
-  }
-}
-
-size_t numComponentsOfGLTFType(int type)
-{
-  switch (type) {
-  case TINYGLTF_TYPE_SCALAR:
-    return 1;
-  case TINYGLTF_TYPE_VEC2:
-    return 2;
-  case TINYGLTF_TYPE_VEC3:
-    return 3;
-  case TINYGLTF_TYPE_VEC4:
-    return 4;
-  case TINYGLTF_TYPE_MAT2:
-    return 4;
-  case TINYGLTF_TYPE_MAT3:
-    return 9;
-  case TINYGLTF_TYPE_MAT4:
-    return 16;
-  default:
-    assert(false);
-    return 0;
-  }
-}
+#include "gltfUtils.h"
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include "meshoptDecoder.h"
+
+size_t sizeOfGLTFComponentType(int compType)
+{
+  switch (compType) {
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return 1;
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return 2;
+  case TINYGLTF_COMPONENT_TYPE_INT:
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return 4;
+  case TINYGLTF_COMPONENT_TYPE_DOUBLE:
+    return 8;
+  default:
+    assert(false);
+    return 0;
+  }
+}
+
+size_t numComponentsOfGLTFType(int type)
+{
+  switch (type) {
+  case TINYGLTF_TYPE_SCALAR:
+    return 1;
+  case TINYGLTF_TYPE_VEC2:
+    return 2;
+  case TINYGLTF_TYPE_VEC3:
+    return 3;
+  case TINYGLTF_TYPE_VEC4:
+    return 4;
+  case TINYGLTF_TYPE_MAT2:
+    return 4;
+  case TINYGLTF_TYPE_MAT3:
+    return 9;
+  case TINYGLTF_TYPE_MAT4:
+    return 16;
+  default:
+    assert(false);
+    return 0;
+  }
+}
+
+float normalizationScaleOfGLTFComponentType(int compType)
+{
+  switch (compType) {
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+    return 1.0f / 127.0f;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return 1.0f / 255.0f;
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+    return 1.0f / 32767.0f;
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return 1.0f / 65535.0f;
+  default:
+    return 1.0f;
+  }
+}
+
+vsg::ref_ptr<vsg::floatArray> readGLTFBufferAsFloats(int accessorIdx, const tinygltf::Model& model)
+{
+  const tinygltf::Accessor& accessor = model.accessors[accessorIdx];
+
+  if (accessor.sparse.isSparse) { // Sparse accessor is not supported
+    return {};
+  }
+
+  const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+  const tinygltf::Buffer& buffer = model.buffers[bufferView.buffer];
+
+  size_t numComp = numComponentsOfGLTFType(accessor.type);
+  size_t compSize = sizeOfGLTFComponentType(accessor.componentType);
+
+  size_t stride = (bufferView.byteStride == 0) ? numComp * compSize : bufferView.byteStride;
+
+  float scale = accessor.normalized ? normalizationScaleOfGLTFComponentType(accessor.componentType) : 1.0f;
+
+  auto arr = vsg::floatArray::create(uint32_t(accessor.count * numComp));
+
+  size_t pos = accessor.byteOffset + bufferView.byteOffset;
+  for (size_t i = 0; i < accessor.count; ++i) {
+    for (size_t j = 0; j < numComp; ++j) {
+      float value = readComponentAndConvert<float>(buffer.data, pos + compSize * j, accessor.componentType) * scale;
+      arr->at(i * numComp + j) = accessor.normalized ? std::max(value, -1.0f) : value;
+    }
+
+    pos += stride;
+  }
+
+  return arr;
+}
+
+bool decodeMeshoptCompression(tinygltf::Model& model)
+{
+  const std::string extensionName = "EXT_meshopt_compression";
+
+  struct DecodeTask
+  {
+    size_t bufferViewIdx;
+    std::future<std::vector<unsigned char>> result;
+  };
+  std::vector<DecodeTask> tasks;
+
+  for (size_t i = 0; i < model.bufferViews.size(); i++) {
+    const tinygltf::BufferView& bufferView = model.bufferViews[i];
+    auto ext = bufferView.extensions.find(extensionName);
+    if (ext == bufferView.extensions.end()) {
+      continue;
+    }
+    const tinygltf::Value& params = ext->second;
+
+    int bufferIdx = params.Get("buffer").GetNumberAsInt();
+    size_t byteOffset = params.Has("byteOffset") ? size_t(params.Get("byteOffset").GetNumberAsInt()) : 0;
+    size_t byteLength = size_t(params.Get("byteLength").GetNumberAsInt());
+    size_t byteStride = size_t(params.Get("byteStride").GetNumberAsInt());
+    size_t count = size_t(params.Get("count").GetNumberAsInt());
+    std::string mode = params.Get("mode").Get<std::string>();
+    std::string filter = params.Has("filter") ? params.Get("filter").Get<std::string>() : "NONE";
+
+    if (bufferIdx < 0 || size_t(bufferIdx) >= model.buffers.size() || byteOffset + byteLength > model.buffers[bufferIdx].data.size()) {
+      std::cerr << "Invalid " << extensionName << " source of buffer view " << i << std::endl;
+      return false;
+    }
+    const unsigned char* source = model.buffers[bufferIdx].data.data() + byteOffset;
+
+    // Each buffer view is decoded on its own thread
+    tasks.push_back({ i, std::async(std::launch::async, [=]() {
+      std::vector<unsigned char> decoded(count * byteStride);
+      bool succeeded;
+      if (mode == "ATTRIBUTES") {
+        succeeded = decodeMeshoptVertexBuffer(decoded.data(), count, byteStride, source, byteLength)
+          && applyMeshoptFilter(decoded.data(), count, byteStride, filter);
+      } else if (mode == "TRIANGLES") {
+        succeeded = decodeMeshoptIndexBuffer(decoded.data(), count, byteStride, source, byteLength);
+      } else if (mode == "INDICES") {
+        succeeded = decodeMeshoptIndexSequence(decoded.data(), count, byteStride, source, byteLength);
+      } else {
+        succeeded = false;
+      }
+      return succeeded ? decoded : std::vector<unsigned char>();
+    }) });
+  }
+
+  // Wait for all tasks before adding buffers because they read the existing ones
+  std::vector<std::vector<unsigned char>> results;
+  for (auto& task : tasks) {
+    results.push_back(task.result.get());
+  }
+
+  bool succeeded = true;
+  for (size_t i = 0; i < tasks.size(); i++) {
+    const DecodeTask& task = tasks[i];
+    std::vector<unsigned char>& decoded = results[i];
+    if (decoded.empty()) {
+      std::cerr << "Failed to decode buffer view " << task.bufferViewIdx << " compressed by " << extensionName << std::endl;
+      succeeded = false;
+      continue;
+    }
+
+    // Decoded data is stored as a new buffer because the fallback buffer may have no data
+    tinygltf::BufferView& bufferView = model.bufferViews[task.bufferViewIdx];
+    tinygltf::Buffer decodedBuffer;
+    decodedBuffer.data = std::move(decoded);
+    bufferView.buffer = int(model.buffers.size());
+    bufferView.byteOffset = 0;
+    bufferView.byteLength = decodedBuffer.data.size();
+    bufferView.extensions.erase(extensionName);
+    model.buffers.push_back(std::move(decodedBuffer));
+  }
+
+  return succeeded;
+}
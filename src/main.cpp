@@ -1,204 +1,462 @@
-#include <iostream>
-#include <chrono>
-#include <vsg/all.h>
-#include "RayTracer.h"
-#include "RayTracingMaterialGroup.h"
-#include "SceneConversionTraversal.h"
-#include "GLTFLoader.h"
-#include "utils.h"
-
-// Real-time ray tracing using Vulkan Ray Tracing extension
-// Based on VSG's vsgraytracing example:
-//  https://github.com/vsg-dev/vsgExamples/blob/master/examples/raytracing/vsgraytracing/vsgraytracing.cpp
-// Ray tracing algorithm and scene are based on "Ray Tracing in One Weekend" (v3.2.3) written by Peter Shirley:
-//  https://raytracing.github.io/books/RayTracingInOneWeekend.html
-// Vulkan-specific designs are based on NVIDIA Vulkan Ray Tracing tutorial:
-//  https://nvpro-samples.github.io/vk_raytracing_tutorial_KHR/
-
-const int DEFAULT_SCREEN_WIDTH = 800;
-const int DEFAULT_SCREEN_HEIGHT = 450;
-
-const uint32_t DEFAULT_SAMPLES_PER_PIXEL = 100;
-
-const int FPS_MEASURE_COUNT = 100;
-
-vsg::ref_ptr<RayTracingScene> createDefaultScene(vsg::Device* device)
-{
-  // Define materials used in the scene
-  RayTracingMaterial groundMaterial;
-  groundMaterial.color = vsg::vec3(0.8f, 0.8f, 0.0f);
-  groundMaterial.roughness = 1.0f;
-  groundMaterial.metallic = 0.0f;
-  RayTracingMaterial centerMaterial;
-  centerMaterial.color = vsg::vec3(0.1f, 0.2f, 0.5f);
-  centerMaterial.roughness = 0.1f;
-  centerMaterial.metallic = 0.0f;
-  RayTracingMaterial leftMaterial;
-  leftMaterial.color = vsg::vec3(1.0f, 1.0f, 1.0f);
-  leftMaterial.roughness = 0.5f;
-  leftMaterial.metallic = 1.0f;
-  RayTracingMaterial rightMaterial;
-  rightMaterial.color = vsg::vec3(0.8f, 0.6f, 0.2f);
-  rightMaterial.roughness = 0.0f;
-  rightMaterial.metallic = 1.0f;
-
-  // Scene to render
-  auto scene = vsg::Group::create();
-  auto groundGroup = RayTracingMaterialGroup::create(groundMaterial);
-  groundGroup->addChild(createSphere(vsg::vec3(0.0f, -100.5f, -1.0f), 100.0f));
-  //groundGroup->addChild(createQuad(vsg::vec3(0.0f, -0.5f, -1.0f), vsg::vec3(0.0f, 1.0f, 0.0f), vsg::vec3(0.0f, 0.0f, -1.0f), 100.0f, 100.0f));
-  scene->addChild(groundGroup);
-  auto centerGroup = RayTracingMaterialGroup::create(centerMaterial);
-  centerGroup->addChild(createSphere(vsg::vec3(0.0f, 0.0f, -1.0f), 0.5f));
-  scene->addChild(centerGroup);
-  auto leftGroup = RayTracingMaterialGroup::create(leftMaterial);
-  leftGroup->addChild(createSphere(vsg::vec3(-1.0f, 0.0f, -1.0f), 0.5f));
-  scene->addChild(leftGroup);
-  auto rightGroup = RayTracingMaterialGroup::create(rightMaterial);
-  rightGroup->addChild(createSphere(vsg::vec3(1.0f, 0.0f, -1.0f), 0.5f));
-  scene->addChild(rightGroup);
-
-  // Convert scene into acceleration structure for ray tracing
-  SceneConversionTraversal sceneConversionTraversal(device);
-  scene->accept(sceneConversionTraversal);
-
-  return sceneConversionTraversal.scene;
-}
-
-int main(int argc, char* argv[])
-{
-  // Use VSG's option parser to handle command line arguments
-  vsg::CommandLine arguments(&argc, argv);
-  bool useDebugLayer = arguments.read({ "--debug" });
-  auto cameraPos = arguments.value(vsg::dvec3(0.0, 0.0, 1.0), { "--camera", "-c" });
-  auto lookAtPos = arguments.value(vsg::dvec3(0.0, 0.0, 0.0), { "--lookat", "-l" });
-  auto cameraUpVec = arguments.value(vsg::dvec3(0.0, 1.0, 0.0), { "--camera-up", "-u" });
-  double fov = arguments.value(90.0, { "--camera-fov", "-f" });
-  uint32_t samplesPerPixel = arguments.value(DEFAULT_SAMPLES_PER_PIXEL, { "--samples", "-s" });
-  std::string envMapFile = arguments.value<std::string>("", { "--envmap", "-e" });
-  int screenWidth = arguments.value<int>(DEFAULT_SCREEN_WIDTH, { "--screen-width", "-W" });
-  int screenHeight = arguments.value<int>(DEFAULT_SCREEN_HEIGHT, { "--screen-height", "-H" });
-  std::string algorithmName = arguments.value<std::string>("pt", { "--algorithm", "-a" });
-
-  SamplingAlgorithm algorithm;
-  if (algorithmName == "pt") {
-    algorithm = SamplingAlgorithm::PATH_TRACING;
-  } else if (algorithmName == "qmc") {
-    algorithm = SamplingAlgorithm::QUASI_MONTE_CARLO;
-  }
-
-  std::string gltfFile;
-  // Flags such as "--debug" are removed by arguments.read calls above
-  if (arguments.argc() >= 2) {
-    gltfFile = arguments[1];
-  }
-
-  auto windowTraits = vsg::WindowTraits::create(screenWidth, screenHeight, "VSGRayTracer");
-  windowTraits->queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;  // Because ray tracing needs compute queue. See: https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/vkCmdTraceRaysKHR.html#VkQueueFlagBits
-  windowTraits->swapchainPreferences.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;  // The screen can be target of image-to-image copy
-  // Ray tracing requires Vulkan 1.1
-  windowTraits->vulkanVersion = VK_API_VERSION_1_1;
-  // Vulkan extensions required for ray tracing
-  windowTraits->deviceExtensionNames = {
-    VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
-    VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
-    // Below are extensions required by the above two
-    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
-    VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
-    VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
-    VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME,
-    VK_KHR_SPIRV_1_4_EXTENSION_NAME,
-    // Below are for shaders
-    VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME
-  };
-  // Enable features related to the above extensions and GLSL extensions used in shaders
-  windowTraits->deviceFeatures->get<VkPhysicalDeviceAccelerationStructureFeaturesKHR, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR>().accelerationStructure = true;
-  windowTraits->deviceFeatures->get<VkPhysicalDeviceRayTracingPipelineFeaturesKHR, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR>().rayTracingPipeline = true;
-  windowTraits->deviceFeatures->get<VkPhysicalDeviceBufferDeviceAddressFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES>().bufferDeviceAddress = true;
-  windowTraits->deviceFeatures->get().shaderInt16 = true;
-  windowTraits->deviceFeatures->get<VkPhysicalDevice16BitStorageFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES>().storageBuffer16BitAccess = true;
-  windowTraits->deviceFeatures->get<VkPhysicalDeviceScalarBlockLayoutFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SCALAR_BLOCK_LAYOUT_FEATURES>().scalarBlockLayout = true;
-  // Enable Vulkan validation layer if specified by command line argument
-  windowTraits->debugLayer = useDebugLayer;
-
-  auto window = vsg::Window::create(windowTraits);
-
-  vsg::Device* device = window->getOrCreateDevice();  // Handle of a Vulkan device (GPU?)
-
-  vsg::ref_ptr<RayTracingScene> scene;
-  if (!gltfFile.empty()) {
-    // Load scene from a GLTF file
-    scene = RayTracingScene::create(device);
-    GLTFLoader loader(scene);
-    if (!loader.loadFile(gltfFile)) {
-      std::cerr << "GLTF load error" << std::endl;
-      return -1;
-    }
-  } else {
-    // Use default scene
-    scene = createDefaultScene(device);
-  }
-
-  if (!envMapFile.empty()) {
-    auto envMap = loadEXRTexture(envMapFile);
-    if (!envMap) {
-      std::cerr << "Environment map load error" << std::endl;
-      return -1;
-    }
-    
-    scene->envMap = envMap;
-  } else {
-    // Use default environment map (1x1 px and value is 1.0)
-    scene->envMap = vsg::vec3Array2D::create(1, 1, vsg::vec3(1.0f, 1.0f, 1.0f), vsg::Data::Layout{ VK_FORMAT_R32G32B32_SFLOAT });
-  }
-
-  auto rayTracer = RayTracer::create(device, screenWidth, screenHeight, scene, algorithm);
-
-  auto viewer = vsg::Viewer::create();
-  viewer->addWindow(window);
-
-  auto perspective = vsg::Perspective::create(fov, double(screenWidth) / double(screenHeight), 0.1, 1000.0);
-  auto lookAt = vsg::LookAt::create(cameraPos, lookAtPos, cameraUpVec);
-  auto camera = vsg::Camera::create(perspective, lookAt, vsg::ViewportState::create(window->extent2D()));
-
-  viewer->addEventHandler(vsg::CloseHandler::create(viewer));
-  viewer->addEventHandler(vsg::Trackball::create(camera));
-
-  rayTracer->setSamplesPerPixel(samplesPerPixel);
-
-  // Ray generation shader uses inverse of projection and view matrices
-  vsg::dmat4 viewMat, projectionMat;
-  lookAt->get(viewMat);
-  perspective->get(projectionMat);
-  rayTracer->setCameraParams(viewMat, projectionMat);
-
-  viewer->assignRecordAndSubmitTaskAndPresentation({ rayTracer->createCommandGraph(window) });
-  viewer->compile();
-
-  // For FPS measurement
-  int counter = 0;
-  auto lastTime = std::chrono::high_resolution_clock::now();
-
-  while (viewer->advanceToNextFrame()) {
-    viewer->handleEvents();
-
-    lookAt->get(viewMat);
-    rayTracer->setCameraParams(viewMat, projectionMat);
-
-    viewer->update();
-    viewer->recordAndSubmit();
-    viewer->present();
-
-    // FPS measurement
-    ++counter;
-    if (counter >= FPS_MEASURE_COUNT) {
-      counter = 0;
-      auto elapsed = std::chrono::high_resolution_clock::now() - lastTime;
-      long long fps = std::chrono::seconds(FPS_MEASURE_COUNT) / elapsed;
-      std::cout << fps << " fps" << std::endl;
-      lastTime = std::chrono::high_resolution_clock::now();
-    }
-  }
-
-  return 0;
+#include <iostream>
+#include <chrono>
+#include <optional>
+#include <thread>
+#include <vsg/all.h>
+#include "RayTracer.h"
+#include "RayTracingMaterialGroup.h"
+#include "SceneConversionTraversal.h"
+#include "SamplesPerPixelController.h"
+#include "TiledRenderer.h"
+#include "AsyncSceneLoader.h"
+#include "RenderServer.h"
+#include "ToneMapper.h"
+#include "AccelerationStructureBuilder.h"
+#include "StressSceneGenerator.h"
+#include "utils.h"
+
+// Real-time ray tracing using Vulkan Ray Tracing extension
+// Based on VSG's vsgraytracing example:
+//  https://github.com/vsg-dev/vsgExamples/blob/master/examples/raytracing/vsgraytracing/vsgraytracing.cpp
+// Ray tracing algorithm and scene are based on "Ray Tracing in One Weekend" (v3.2.3) written by Peter Shirley:
+//  https://raytracing.github.io/books/RayTracingInOneWeekend.html
+// Vulkan-specific designs are based on NVIDIA Vulkan Ray Tracing tutorial:
+//  https://nvpro-samples.github.io/vk_raytracing_tutorial_KHR/
+
+const int DEFAULT_SCREEN_WIDTH = 800;
+const int DEFAULT_SCREEN_HEIGHT = 450;
+
+const uint32_t DEFAULT_SAMPLES_PER_PIXEL = 100;
+const uint32_t DEFAULT_MIN_SAMPLES_PER_PIXEL = 1;
+const uint32_t DEFAULT_MAX_SAMPLES_PER_PIXEL = 1024;
+
+const uint32_t DEFAULT_TILE_SIZE = 512;
+const uint32_t DEFAULT_SAMPLES_PER_BATCH = 64;
+
+const std::string DEFAULT_PIPELINE_CACHE_DIR = "pipeline_cache";
+
+const double SNAPSHOT_INTERVAL_SECONDS = 1.0;  // Interval of showing partially loaded scenes
+
+const int FPS_MEASURE_COUNT = 100;
+
+// Default environment map (1x1 px and value is 1.0)
+vsg::ref_ptr<vsg::Data> createDefaultEnvMap()
+{
+  return vsg::vec3Array2D::create(1, 1, vsg::vec3(1.0f, 1.0f, 1.0f), vsg::Data::Layout{ VK_FORMAT_R32G32B32_SFLOAT });
+}
+
+vsg::ref_ptr<RayTracingScene> createDefaultScene(vsg::Device* device, AccelerationStructureBuildPreference blasBuildPreference, bool compactBLAS)
+{
+  // Define materials used in the scene
+  RayTracingMaterial groundMaterial;
+  groundMaterial.color = vsg::vec3(0.8f, 0.8f, 0.0f);
+  groundMaterial.roughness = 1.0f;
+  groundMaterial.metallic = 0.0f;
+  RayTracingMaterial centerMaterial;
+  centerMaterial.color = vsg::vec3(0.1f, 0.2f, 0.5f);
+  centerMaterial.roughness = 0.1f;
+  centerMaterial.metallic = 0.0f;
+  RayTracingMaterial leftMaterial;
+  leftMaterial.color = vsg::vec3(1.0f, 1.0f, 1.0f);
+  leftMaterial.roughness = 0.5f;
+  leftMaterial.metallic = 1.0f;
+  RayTracingMaterial rightMaterial;
+  rightMaterial.color = vsg::vec3(0.8f, 0.6f, 0.2f);
+  rightMaterial.roughness = 0.0f;
+  rightMaterial.metallic = 1.0f;
+
+  // Scene to render
+  auto scene = vsg::Group::create();
+  auto groundGroup = RayTracingMaterialGroup::create(groundMaterial);
+  groundGroup->addChild(createSphere(vsg::vec3(0.0f, -100.5f, -1.0f), 100.0f));
+  //groundGroup->addChild(createQuad(vsg::vec3(0.0f, -0.5f, -1.0f), vsg::vec3(0.0f, 1.0f, 0.0f), vsg::vec3(0.0f, 0.0f, -1.0f), 100.0f, 100.0f));
+  scene->addChild(groundGroup);
+  auto centerGroup = RayTracingMaterialGroup::create(centerMaterial);
+  centerGroup->addChild(createSphere(vsg::vec3(0.0f, 0.0f, -1.0f), 0.5f));
+  scene->addChild(centerGroup);
+  auto leftGroup = RayTracingMaterialGroup::create(leftMaterial);
+  leftGroup->addChild(createSphere(vsg::vec3(-1.0f, 0.0f, -1.0f), 0.5f));
+  scene->addChild(leftGroup);
+  auto rightGroup = RayTracingMaterialGroup::create(rightMaterial);
+  rightGroup->addChild(createSphere(vsg::vec3(1.0f, 0.0f, -1.0f), 0.5f));
+  scene->addChild(rightGroup);
+
+  // Convert scene into acceleration structure for ray tracing
+  SceneConversionTraversal sceneConversionTraversal(device);
+  sceneConversionTraversal.scene->blasBuildPreference = blasBuildPreference;
+  sceneConversionTraversal.scene->compactBLAS = compactBLAS;
+  scene->accept(sceneConversionTraversal);
+
+  return sceneConversionTraversal.scene;
+}
+
+int main(int argc, char* argv[])
+{
+  // Use VSG's option parser to handle command line arguments
+  vsg::CommandLine arguments(&argc, argv);
+  bool useDebugLayer = arguments.read({ "--debug" });
+  auto cameraPos = arguments.value(vsg::dvec3(0.0, 0.0, 1.0), { "--camera", "-c" });
+  auto lookAtPos = arguments.value(vsg::dvec3(0.0, 0.0, 0.0), { "--lookat", "-l" });
+  auto cameraUpVec = arguments.value(vsg::dvec3(0.0, 1.0, 0.0), { "--camera-up", "-u" });
+  double fov = arguments.value(90.0, { "--camera-fov", "-f" });
+  uint32_t samplesPerPixel = arguments.value(DEFAULT_SAMPLES_PER_PIXEL, { "--samples", "-s" });
+  std::string envMapFile = arguments.value<std::string>("", { "--envmap", "-e" });
+  int screenWidth = arguments.value<int>(DEFAULT_SCREEN_WIDTH, { "--screen-width", "-W" });
+  int screenHeight = arguments.value<int>(DEFAULT_SCREEN_HEIGHT, { "--screen-height", "-H" });
+  std::string algorithmName = arguments.value<std::string>("pt", { "--algorithm", "-a" });
+  double targetMilliseconds = arguments.value(0.0, { "--target-ms" });
+  uint32_t minSamplesPerPixel = arguments.value(DEFAULT_MIN_SAMPLES_PER_PIXEL, { "--min-samples" });
+  uint32_t maxSamplesPerPixel = arguments.value(DEFAULT_MAX_SAMPLES_PER_PIXEL, { "--max-samples" });
+  std::string outputFile = arguments.value<std::string>("", { "--output", "-o" });
+  uint32_t tileSize = arguments.value(DEFAULT_TILE_SIZE, { "--tile-size" });
+  uint32_t samplesPerBatch = arguments.value(DEFAULT_SAMPLES_PER_BATCH, { "--batch-samples" });
+  double textureBudgetMB = arguments.value(0.0, { "--texture-budget" });
+  bool optimizeMeshes = arguments.read({ "--optimize-meshes" });
+  std::string pipelineCacheDir = arguments.value<std::string>(DEFAULT_PIPELINE_CACHE_DIR, { "--pipeline-cache" });
+  bool noPipelineCache = arguments.read({ "--no-pipeline-cache" });
+  bool server = arguments.read({ "--server" });
+  bool writeAOVs = arguments.read({ "--aovs" });
+  float exposure = arguments.value(0.0f, { "--exposure" });
+  std::string toneMapName = arguments.value<std::string>("clamp", { "--tone-map" });
+  bool compactBLAS = arguments.read({ "--compact-blas" });
+  std::string blasBuildName = arguments.value<std::string>("fast-trace", { "--blas-build" });
+  uint32_t maxHistorySamples = arguments.value(0u, { "--history" });
+  bool stressScene = arguments.read({ "--stress" });
+  StressSceneGenerator stressSceneGenerator;
+  stressSceneGenerator.numInstances = arguments.value(stressSceneGenerator.numInstances, { "--stress-instances" });
+  stressSceneGenerator.numMeshes = arguments.value(stressSceneGenerator.numMeshes, { "--stress-meshes" });
+  stressSceneGenerator.trianglesPerMesh = arguments.value(stressSceneGenerator.trianglesPerMesh, { "--stress-triangles" });
+  stressSceneGenerator.numTextures = arguments.value(stressSceneGenerator.numTextures, { "--stress-textures" });
+  stressSceneGenerator.numMaterials = arguments.value(stressSceneGenerator.numMaterials, { "--stress-materials" });
+  stressSceneGenerator.emissiveFraction = arguments.value(stressSceneGenerator.emissiveFraction, { "--stress-emissive" });
+  stressSceneGenerator.seed = arguments.value(stressSceneGenerator.seed, { "--stress-seed" });
+
+  SamplingAlgorithm algorithm;
+  if (algorithmName == "pt") {
+    algorithm = SamplingAlgorithm::PATH_TRACING;
+  } else if (algorithmName == "qmc") {
+    algorithm = SamplingAlgorithm::QUASI_MONTE_CARLO;
+  }
+
+  auto toneMapOperator = parseToneMapOperator(toneMapName);
+  if (!toneMapOperator) {
+    std::cerr << "Unknown tone mapping operator " << toneMapName << std::endl;
+    return -1;
+  }
+  AccelerationStructureBuildPreference blasBuildPreference;
+  if (blasBuildName == "fast-trace") {
+    blasBuildPreference = AccelerationStructureBuildPreference::FAST_TRACE;
+  } else if (blasBuildName == "fast-build") {
+    blasBuildPreference = AccelerationStructureBuildPreference::FAST_BUILD;
+  } else {
+    std::cerr << "Unknown BLAS build preference " << blasBuildName << std::endl;
+    return -1;
+  }
+
+  // Shared by ray tracers created for snapshots, so that adjustments are kept
+  auto toneMapParams = ToneMapParamsValue::create();
+  toneMapParams->value().exposure = exposure;
+  toneMapParams->value().toneMapOperator = uint32_t(toneMapOperator.value());
+
+  std::vector<std::string> gltfFiles;
+  // Flags such as "--debug" are removed by arguments.read calls above
+  for (int i = 1; i < arguments.argc(); ++i) {
+    gltfFiles.push_back(arguments[i]);
+  }
+
+  // In offline rendering, the window is only used to create a device and its size is independent of the image
+  bool offline = !outputFile.empty() || server;
+  auto windowTraits = offline
+    ? vsg::WindowTraits::create(DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT, "VSGRayTracer")
+    : vsg::WindowTraits::create(screenWidth, screenHeight, "VSGRayTracer");
+  windowTraits->queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;  // Because ray tracing needs compute queue. See: https://www.khronos.org/registry/vulkan/specs/1.2-extensions/man/html/vkCmdTraceRaysKHR.html#VkQueueFlagBits
+  windowTraits->swapchainPreferences.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;  // The screen can be target of image-to-image copy
+  // Ray tracing requires Vulkan 1.1
+  windowTraits->vulkanVersion = VK_API_VERSION_1_1;
+  // Vulkan extensions required for ray tracing
+  windowTraits->deviceExtensionNames = {
+    VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME,
+    VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME,
+    // Below are extensions required by the above two
+    VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME,
+    VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
+    VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
+    VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME,
+    VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+    // Below are for shaders
+    VK_EXT_SCALAR_BLOCK_LAYOUT_EXTENSION_NAME
+  };
+  // Enable features related to the above extensions and GLSL extensions used in shaders
+  windowTraits->deviceFeatures->get<VkPhysicalDeviceAccelerationStructureFeaturesKHR, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR>().accelerationStructure = true;
+  windowTraits->deviceFeatures->get<VkPhysicalDeviceRayTracingPipelineFeaturesKHR, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR>().rayTracingPipeline = true;
+  windowTraits->deviceFeatures->get<VkPhysicalDeviceBufferDeviceAddressFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES>().bufferDeviceAddress = true;
+  windowTraits->deviceFeatures->get().shaderInt16 = true;
+  windowTraits->deviceFeatures->get<VkPhysicalDevice16BitStorageFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES>().storageBuffer16BitAccess = true;
+  windowTraits->deviceFeatures->get<VkPhysicalDeviceScalarBlockLayoutFeatures, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SCALAR_BLOCK_LAYOUT_FEATURES>().scalarBlockLayout = true;
+  // Enable Vulkan validation layer if specified by command line argument
+  windowTraits->debugLayer = useDebugLayer;
+
+  auto window = vsg::Window::create(windowTraits);
+
+  vsg::Device* device = window->getOrCreateDevice();  // Handle of a Vulkan device (GPU?)
+
+  vsg::ref_ptr<RayTracingScene> scene;
+  vsg::ref_ptr<GLTFAnimation> animation;
+  vsg::ref_ptr<AsyncSceneLoader> sceneLoader;
+  if (!gltfFiles.empty()) {
+    // Load scene from GLTF files (and the environment map) on a worker thread
+    scene = RayTracingScene::create(device);
+    scene->blasBuildPreference = blasBuildPreference;
+    scene->compactBLAS = compactBLAS;
+    if (textureBudgetMB > 0.0 && !offline) {
+      scene->textureStreamer = TextureStreamer::create(window, VkDeviceSize(textureBudgetMB * 1024.0 * 1024.0));
+    }
+    std::optional<MeshOptimizer> meshOptimizer;
+    if (optimizeMeshes) {
+      meshOptimizer.emplace();
+    }
+    sceneLoader = AsyncSceneLoader::create(scene, gltfFiles, envMapFile, meshOptimizer);
+  } else if (stressScene) {
+    // Synthetic scene for scaling benchmarks
+    scene = RayTracingScene::create(device);
+    scene->blasBuildPreference = blasBuildPreference;
+    scene->compactBLAS = compactBLAS;
+    stressSceneGenerator.generate(scene);
+    stressSceneGenerator.report(server ? std::cerr : std::cout);
+  } else {
+    // Use default scene
+    scene = createDefaultScene(device, blasBuildPreference, compactBLAS);
+  }
+  // The environment map of a glTF scene is loaded by the worker thread
+  if (!sceneLoader && !envMapFile.empty()) {
+    auto envMap = loadEXRTexture(envMapFile);
+    if (!envMap) {
+      std::cerr << "Environment map load error" << std::endl;
+      return -1;
+    }
+
+    scene->envMap = envMap;
+  }
+
+  // BLASes are built (and compacted) before ray tracers build TLAS referring to them
+  auto blasBuilder = AccelerationStructureBuilder::create(window);
+
+  // Take results of the worker thread after it finished
+  auto finishLoading = [&]() {
+    if (!sceneLoader->wait()) {
+      return false;
+    }
+    if (sceneLoader->meshOptimizer) {
+      sceneLoader->meshOptimizer->report(server ? std::cerr : std::cout);
+    }
+    animation = sceneLoader->animation;
+    sceneLoader = nullptr;
+    return true;
+  };
+
+  if (offline) {
+    // Offline rendering needs the complete scene
+    if (sceneLoader && !finishLoading()) {
+      return -1;
+    }
+    if (!scene->envMap) {
+      scene->envMap = createDefaultEnvMap();
+    }
+
+    blasBuilder->build(scene);
+    // Only results are printed into stdout in server mode
+    blasBuilder->report(scene).print(server ? std::cerr : std::cout);
+
+    // Render the image in tiles and write it into the file. Jobs of the server can render several views in one launch
+    auto rayTracer = RayTracer::create(device, tileSize, tileSize, scene, algorithm, VK_FORMAT_R32G32B32A32_SFLOAT, server ? MAX_NUM_VIEWS : 1u, writeAOVs);
+    if (!noPipelineCache) {
+      rayTracer->setPipelineCache(PipelineCache::create(pipelineCacheDir));
+    }
+
+    auto tiledRenderer = TiledRenderer::create(window, rayTracer, tileSize);
+    tiledRenderer->toneMapParams = toneMapParams->value();
+
+    // Options give the job of -o, and defaults of jobs in server mode
+    RenderJob job;
+    job.views[0].cameraPos = cameraPos;
+    job.views[0].lookAtPos = lookAtPos;
+    job.views[0].cameraUp = cameraUpVec;
+    job.views[0].output = outputFile;
+    job.fov = fov;
+    job.width = uint32_t(screenWidth);
+    job.height = uint32_t(screenHeight);
+    job.samplesPerPixel = samplesPerPixel;
+    job.samplesPerBatch = samplesPerBatch;
+
+    auto renderServer = RenderServer::create(rayTracer, tiledRenderer, job);
+    renderServer->animation = animation;
+
+    if (server) {
+      // Render jobs read from stdin until it is closed. Only results are printed into stdout
+      tiledRenderer->reportProgress = false;
+      renderServer->run(std::cin, std::cout);
+      return 0;
+    }
+
+    if (!renderServer->render(job)) {
+      return -1;
+    }
+    return 0;
+  }
+
+  // Frame time budget controller
+  std::optional<SamplesPerPixelController> sppController;
+  if (targetMilliseconds > 0.0) {
+    if (algorithm == SamplingAlgorithm::PATH_TRACING) {
+      sppController.emplace(targetMilliseconds, samplesPerPixel, minSamplesPerPixel, maxSamplesPerPixel);
+      samplesPerPixel = sppController->getSamplesPerPixel();
+    } else {
+      // Hammersley sequence for QMC is generated for a fixed number of samples
+      std::cerr << "--target-ms is supported only with path tracing algorithm" << std::endl;
+    }
+  }
+
+  // While loading, snapshots of the scene are rendered and replaced as more meshes arrive
+  vsg::ref_ptr<RayTracingScene> renderedScene = scene;
+  if (sceneLoader) {
+    // Wait for the first meshes, keeping the window responsive
+    vsg::UIEvents events;
+    while (!sceneLoader->finished() && scene->numInstances() == 0) {
+      window->pollEvents(events);
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (sceneLoader->finished()) {
+      if (!finishLoading()) {
+        return -1;
+      }
+    } else {
+      renderedScene = scene->createSnapshot();
+    }
+  }
+
+  // BLASes of meshes which arrived since the previous snapshot are built. Snapshots share the default environment map
+  vsg::ref_ptr<vsg::Data> defaultEnvMap;
+  auto buildScene = [&](vsg::ref_ptr<RayTracingScene> sceneToRender) {
+    if (!sceneToRender->envMap) {
+      if (!defaultEnvMap) {
+        defaultEnvMap = createDefaultEnvMap();
+      }
+      sceneToRender->envMap = defaultEnvMap;
+    }
+    blasBuilder->build(sceneToRender);
+    if (!sceneLoader || sceneToRender == scene) {
+      blasBuilder->report(sceneToRender).print(std::cout);
+    }
+  };
+  buildScene(renderedScene);
+
+  auto rayTracer = RayTracer::create(device, screenWidth, screenHeight, renderedScene, algorithm);
+  if (!noPipelineCache) {
+    // Ray tracing pipelines compiled in previous runs are reused
+    rayTracer->setPipelineCache(PipelineCache::create(pipelineCacheDir));
+  }
+  if (sppController) {
+    rayTracer->gpuTimer = GPUTimer::create(device, NUM_FRAMES_IN_FLIGHT);
+  }
+  rayTracer->toneMapParams = toneMapParams;
+  rayTracer->maxHistorySamples = maxHistorySamples;
+  rayTracer->setSamplesPerPixel(samplesPerPixel);
+
+  auto viewer = vsg::Viewer::create();
+  viewer->addWindow(window);
+
+  auto perspective = vsg::Perspective::create(fov, double(screenWidth) / double(screenHeight), 0.1, 1000.0);
+  auto lookAt = vsg::LookAt::create(cameraPos, lookAtPos, cameraUpVec);
+  auto camera = vsg::Camera::create(perspective, lookAt, vsg::ViewportState::create(window->extent2D()));
+
+  viewer->addEventHandler(vsg::CloseHandler::create(viewer));
+  viewer->addEventHandler(vsg::Trackball::create(camera));
+  viewer->addEventHandler(ToneMapKeyHandler::create(toneMapParams));
+
+  // Ray generation shader uses inverse of projection and view matrices
+  vsg::dmat4 viewMat, projectionMat;
+  lookAt->get(viewMat);
+  perspective->get(projectionMat);
+  rayTracer->setCameraParams(viewMat, projectionMat);
+
+  viewer->assignRecordAndSubmitTaskAndPresentation({ rayTracer->createCommandGraph(window) });
+  viewer->compile();
+
+  // For FPS measurement
+  int counter = 0;
+  auto lastTime = std::chrono::high_resolution_clock::now();
+  auto startTime = lastTime;
+  auto lastSnapshotTime = lastTime;
+
+  while (viewer->advanceToNextFrame()) {
+    viewer->handleEvents();
+
+    // Replace the rendered scene with a newer snapshot, or with the complete scene when loading finished.
+    // The ray tracer and its commands are kept, and only TLAS, descriptors and hit groups of the new scene are updated
+    if (sceneLoader) {
+      bool loaded = sceneLoader->finished();
+      std::chrono::duration<double> sinceSnapshot = std::chrono::high_resolution_clock::now() - lastSnapshotTime;
+      if (loaded || (sinceSnapshot.count() >= SNAPSHOT_INTERVAL_SECONDS && scene->numInstances() > renderedScene->numInstances())) {
+        if (loaded) {
+          if (!finishLoading()) {
+            return -1;
+          }
+          renderedScene = scene;
+        } else {
+          renderedScene = scene->createSnapshot();
+        }
+        buildScene(renderedScene);
+        rayTracer->setScene(renderedScene, window);
+        lastSnapshotTime = std::chrono::high_resolution_clock::now();
+      }
+    }
+
+    // Uniforms and the target image of the previous frame may still be in use by the GPU
+    rayTracer->advanceFrame();
+    lookAt->get(viewMat);
+    rayTracer->setCameraParams(viewMat, projectionMat);
+    rayTracer->updateMaterials();
+
+    // Move animated instances. TLAS is refitted in the command graph
+    if (animation) {
+      std::chrono::duration<double> time = std::chrono::high_resolution_clock::now() - startTime;
+      animation->update(time.count());
+    }
+
+    viewer->update();
+    viewer->recordAndSubmit();
+    viewer->present();
+
+    // Stream textures at the resolution requested by the rendered frames
+    if (scene->textureStreamer) {
+      scene->textureStreamer->update(rayTracer->getFrameIndex(), viewer->recordAndSubmitTasks[0]->fence());
+    }
+
+    // Adjust samples per pixel using GPU time of a finished frame
+    if (sppController) {
+      if (auto timing = rayTracer->gpuTimer->getFrameTiming()) {
+        uint32_t newSamplesPerPixel = sppController->update(timing->milliseconds, timing->samplesPerPixel);
+        if (newSamplesPerPixel != samplesPerPixel) {
+          samplesPerPixel = newSamplesPerPixel;
+          rayTracer->setSamplesPerPixel(samplesPerPixel);
+        }
+      }
+    }
+
+    // FPS measurement
+    ++counter;
+    if (counter >= FPS_MEASURE_COUNT) {
+      counter = 0;
+      auto elapsed = std::chrono::high_resolution_clock::now() - lastTime;
+      long long fps = std::chrono::seconds(FPS_MEASURE_COUNT) / elapsed;
+      std::cout << fps << " fps";
+      if (sppController) {
+        std::cout << " (" << samplesPerPixel << " spp)";
+      }
+      std::cout << std::endl;
+      lastTime = std::chrono::high_resolution_clock::now();
+    }
+  }
+
+  return 0;
 }
\ No newline at end of file
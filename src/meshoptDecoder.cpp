@@ -0,0 +1,386 @@
+#include "meshoptDecoder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Constants of the bitstreams (same as the reference implementation, meshoptimizer)
+const uint8_t VERTEX_HEADER = 0xa0;
+const uint8_t INDEX_HEADER = 0xe0;
+const uint8_t SEQUENCE_HEADER = 0xd0;
+const size_t BYTE_GROUP_SIZE = 16;
+const size_t BYTE_GROUP_DECODE_LIMIT = 24;
+const size_t VERTEX_BLOCK_SIZE_BYTES = 8192;
+const size_t VERTEX_BLOCK_MAX_SIZE = 256;
+const size_t TAIL_MAX_SIZE = 32;
+
+static uint8_t unzigzag8(uint8_t v)
+{
+  return uint8_t(-(v & 1) ^ (v >> 1));
+}
+
+// Decode a group of 16 bytes, each of which is encoded in 2^bitsLog2 bits (or a separate byte if it does not fit)
+static const uint8_t* decodeBytesGroup(const uint8_t* data, uint8_t* buffer, int bitsLog2)
+{
+  switch (bitsLog2) {
+  case 0:
+    std::memset(buffer, 0, BYTE_GROUP_SIZE);
+    return data;
+  case 1:
+  case 2:
+    {
+      int bits = 1 << bitsLog2;  // 2 or 4
+      uint8_t sentinel = uint8_t((1 << bits) - 1);
+      const uint8_t* dataVar = data + BYTE_GROUP_SIZE * bits / 8;
+      for (size_t i = 0; i < BYTE_GROUP_SIZE; ++i) {
+        // Values are packed from the most significant bits
+        uint8_t byte = data[i * bits / 8];
+        uint8_t encoded = uint8_t(byte >> (8 - bits - (i * bits) % 8)) & sentinel;
+        if (encoded == sentinel) {
+          buffer[i] = *dataVar++;
+        } else {
+          buffer[i] = encoded;
+        }
+      }
+      return dataVar;
+    }
+  default:
+    std::memcpy(buffer, data, BYTE_GROUP_SIZE);
+    return data + BYTE_GROUP_SIZE;
+  }
+}
+
+static const uint8_t* decodeBytes(const uint8_t* data, const uint8_t* dataEnd, uint8_t* buffer, size_t bufferSize)
+{
+  // 2-bit header per group
+  const uint8_t* header = data;
+  size_t headerSize = (bufferSize / BYTE_GROUP_SIZE + 3) / 4;
+  if (size_t(dataEnd - data) < headerSize) {
+    return nullptr;
+  }
+  data += headerSize;
+
+  for (size_t i = 0; i < bufferSize; i += BYTE_GROUP_SIZE) {
+    if (size_t(dataEnd - data) < BYTE_GROUP_DECODE_LIMIT) {
+      return nullptr;
+    }
+    size_t group = i / BYTE_GROUP_SIZE;
+    int bitsLog2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+    data = decodeBytesGroup(data, buffer + i, bitsLog2);
+  }
+  return data;
+}
+
+bool decodeMeshoptVertexBuffer(uint8_t* destination, size_t count, size_t byteStride, const uint8_t* buffer, size_t size)
+{
+  if (byteStride == 0 || byteStride > 256 || byteStride % 4 != 0 || size < 1 + byteStride) {
+    return false;
+  }
+  const uint8_t* data = buffer;
+  const uint8_t* dataEnd = buffer + size;
+
+  uint8_t header = *data++;
+  if ((header & 0xf0) != VERTEX_HEADER || (header & 0x0f) > 0) {
+    return false; // Unsupported version
+  }
+
+  // The first element is stored at the end, and deltas of later elements are decoded from it
+  size_t tailSize = std::max(byteStride, TAIL_MAX_SIZE);
+  if (size_t(dataEnd - data) < tailSize) {
+    return false;
+  }
+  std::vector<uint8_t> lastVertex(dataEnd - byteStride, dataEnd);
+
+  size_t blockSize = std::min((VERTEX_BLOCK_SIZE_BYTES / byteStride) & ~(BYTE_GROUP_SIZE - 1), VERTEX_BLOCK_MAX_SIZE);
+  std::vector<uint8_t> bytes(VERTEX_BLOCK_MAX_SIZE);
+
+  for (size_t first = 0; first < count; first += blockSize) {
+    size_t blockCount = std::min(blockSize, count - first);
+    size_t alignedCount = (blockCount + BYTE_GROUP_SIZE - 1) & ~(BYTE_GROUP_SIZE - 1);
+    uint8_t* blockDestination = destination + first * byteStride;
+
+    // Each byte of elements is stored separately
+    for (size_t k = 0; k < byteStride; ++k) {
+      data = decodeBytes(data, dataEnd, bytes.data(), alignedCount);
+      if (!data) {
+        return false;
+      }
+      uint8_t p = lastVertex[k];
+      for (size_t i = 0; i < blockCount; ++i) {
+        p = uint8_t(unzigzag8(bytes[i]) + p);
+        blockDestination[i * byteStride + k] = p;
+      }
+    }
+    std::memcpy(lastVertex.data(), blockDestination + (blockCount - 1) * byteStride, byteStride);
+  }
+
+  return size_t(dataEnd - data) == tailSize;
+}
+
+static uint32_t decodeVByte(const uint8_t*& data)
+{
+  uint8_t lead = *data++;
+  if (lead < 128) {
+    return lead;
+  }
+  uint32_t result = lead & 127;
+  uint32_t shift = 7;
+  for (int i = 0; i < 4; ++i) {
+    uint8_t group = *data++;
+    result |= uint32_t(group & 127) << shift;
+    shift += 7;
+    if (group < 128) {
+      break;
+    }
+  }
+  return result;
+}
+
+static uint32_t decodeIndex(const uint8_t*& data, uint32_t last)
+{
+  uint32_t v = decodeVByte(data);
+  uint32_t d = (v >> 1) ^ -int32_t(v & 1);
+  return last + d;
+}
+
+static void writeIndex(uint8_t* destination, size_t i, size_t indexSize, uint32_t index)
+{
+  if (indexSize == 2) {
+    uint16_t value = uint16_t(index);
+    std::memcpy(destination + i * 2, &value, 2);
+  } else {
+    std::memcpy(destination + i * 4, &index, 4);
+  }
+}
+
+bool decodeMeshoptIndexBuffer(uint8_t* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size)
+{
+  if (count % 3 != 0 || (indexSize != 2 && indexSize != 4) || size < 1 + count / 3 + 16) {
+    return false;
+  }
+  if ((buffer[0] & 0xf0) != INDEX_HEADER) {
+    return false;
+  }
+  int version = buffer[0] & 0x0f;
+  if (version > 1) {
+    return false;
+  }
+
+  // FIFOs of recently seen edges and vertices
+  uint32_t edgeFifo[16][2];
+  uint32_t vertexFifo[16];
+  std::memset(edgeFifo, -1, sizeof(edgeFifo));
+  std::memset(vertexFifo, -1, sizeof(vertexFifo));
+  size_t edgeFifoOffset = 0;
+  size_t vertexFifoOffset = 0;
+  auto pushEdge = [&](uint32_t a, uint32_t b) {
+    edgeFifo[edgeFifoOffset][0] = a;
+    edgeFifo[edgeFifoOffset][1] = b;
+    edgeFifoOffset = (edgeFifoOffset + 1) & 15;
+  };
+  auto pushVertex = [&](uint32_t v, bool condition = true) {
+    vertexFifo[vertexFifoOffset] = v;
+    vertexFifoOffset = (vertexFifoOffset + (condition ? 1 : 0)) & 15;
+  };
+
+  uint32_t next = 0;
+  uint32_t last = 0;
+  int fecMax = (version >= 1) ? 13 : 15;
+
+  // One code per triangle, then variable length data, and a table of 16 auxiliary codes at the end
+  const uint8_t* code = buffer + 1;
+  const uint8_t* data = code + count / 3;
+  const uint8_t* dataSafeEnd = buffer + size - 16;
+  const uint8_t* codeauxTable = dataSafeEnd;
+
+  for (size_t i = 0; i < count; i += 3) {
+    if (data > dataSafeEnd) {
+      return false;
+    }
+
+    uint8_t codetri = *code++;
+    uint32_t a, b, c;
+    if (codetri < 0xf0) {
+      // The triangle shares an edge with a recent one
+      int fe = codetri >> 4;
+      a = edgeFifo[(edgeFifoOffset - 1 - fe) & 15][0];
+      b = edgeFifo[(edgeFifoOffset - 1 - fe) & 15][1];
+
+      int fec = codetri & 15;
+      if (fec < fecMax) {
+        c = (fec == 0) ? next : vertexFifo[(vertexFifoOffset - 1 - fec) & 15];
+        next += (fec == 0) ? 1 : 0;
+        pushVertex(c, fec == 0);
+      } else {
+        // fec - (fec ^ 3) decodes 13 and 14 into -1 and 1
+        last = c = (fec != 15) ? last + (fec - (fec ^ 3)) : decodeIndex(data, last);
+        pushVertex(c);
+      }
+      pushEdge(c, b);
+      pushEdge(a, c);
+    } else {
+      int fea, feb, fec;
+      if (codetri < 0xfe) {
+        uint8_t codeaux = codeauxTable[codetri & 15];
+        fea = 0;
+        feb = codeaux >> 4;
+        fec = codeaux & 15;
+      } else {
+        uint8_t codeaux = *data++;
+        fea = (codetri == 0xfe) ? 0 : 15;
+        feb = codeaux >> 4;
+        fec = codeaux & 15;
+        if (codeaux == 0) {
+          next = 0; // Reset
+        }
+      }
+
+      // next is incremented for all three vertices before free indices are decoded (this matches the encoder)
+      a = (fea == 0) ? next++ : 0;
+      b = (feb == 0) ? next++ : vertexFifo[(vertexFifoOffset - feb) & 15];
+      c = (fec == 0) ? next++ : vertexFifo[(vertexFifoOffset - fec) & 15];
+      if (fea == 15) {
+        last = a = decodeIndex(data, last);
+      }
+      if (feb == 15) {
+        last = b = decodeIndex(data, last);
+      }
+      if (fec == 15) {
+        last = c = decodeIndex(data, last);
+      }
+
+      pushVertex(a);
+      pushVertex(b, feb == 0 || feb == 15);
+      pushVertex(c, fec == 0 || fec == 15);
+      pushEdge(b, a);
+      pushEdge(c, b);
+      pushEdge(a, c);
+    }
+
+    writeIndex(destination, i, indexSize, a);
+    writeIndex(destination, i + 1, indexSize, b);
+    writeIndex(destination, i + 2, indexSize, c);
+  }
+
+  // All data has to be consumed up to the auxiliary table
+  return data == dataSafeEnd;
+}
+
+bool decodeMeshoptIndexSequence(uint8_t* destination, size_t count, size_t indexSize, const uint8_t* buffer, size_t size)
+{
+  if ((indexSize != 2 && indexSize != 4) || size < 1 + count + 4) {
+    return false;
+  }
+  if ((buffer[0] & 0xf0) != SEQUENCE_HEADER || (buffer[0] & 0x0f) > 1) {
+    return false;
+  }
+
+  const uint8_t* data = buffer + 1;
+  const uint8_t* dataSafeEnd = buffer + size - 4;
+
+  // Indices are deltas from one of two baselines
+  uint32_t last[2] = { 0, 0 };
+  for (size_t i = 0; i < count; ++i) {
+    if (data >= dataSafeEnd) {
+      return false;
+    }
+    uint32_t v = decodeVByte(data);
+    uint32_t baseline = v & 1;
+    v >>= 1;
+    uint32_t d = (v >> 1) ^ -int32_t(v & 1);
+    last[baseline] += d;
+    writeIndex(destination, i, indexSize, last[baseline]);
+  }
+
+  return data == dataSafeEnd;
+}
+
+// Octahedral encoded normals and tangents (xyz of 8-bit or 16-bit signed normalized vectors)
+template<typename T>
+static void decodeFilterOctahedral(T* data, size_t count)
+{
+  const float maxValue = float((1 << (sizeof(T) * 8 - 1)) - 1);
+  auto roundToInt = [](float v) { return int(v + ((v >= 0.0f) ? 0.5f : -0.5f)); };
+  for (size_t i = 0; i < count; ++i) {
+    float x = float(data[i * 4 + 0]);
+    float y = float(data[i * 4 + 1]);
+    // z encodes 1.0 at the same bit count as x and y
+    float z = float(data[i * 4 + 2]) - std::abs(x) - std::abs(y);
+
+    // Fold back the lower hemisphere
+    float t = (z < 0.0f) ? z : 0.0f;
+    x += (x >= 0.0f) ? t : -t;
+    y += (y >= 0.0f) ? t : -t;
+
+    float scale = maxValue / std::sqrt(x * x + y * y + z * z);
+    data[i * 4 + 0] = T(roundToInt(x * scale));
+    data[i * 4 + 1] = T(roundToInt(y * scale));
+    data[i * 4 + 2] = T(roundToInt(z * scale));
+  }
+}
+
+// Quaternions stored as three smallest components and index of the largest one
+static void decodeFilterQuaternion(int16_t* data, size_t count)
+{
+  const float scale = 1.0f / std::sqrt(2.0f);
+  auto roundToInt = [](float v) { return int(v + ((v >= 0.0f) ? 0.5f : -0.5f)); };
+  for (size_t i = 0; i < count; ++i) {
+    // Scale is stored in the high bits of the 4th component
+    int sf = data[i * 4 + 3] | 3;
+    float ss = scale / float(sf);
+
+    float x = float(data[i * 4 + 0]) * ss;
+    float y = float(data[i * 4 + 1]) * ss;
+    float z = float(data[i * 4 + 2]) * ss;
+    float ww = 1.0f - x * x - y * y - z * z;
+    float w = std::sqrt(std::max(ww, 0.0f));
+
+    int maxComponent = data[i * 4 + 3] & 3;
+    data[i * 4 + ((maxComponent + 1) & 3)] = int16_t(roundToInt(x * 32767.0f));
+    data[i * 4 + ((maxComponent + 2) & 3)] = int16_t(roundToInt(y * 32767.0f));
+    data[i * 4 + ((maxComponent + 3) & 3)] = int16_t(roundToInt(z * 32767.0f));
+    data[i * 4 + ((maxComponent + 0) & 3)] = int16_t(roundToInt(w * 32767.0f));
+  }
+}
+
+// Floats stored as 24-bit mantissa and 8-bit exponent
+static void decodeFilterExponential(uint32_t* data, size_t count)
+{
+  for (size_t i = 0; i < count; ++i) {
+    uint32_t v = data[i];
+    int32_t mantissa = int32_t(v << 8) >> 8;
+    int32_t exponent = int32_t(v) >> 24;
+    float value = std::ldexp(float(mantissa), exponent);
+    std::memcpy(&data[i], &value, sizeof(float));
+  }
+}
+
+bool applyMeshoptFilter(uint8_t* data, size_t count, size_t byteStride, const std::string& filter)
+{
+  if (filter.empty() || filter == "NONE") {
+    return true;
+  } else if (filter == "OCTAHEDRAL") {
+    if (byteStride == 4) {
+      decodeFilterOctahedral(reinterpret_cast<int8_t*>(data), count);
+    } else if (byteStride == 8) {
+      decodeFilterOctahedral(reinterpret_cast<int16_t*>(data), count);
+    } else {
+      return false;
+    }
+    return true;
+  } else if (filter == "QUATERNION") {
+    if (byteStride != 8) {
+      return false;
+    }
+    decodeFilterQuaternion(reinterpret_cast<int16_t*>(data), count);
+    return true;
+  } else if (filter == "EXPONENTIAL") {
+    if (byteStride % 4 != 0) {
+      return false;
+    }
+    decodeFilterExponential(reinterpret_cast<uint32_t*>(data), count * byteStride / 4);
+    return true;
+  }
+  return false;
+}
@@ -1,88 +1,132 @@
-#include "utils.h"
-
-#include <cmath>
-#include <iostream>
-#include <vsg/core/Array2D.h>
-#include <vsg/maths/transform.h>
-#define TINYEXR_IMPLEMENTATION
-#include "tinyexr.h"
-
-vsg::ref_ptr<vsg::Node> createSphere(vsg::vec3 center, float radius)
-{
-  int numTheta = 32;
-  int numPhi = 64;
-
-  int numVertices = (numTheta + 1) * numPhi;
-  int numIndices = 6 * numTheta * numPhi;
-
-  auto vertices = vsg::vec3Array::create(numVertices);
-  auto normals = vsg::vec3Array::create(numVertices);
-  auto texCoords = vsg::vec2Array::create(numVertices);
-  auto indices = vsg::ushortArray::create(numIndices);
-
-  for (int i = 0; i <= numTheta; ++i) {
-    float v = float(i) / numTheta;
-    float theta = vsg::PIf * v;
-
-    for (int j = 0; j < numPhi; ++j) {
-      float u = float(j) / numPhi;
-      float phi = 2 * vsg::PIf * u;
-
-      auto normal = vsg::vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
-      
-      int vertId = numPhi * i + j;
-      vertices->set(vertId, normal * radius + center);
-      normals->set(vertId, normal);
-      texCoords->set(vertId, vsg::vec2(u, v));
-
-      if (i < numTheta) {
-        int nextI = i + 1;
-        int nextJ = (j + 1) % numPhi;
-        indices->set(6 * vertId, numPhi * i + j);
-        indices->set(6 * vertId + 1, numPhi * nextI + j);
-        indices->set(6 * vertId + 2, numPhi * nextI + nextJ);
-        indices->set(6 * vertId + 3, numPhi * i + j);
-        indices->set(6 * vertId + 4, numPhi * nextI + nextJ);
-        indices->set(6 * vertId + 5, numPhi * i + nextJ);
-      }
-    }
-  }
-
-  auto geom = vsg::Geometry::create();
-  geom->arrays = vsg::DataList{ vertices, normals, texCoords };
-  geom->indices = indices;
-
-  return geom;
-}
-
-vsg::ref_ptr<vsg::Node> createQuad(vsg::vec3 center, vsg::vec3 normal, vsg::vec3 up, float width, float height)
-{
-  auto builder = vsg::Builder::create();
-
-  vsg::GeometryInfo geomInfo;
-  geomInfo.dx = vsg::vec3(width, 0.0f, 0.0f);
-  geomInfo.dy = vsg::vec3(0.0f, height, 0.0f);
-  geomInfo.dz = vsg::vec3(0.0f, 0.0f, 1.0f);
-  geomInfo.transform = vsg::lookAt(center, center + normal, up);
-
-  return builder->createQuad(geomInfo);
-}
-
-vsg::ref_ptr<vsg::Data> loadEXRTexture(const std::string& path)
-{
-  float* data;
-  int width, height;
-  const char* error;
-  if (LoadEXR(&data, &width, &height, path.c_str(), &error) != TINYEXR_SUCCESS) {
-    std::cout << error << std::endl;
-    FreeEXRErrorMessage(error);
-    return {};  // EXR load failure
-  }
-
-  auto arr = vsg::vec4Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32B32A32_SFLOAT });
-  memcpy(arr->dataPointer(), data, arr->dataSize());
-
-  free(data);
-
-  return arr;
-}
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vsg/core/Array2D.h>
+#include <vsg/maths/transform.h>
+#include <vsg/vk/Extensions.h>
+#include "ProceduralShape.h"
+#define TINYEXR_IMPLEMENTATION
+#include "tinyexr.h"
+
+vsg::ref_ptr<vsg::Node> createSphere(vsg::vec3 center, float radius)
+{
+  return ProceduralShape::create(PrimitiveShape::SPHERE, vsg::translate(center) * vsg::scale(radius));
+}
+
+// Transform from the XY plane of object coordinate into a plane facing normal
+static vsg::mat4 planeTransform(vsg::vec3 center, vsg::vec3 normal, vsg::vec3 up, float halfWidth, float halfHeight)
+{
+  vsg::vec3 zAxis = vsg::normalize(normal);
+  vsg::vec3 xAxis = vsg::normalize(vsg::cross(up, zAxis));
+  vsg::vec3 yAxis = vsg::cross(zAxis, xAxis);
+
+  vsg::mat4 transform;
+  transform[0] = vsg::vec4(xAxis * halfWidth, 0.0f);
+  transform[1] = vsg::vec4(yAxis * halfHeight, 0.0f);
+  transform[2] = vsg::vec4(zAxis, 0.0f);
+  transform[3] = vsg::vec4(center, 1.0f);
+  return transform;
+}
+
+vsg::ref_ptr<vsg::Node> createQuad(vsg::vec3 center, vsg::vec3 normal, vsg::vec3 up, float width, float height)
+{
+  return ProceduralShape::create(PrimitiveShape::QUAD, planeTransform(center, normal, up, 0.5f * width, 0.5f * height));
+}
+
+vsg::ref_ptr<vsg::Node> createDisk(vsg::vec3 center, vsg::vec3 normal, vsg::vec3 up, float radius)
+{
+  return ProceduralShape::create(PrimitiveShape::DISK, planeTransform(center, normal, up, radius, radius));
+}
+
+vsg::ref_ptr<vsg::Data> loadEXRTexture(const std::string& path)
+{
+  float* data;
+  int width, height;
+  const char* error;
+  if (LoadEXR(&data, &width, &height, path.c_str(), &error) != TINYEXR_SUCCESS) {
+    std::cerr << error << std::endl;
+    FreeEXRErrorMessage(error);
+    return {};  // EXR load failure
+  }
+
+  auto arr = vsg::vec4Array2D::create(width, height, vsg::Data::Layout{ VK_FORMAT_R32G32B32A32_SFLOAT });
+  memcpy(arr->dataPointer(), data, arr->dataSize());
+
+  free(data);
+
+  return arr;
+}
+
+bool saveEXRImage(const std::string& path, int width, int height, std::vector<EXRChannel> channels)
+{
+  // Readers expect channels sorted by name
+  std::sort(channels.begin(), channels.end(), [](const EXRChannel& a, const EXRChannel& b) { return a.name < b.name; });
+
+  std::vector<EXRChannelInfo> channelInfos(channels.size());
+  std::vector<float*> images;
+  for (size_t i = 0; i < channels.size(); ++i) {
+    std::strncpy(channelInfos[i].name, channels[i].name.c_str(), sizeof(channelInfos[i].name) - 1);
+    images.push_back(channels[i].pixels.data());
+  }
+  // Saved as 32-bit float to keep the raw values
+  std::vector<int> pixelTypes(channels.size(), TINYEXR_PIXELTYPE_FLOAT);
+
+  EXRHeader header;
+  InitEXRHeader(&header);
+  header.num_channels = int(channels.size());
+  header.channels = channelInfos.data();
+  header.pixel_types = pixelTypes.data();
+  header.requested_pixel_types = pixelTypes.data();
+
+  EXRImage image;
+  InitEXRImage(&image);
+  image.num_channels = int(channels.size());
+  image.images = reinterpret_cast<unsigned char**>(images.data());
+  image.width = width;
+  image.height = height;
+
+  const char* error;
+  if (SaveEXRImageToFile(&image, &header, path.c_str(), &error) != TINYEXR_SUCCESS) {
+    std::cerr << error << std::endl;
+    FreeEXRErrorMessage(error);
+    return false;
+  }
+
+  return true;
+}
+
+VkDeviceAddress getBufferDeviceAddress(vsg::Device* device, vsg::ref_ptr<vsg::Buffer> buffer)
+{
+  VkBufferDeviceAddressInfo addressInfo{};
+  addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+  addressInfo.buffer = buffer->vk(device->deviceID);
+
+  return device->getExtensions()->vkGetBufferDeviceAddressKHR(*device, &addressInfo);
+}
+
+vsg::ref_ptr<vsg::Buffer> createHostVisibleBuffer(vsg::Device* device, vsg::ref_ptr<vsg::Data> data, VkBufferUsageFlags usage)
+{
+  auto buffer = vsg::createBufferAndMemory(
+    device, data->dataSize(), usage,
+    VK_SHARING_MODE_EXCLUSIVE, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  auto memory = buffer->getDeviceMemory(device->deviceID);
+  void* mappedData;
+  memory->map(buffer->getMemoryOffset(device->deviceID), data->dataSize(), 0, &mappedData);
+  std::memcpy(mappedData, data->dataPointer(), data->dataSize());
+  memory->unmap();
+
+  return buffer;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}